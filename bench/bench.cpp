@@ -0,0 +1,396 @@
+/* Benchmarks of sickle, run with `make bench`.
+
+The micro-benchmarks time the sliding window (per quality type and read
+length), GZReader::read_lines on plain and gzipped files, the parsing of
+FQEntry records from a batch and the formatting of the output records.
+The end-to-end benchmarks run the sickle binary in se, pe and interleaved
+mode at several thread counts and batch sizes.
+
+All inputs are synthetic, made from a fixed seed, and the results are
+written as JSON to compare releases. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+
+#include "sickle.h"
+#include "trim_paired.h"
+#include "GZReader.h"
+#include "Batch.h"
+#include "FQEntry.h"
+#include "stats.h"
+
+using namespace std;
+
+/* Best of this many runs of each micro-benchmark */
+#ifndef BENCH_REPEATS
+#define BENCH_REPEATS 3
+#endif
+
+#ifndef BENCH_SEED
+#define BENCH_SEED 20111
+#endif
+
+/* Exposes the trimming and formatting functions of the pe trimmer */
+class Bench_Trimmer : public Trim_Paired{
+public:
+    using Abstract_Trimmer::sliding_window;
+    using Abstract_Trimmer::append_read;
+    void set_qualtype(int type){
+        qualtype = type;
+        prepare_filters();
+    }
+};
+
+struct Record{
+    string name, seq, comment, qual;
+};
+
+struct Result{
+    string name;
+    //extra JSON fields, already formatted
+    string params;
+    long reads;
+    uint64_t bytes;
+    double seconds;
+};
+
+static uint64_t rng_state = BENCH_SEED;
+
+static uint64_t next_random(){
+    //xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+/* Random bases, with qualities that decay towards the 3' end as in Illumina reads */
+static vector<Record> make_records(long n, int len, int qualtype){
+    int offset = quality_constants[qualtype][Q_OFFSET];
+    int min_q = qualtype == SOLEXA ? -5 : 2;
+    vector<Record> records(n);
+    for(long i = 0; i < n; i++){
+        Record &rec = records[i];
+        rec.name = "@bench:" + to_string(i);
+        rec.comment = "+";
+        rec.seq.resize(len);
+        rec.qual.resize(len);
+        for(int pos = 0; pos < len; pos++){
+            rec.seq[pos] = "ACGT"[next_random() % 4];
+            double decay = (double)pos / len;
+            int q = 40 - (int)(decay * decay * 35) + (int)(next_random() % 7) - 3;
+            q = max(min_q, min(41, q));
+            rec.qual[pos] = (char)(q + offset);
+        }
+    }
+    return records;
+}
+
+static void make_entries(vector<Record> &records, vector<FQEntry> &entries){
+    entries.resize(records.size());
+    for(size_t i = 0; i < records.size(); i++){
+        entries[i].name = records[i].name;
+        entries[i].seq = records[i].seq;
+        entries[i].comment = records[i].comment;
+        entries[i].qual = records[i].qual;
+    }
+}
+
+static uint64_t records_bytes(vector<Record> &records){
+    uint64_t bytes = 0;
+    for(size_t i = 0; i < records.size(); i++){
+        bytes += records[i].name.length() + records[i].seq.length() + records[i].comment.length()
+            + records[i].qual.length() + 4;
+    }
+    return bytes;
+}
+
+static int write_fastq(const char* path, vector<Record> &records, size_t first, size_t step, bool gzip){
+    gzFile out = gzopen(path, gzip ? "w6" : "wT");
+    if(!out){
+        fprintf(stderr, "****Error: Could not open benchmark input file '%s'.\n\n", path);
+        return EXIT_FAILURE;
+    }
+    for(size_t i = first; i < records.size(); i += step){
+        Record &rec = records[i];
+        gzwrite_str(out, rec.name + "\n" + rec.seq + "\n" + rec.comment + "\n" + rec.qual + "\n");
+    }
+    gzclose(out);
+    return 0;
+}
+
+static void bench_sliding_window(vector<Result> &results, long bases){
+    static const int qualtypes[] = {SANGER, ILLUMINA, SOLEXA};
+    static const int lengths[] = {50, 100, 150, 250};
+    Bench_Trimmer trimmer;
+    for(int qualtype: qualtypes){
+        trimmer.set_qualtype(qualtype);
+        for(int len: lengths){
+            vector<Record> records = make_records(bases / len, len, qualtype);
+            vector<FQEntry> entries;
+            make_entries(records, entries);
+            double best = -1;
+            for(int rep = 0; rep < BENCH_REPEATS; rep++){
+                timepoint start = stats_now();
+                for(size_t i = 0; i < entries.size(); i++){
+                    free(trimmer.sliding_window(entries[i]));
+                }
+                double seconds = seconds_between(start, stats_now());
+                if(best < 0 || seconds < best) best = seconds;
+            }
+            string params = "\"qual_type\": \"" + string(typenames[qualtype]) + "\", \"read_length\": " + to_string(len);
+            results.push_back({"sliding_window", params, (long)entries.size(), records_bytes(records), best});
+        }
+    }
+}
+
+static void bench_read_lines(vector<Result> &results, vector<Record> &records, const string &tmp_dir){
+    for(int gzip = 0; gzip <= 1; gzip++){
+        string path = tmp_dir + "/sickle_bench_read" + (gzip ? ".fq.gz" : ".fq");
+        if(write_fastq(path.c_str(), records, 0, 1, gzip)) exit(EXIT_FAILURE);
+        double best = -1;
+        long lines = 0;
+        for(int rep = 0; rep < BENCH_REPEATS; rep++){
+            timepoint start = stats_now();
+            GZReader* reader = new GZReader(strdup(path.c_str()), 16*1024*1024, false);
+            lines = 0;
+            Batch* batch;
+            while((batch = reader->get_batch_buffering_lines()) != NULL){
+                lines += batch->n_lines();
+                batch->free_this();
+                delete(batch);
+            }
+            delete(reader);
+            double seconds = seconds_between(start, stats_now());
+            if(best < 0 || seconds < best) best = seconds;
+        }
+        remove(path.c_str());
+        string params = string("\"gzip\": ") + (gzip ? "true" : "false");
+        results.push_back({"read_lines", params, lines / 4, records_bytes(records), best});
+    }
+}
+
+static void bench_parse(vector<Result> &results, vector<Record> &records){
+    vector<const char*> lines;
+    for(size_t i = 0; i < records.size(); i++){
+        lines.push_back(records[i].name.c_str());
+        lines.push_back(records[i].seq.c_str());
+        lines.push_back(records[i].comment.c_str());
+        lines.push_back(records[i].qual.c_str());
+    }
+    double best = -1;
+    for(int rep = 0; rep < BENCH_REPEATS; rep++){
+        timepoint start = stats_now();
+        //the lines are owned by the records, so the batch is not freed
+        Batch batch(&lines);
+        int position = 0;
+        while(batch.has_lines()){
+            FQEntry* fqrec = new FQEntry(position, &batch);
+            position = fqrec->position;
+            delete(fqrec);
+        }
+        double seconds = seconds_between(start, stats_now());
+        if(best < 0 || seconds < best) best = seconds;
+    }
+    results.push_back({"fqentry_parse", "", (long)records.size(), records_bytes(records), best});
+}
+
+static void bench_format(vector<Result> &results, vector<Record> &records){
+    Bench_Trimmer trimmer;
+    BufferPool pool;
+    vector<FQEntry> entries;
+    make_entries(records, entries);
+    cutsites cs;
+    double best = -1;
+    uint64_t bytes = 0;
+    for(int rep = 0; rep < BENCH_REPEATS; rep++){
+        timepoint start = stats_now();
+        OutputBuffer out(&pool, records_bytes(records));
+        for(size_t i = 0; i < entries.size(); i++){
+            cs.five_prime_cut = 0;
+            cs.three_prime_cut = entries[i].seq.length() - (i % 20);
+            trimmer.append_read(out, &entries[i], &cs);
+        }
+        bytes = out.length();
+        double seconds = seconds_between(start, stats_now());
+        if(best < 0 || seconds < best) best = seconds;
+    }
+    results.push_back({"format", "", (long)entries.size(), bytes, best});
+}
+
+static vector<int> parse_list(const char* list){
+    vector<int> values;
+    stringstream in(list);
+    string item;
+    while(getline(in, item, ',')){
+        int value = atoi(item.c_str());
+        if(value > 0) values.push_back(value);
+    }
+    return values;
+}
+
+static int bench_end_to_end(vector<Result> &results, const string &sickle, const string &tmp_dir, long n,
+    vector<int> &thread_counts, vector<int> &batch_mbs)
+{
+    vector<Record> records = make_records(2*n, 150, SANGER);
+    string se = tmp_dir + "/sickle_bench_se.fq";
+    string r1 = tmp_dir + "/sickle_bench_r1.fq";
+    string r2 = tmp_dir + "/sickle_bench_r2.fq";
+    string out = tmp_dir + "/sickle_bench_out";
+    //the se input has the same reads as the pe ones, interleaved
+    if(write_fastq(se.c_str(), records, 0, 1, false)) return EXIT_FAILURE;
+    if(write_fastq(r1.c_str(), records, 0, 2, false)) return EXIT_FAILURE;
+    if(write_fastq(r2.c_str(), records, 1, 2, false)) return EXIT_FAILURE;
+    uint64_t bytes = records_bytes(records);
+
+    static const char* modes[] = {"se", "pe", "interleaved"};
+    for(const char* mode: modes){
+        for(int threads: thread_counts){
+            for(int batch_mb: batch_mbs){
+                string args = " -t sanger -a " + to_string(threads) + " -b " + to_string(batch_mb);
+                string cmd;
+                if(!strcmp(mode, "se")){
+                    cmd = sickle + " se -f " + se + " -o " + out + "1.fq" + args;
+                }else if(!strcmp(mode, "pe")){
+                    cmd = sickle + " pe -f " + r1 + " -r " + r2 + " -o " + out + "1.fq -p " + out + "2.fq -s "
+                        + out + "s.fq" + args;
+                }else{
+                    cmd = sickle + " pe -c " + se + " -m " + out + "1.fq -s " + out + "s.fq" + args;
+                }
+                cmd += " > /dev/null";
+                timepoint start = stats_now();
+                int status = system(cmd.c_str());
+                double seconds = seconds_between(start, stats_now());
+                if(status != 0){
+                    fprintf(stderr, "****Error: Benchmark command failed: %s\n\n", cmd.c_str());
+                    return EXIT_FAILURE;
+                }
+                string params = "\"mode\": \"" + string(mode) + "\", \"threads\": " + to_string(threads)
+                    + ", \"batch_mb\": " + to_string(batch_mb);
+                results.push_back({"end_to_end", params, (long)records.size(), bytes, seconds});
+            }
+        }
+    }
+    const char* outputs[] = {"1.fq", "2.fq", "s.fq"};
+    for(const char* suffix: outputs) remove((out + suffix).c_str());
+    remove(se.c_str());
+    remove(r1.c_str());
+    remove(r2.c_str());
+    return 0;
+}
+
+static void write_results(ostream &out, vector<Result> &results){
+    out << "{\n";
+    out << "  \"sickle_version\": \"" << VERSION << "\",\n";
+    out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"results\": [";
+    for(size_t i = 0; i < results.size(); i++){
+        Result &res = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"benchmark\": \"" << res.name << "\", ";
+        if(!res.params.empty()) out << res.params << ", ";
+        out << "\"reads\": " << res.reads << ", \"bytes\": " << res.bytes << ", \"seconds\": " << res.seconds
+            << ", \"reads_per_second\": " << (res.seconds > 0 ? res.reads / res.seconds : 0)
+            << ", \"mb_per_second\": " << (res.seconds > 0 ? res.bytes / res.seconds / (1024*1024) : 0) << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static struct option bench_long_options[] = {
+    {"sickle", required_argument, 0, 's'},
+    {"output", required_argument, 0, 'o'},
+    {"tmp-dir", required_argument, 0, 'd'},
+    {"reads", required_argument, 0, 'n'},
+    {"e2e-reads", required_argument, 0, 'e'},
+    {"threads", required_argument, 0, 'a'},
+    {"batches", required_argument, 0, 'b'},
+    {"no-e2e", no_argument, 0, 'E'},
+    {"no-micro", no_argument, 0, 'M'},
+    {"help", no_argument, 0, 'h'},
+    {NULL, 0, NULL, 0}
+};
+
+static void usage(int status){
+    fprintf(stderr, "\nUsage: sickle_bench [options]\n\
+\n\
+Options:\n\
+-s, --sickle, sickle binary for the end-to-end benchmarks. Default ./sickle\n\
+-o, --output, JSON results file. Default: standard output\n\
+-d, --tmp-dir, Directory for the benchmark inputs and outputs. Default /tmp\n\
+-n, --reads, Reads of the micro-benchmarks. Default 200000\n\
+-e, --e2e-reads, Reads (or pairs) of the end-to-end benchmarks. Default 200000\n\
+-a, --threads, Comma separated thread counts of the end-to-end benchmarks. Default 1,2,4\n\
+-b, --batches, Comma separated batch sizes, in MB, of the end-to-end benchmarks. Default 4,16,64\n\
+--no-e2e, Only run the micro-benchmarks\n\
+--no-micro, Only run the end-to-end benchmarks\n\
+--help, display this help and exit\n\n");
+    exit(status);
+}
+
+int main(int argc, char *argv[]){
+    string sickle = "./sickle";
+    string tmp_dir = "/tmp";
+    char* outfn = NULL;
+    long n = 200000;
+    long e2e_n = 200000;
+    vector<int> thread_counts = {1, 2, 4};
+    vector<int> batch_mbs = {4, 16, 64};
+    bool micro = true, e2e = true;
+
+    int optc;
+    while((optc = getopt_long(argc, argv, "s:o:d:n:e:a:b:h", bench_long_options, NULL)) != -1){
+        switch(optc){
+        case 's': sickle = optarg; break;
+        case 'o': outfn = optarg; break;
+        case 'd': tmp_dir = optarg; break;
+        case 'n': n = atol(optarg); break;
+        case 'e': e2e_n = atol(optarg); break;
+        case 'a': thread_counts = parse_list(optarg); break;
+        case 'b': batch_mbs = parse_list(optarg); break;
+        case 'E': e2e = false; break;
+        case 'M': micro = false; break;
+        case 'h': usage(EXIT_SUCCESS); break;
+        default: usage(EXIT_FAILURE);
+        }
+    }
+    if(n < 1 || e2e_n < 1 || thread_counts.empty() || batch_mbs.empty()){
+        fprintf(stderr, "****Error: Read counts, thread counts and batch sizes must be >= 1.\n\n");
+        return EXIT_FAILURE;
+    }
+
+    vector<Result> results;
+    if(micro){
+        fprintf(stderr, "Running micro-benchmarks\n");
+        bench_sliding_window(results, n * 150);
+        vector<Record> records = make_records(n, 150, SANGER);
+        bench_read_lines(results, records, tmp_dir);
+        bench_parse(results, records);
+        bench_format(results, records);
+    }
+    if(e2e){
+        fprintf(stderr, "Running end-to-end benchmarks with %s\n", sickle.c_str());
+        int res = bench_end_to_end(results, sickle, tmp_dir, e2e_n, thread_counts, batch_mbs);
+        if(res != 0) return res;
+    }
+
+    if(outfn){
+        ofstream out(outfn);
+        if(!out){
+            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
+            return EXIT_FAILURE;
+        }
+        write_results(out, results);
+    }else{
+        write_results(cout, results);
+    }
+    return EXIT_SUCCESS;
+}
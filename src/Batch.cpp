@@ -6,6 +6,9 @@ using namespace std;
 Batch::Batch(vector<const char*>* lines_raw){
     //msg("Making buffer");
     this->lines_raw = lines_raw;
+    pool = NULL;
+    end_file = 0;
+    end_offset = -1;
     last_line = -1;
     sequences_len = 0;
     //int lines_with_n = 0;
@@ -20,6 +23,11 @@ Batch::Batch(vector<const char*>* lines_raw){
     assert(lines.size() % 4 == 0);
 }
 
+Batch::Batch(vector<const char*>* lines_raw, PoolBlock block, BufferPool* pool): Batch(lines_raw){
+    this->block = block;
+    this->pool = pool;
+}
+
 Batch::Batch(vector<const char*>* lines_raw, vector<const char*>* previous_lines){
     //msg("Making buffer");
     this->lines_raw = lines_raw;
@@ -27,6 +35,9 @@ Batch::Batch(vector<const char*>* lines_raw, vector<const char*>* previous_lines
     //msg(to_string(lines_raw->size()));
     //msg(to_string(lines_raw->size()%4));
     this->previous_lines = previous_lines;
+    pool = NULL;
+    end_file = 0;
+    end_offset = -1;
     //msg("previous_lines");
     //msg(to_string(previous_lines->size()));
     last_line = -1;
@@ -50,9 +61,8 @@ Batch::Batch(vector<const char*>* lines_raw, vector<const char*>* previous_lines
 }
 
 void Batch::free_this(){
-    for(int i = 0; i < lines_raw->size(); i++){
-		delete(lines_raw->at(i));
-	}
+    //the lines are in the block, or owned by the caller without a pool
+    if(pool) pool->release(block);
 	delete(lines_raw);
 }
 
@@ -60,6 +70,10 @@ int Batch::n_lines(){
     return lines.size();
 }
 
+size_t Batch::block_bytes(){
+    return pool ? block.capacity : 0;
+}
+
 bool Batch::has_lines(){
     return last_line+1 < lines.size();
 }
@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <iostream>
 #include "sickle.h"
+#include "pool.h"
 
 using namespace std;
 
@@ -18,6 +19,8 @@ class Batch{
 public:
     //Batch(const char * buffer, bool eof = false);
     Batch(vector<const char*>* lines);
+    //lines in block, which goes back to pool when the batch is freed
+    Batch(vector<const char*>* lines, PoolBlock block, BufferPool* pool);
     Batch(vector<const char*>* lines, vector<const char*>* previous_lines);
     bool has_lines();
 
@@ -26,7 +29,12 @@ public:
     const char * get_remainder();
 
     int sequences_len;
+    //input file and offset in its text right after the records of the batch, or -1, for --checkpoint
+    size_t end_file;
+    int64_t end_offset;
     int n_lines();
+    //capacity of the block of the lines, 0 without one
+    size_t block_bytes();
     void free_this();
 private:
     //void splitSVPtr(std::string_view delims = " ");
@@ -35,6 +43,8 @@ private:
     size_t last_line;
     vector<const char*>* lines_raw;
     vector<const char*>* previous_lines;
+    PoolBlock block;
+    BufferPool* pool;
 
     //void make_lines();
 
@@ -60,7 +60,7 @@ void FQEntry::validate(){
         error(string("Sequence: ") + string(seq));
         error(string("Comment: ") + string(comment));
         error(string("Qualities: ") + string(qual));
-        exit(EXIT_FAILURE);
+        throw TrimError{EXIT_FAILURE};
     }
 
     if(name.at(0) != '@'){
@@ -70,19 +70,19 @@ void FQEntry::validate(){
         error(string("Sequence: ") + string(seq));
         error(string("Comment: ") + string(comment));
         error(string("Qualities: ") + string(qual));
-        exit(EXIT_FAILURE);
+        throw TrimError{EXIT_FAILURE};
     }
 
     if(seq.length() < 1){
         //error(actual_seq);
         error("Sequence line is empty");
-        exit(EXIT_FAILURE);
+        throw TrimError{EXIT_FAILURE};
     }
 
     if(qual.length() < 1){
         //error(actual_seq);
         error("Quality line is empty.");
-        exit(EXIT_FAILURE);
+        throw TrimError{EXIT_FAILURE};
     }
 
     if(qual.length() != seq.length()){
@@ -90,7 +90,7 @@ void FQEntry::validate(){
         error("Sequence and quality lines have different lengths:");
         error(string(seq));
         error(string(qual));
-        exit(EXIT_FAILURE);
+        throw TrimError{EXIT_FAILURE};
     }
 
     //msg("FQEntry validated");
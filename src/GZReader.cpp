@@ -1,41 +1,134 @@
 #include <iostream>
+#include <climits>
 #include <stdexcept>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <thread>
+#include <sys/stat.h>
 #include "GZReader.h"
+#include "binary.h"
 
+int input_files(const char* spec, vector<string> &files){
+    files.clear();
+    string list = spec;
+    size_t start = 0;
+    while(start <= list.length()){
+        size_t comma = list.find(',', start);
+        if(comma == string::npos) comma = list.length();
+        string name = list.substr(start, comma - start);
+        start = comma + 1;
+        if(name.empty()) continue;
+        if(name.find_first_of("*?[") == string::npos){
+            if(access(name.c_str(), R_OK) != 0){
+                fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+            files.push_back(name);
+            continue;
+        }
+        glob_t matches;
+        if(glob(name.c_str(), 0, NULL, &matches) != 0){
+            fprintf(stderr, "****Error: No input files match '%s'.\n\n", name.c_str());
+            globfree(&matches);
+            return EXIT_FAILURE;
+        }
+        for(size_t i = 0; i < matches.gl_pathc; i++) files.push_back(matches.gl_pathv[i]);
+        globfree(&matches);
+    }
+    if(files.empty()){
+        fprintf(stderr, "****Error: No input files in '%s'.\n\n", spec);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
 
-GZReader::GZReader(char* path, int batch_len, bool interleaved){
+uint64_t input_size(const char* spec){
+    uint64_t size = 0;
+    //errors are printed when the readers open the files
+    string list = spec;
+    size_t start = 0;
+    while(start <= list.length()){
+        size_t comma = list.find(',', start);
+        if(comma == string::npos) comma = list.length();
+        string name = list.substr(start, comma - start);
+        start = comma + 1;
+        glob_t matches;
+        if(name.empty() || glob(name.c_str(), GLOB_NOCHECK, NULL, &matches) != 0) continue;
+        for(size_t i = 0; i < matches.gl_pathc; i++){
+            struct stat info;
+            if(stat(matches.gl_pathv[i], &info) == 0) size += info.st_size;
+        }
+        globfree(&matches);
+    }
+    return size;
+}
+
+
+GZReader::GZReader(char* path, int batch_len, bool interleaved, BufferPool* pool){
     if(interleaved){
         min_lines_in_batch = 8;
     }else{
         min_lines_in_batch = 4;
     }
-    std::cout << "Building reader for " << path << "\n";
-    file = gzopen(path, "r");
-    if (!file) {
-        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", path);
+    msg(string("Building reader for ") + path);
+    file = NULL;
+    file_n = 0;
+    batch_end = -1;
+    finished_bytes = 0;
+    opened = input_files(path, files) == 0;
+    if (opened) {
+        file = gzopen(files[0].c_str(), "r");
+        if (!file) {
+            fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", files[0].c_str());
+            opened = false;
+        }
     }
+    binary = opened && read_binary_header();
     eof = false;
+    consumed_bytes = 0;
     this->path = path;
     this->batch_len = batch_len;
+    last_lines_count = 0;
+    long_reads = false;
+    file_done = false;
+    follow = false;
+    follow_timeout = 0;
+    follow_stopping = false;
+    own_pool = pool == NULL;
+    this->pool = own_pool ? new BufferPool() : pool;
 }
 
 GZReader::~GZReader(){
     //msg("destructing gzreader instance");
-    delete(path);
-    gzclose(file);
+    free(path);
+    if(file) gzclose(file);
+    if(own_pool) delete(pool);
     //msg("closed gzfile");
 }
 
 Batch* GZReader::get_batch_buffering_lines()
 {
     if(eof) return NULL;
-    vector<const char*>* lines = read_lines();
+    PoolBlock block = {NULL, 0, false};
+    vector<const char*>* lines;
+    try{
+        lines = binary ? read_binary(block) : long_reads ? read_records(block) : read_lines(block);
+    }catch(TrimError &){
+        //nothing more is read from a damaged input
+        if(block.data) pool->release(block);
+        eof = true;
+        throw;
+    }
     if(lines->size() > 0){
         Batch* batch;
-        batch = new Batch(lines);
+        batch = new Batch(lines, block, pool);
+        batch->end_file = file_n;
+        batch->end_offset = batch_end;
         return batch;
-        return NULL;
     }else{
+        pool->release(block);
+        delete(lines);
         return NULL;
     }
 }
@@ -48,7 +141,7 @@ tuple<const char*, int> GZReader::read_n_chars(int n_chars){
         eof = true;
     }else if(chars_read > n_chars){
         error("MORE CHARACTERS READ THAN BUFFER SIZE!");
-        exit(EXIT_FAILURE);
+        throw TrimError{EXIT_FAILURE};
     }
     big_buffer[chars_read] = '\0';
     msg(string("Read ")+to_string(chars_read)+string(" chars"));
@@ -56,82 +149,238 @@ tuple<const char*, int> GZReader::read_n_chars(int n_chars){
     return {big_buffer, chars_read};
 }
 
-vector<const char*>* GZReader::read_lines(){
+size_t GZReader::block_bytes(){
+    //the lines or text carried from the last batch, and 2.5 times batch_len (see read_lines)
+    size_t carried = pending.length();
+    for(size_t i = 0; i < last_remainder.size(); i++) carried += last_remainder[i].length() + 1;
+    return carried + 2 * (size_t)batch_len + batch_len / 2 + (long_reads && !binary ? LONG_READ_CHUNK : 0) + 1;
+}
+
+vector<const char*>* GZReader::read_lines(PoolBlock &block){
     vector<const char*>* lines = new vector<const char*>();
+    lines->reserve(last_lines_count + min_lines_in_batch);
     int remaining = batch_len;
-    char *buffer = last_lines_buffer;
-    if(buffer == NULL){
-        buffer = new char[batch_len];
-    }
-    char* line;
+    /* gzgets reads lines of up to batch_len chars until batch_len of them, not
+    counting their terminators, are read. Half a batch more holds the terminators
+    of lines of 3 or more chars; only shorter ones end the batch early. */
+    block = pool->acquire(block_bytes());
+    char* next = block.data;
     size_t line_len;
-    if(last_remainder != NULL){
-        for(int i = 0; i < last_remainder->size(); i++){
-            const char* line = (*last_remainder)[i];
-            line_len = strlen(line);
-            remaining -= line_len;
-            lines->push_back(line);
-        }
+    int lines_read = 0;
+    for(size_t i = 0; i < last_remainder.size(); i++){
+        line_len = last_remainder[i].length();
+        memcpy(next, last_remainder[i].c_str(), line_len + 1);
+        lines->push_back(next);
+        next += line_len + 1;
+        remaining -= line_len;
     }
+    last_remainder.clear();
     do{
-        if(!gzgets(file,buffer,batch_len)){
-            eof = true;
-            break;
+        size_t carried = partial_line.length();
+        memcpy(next, partial_line.data(), carried);
+        partial_line.clear();
+        if(!gzgets(file, next + carried, batch_len - carried)){
+            if(carried == 0 && open_next_file()) continue;
+            if(follow && !follow_ended()){
+                partial_line.assign(next, carried);
+                //the whole records so far are trimmed while the rest is written
+                if(lines->size() >= (size_t)min_lines_in_batch) break;
+                follow_wait();
+                continue;
+            }
+            if(carried == 0){
+                eof = true;
+                break;
+            }
+            //the file ended in the middle of its last line
+            next[carried] = '\0';
         }
-        line_len = strlen(buffer)-1;
-        remaining -= line_len;
-        if(buffer[line_len-1] != '\n'){
-            line_len += 1;
-        }
-        line = new char[line_len+1];
-        strncpy(line, buffer, line_len);
-        line[line_len-1] = '\0';
-        //msg(line);
-        lines->push_back(line);
-        //msg("stored new line");
-    }while(remaining > 0);
-    /*if(buffer){
-        delete(buffer);
-    }*/
-
-    //msg("read lines from buffer");
-    if(last_remainder != NULL){
-        //msg("deleting last remainder");
-        delete(last_remainder);
-        last_remainder = NULL;
-        //msg("deleted it");
-    }
+        line_len = strlen(next);
+        if(follow && line_len > carried) last_data = chrono::steady_clock::now();
+        if(follow && line_len > 0 && next[line_len-1] != '\n' && gzeof(file) && !follow_ended()){
+            //gzgets stopped at the end of what is written so far, the line goes on in the next read
+            partial_line.assign(next, line_len);
+            gzclearerr(file);
+            continue;
+        }
+        remaining -= (int)line_len - 1;
+        if(line_len > 0 && next[line_len-1] == '\n'){
+            line_len -= 1;
+            next[line_len] = '\0';
+        }
+        lines->push_back(next);
+        next += line_len + 1;
+        if(++lines_read % GZREADER_OFFSET_LINES == 0) consumed_bytes = finished_bytes + gzoffset(file);
+    }while(remaining > 0 && (size_t)(next - block.data) + batch_len <= block.capacity);
+    consumed_bytes = finished_bytes + gzoffset(file);
+
     int extra_lines = lines->size() % min_lines_in_batch;
-    if(extra_lines > 0 && lines->size() > 0){
-        //msg("adding extra lines");
-        //msg(to_string(extra_lines));
-        //msg(to_string(lines->size()));
-        last_remainder = new vector<const char*>(extra_lines);
-        for(int i = extra_lines-1; i >= 0; i--){
-            //msg(to_string(i));
-            //msg("to");
-            //msg(to_string(lines->size()-1));
-            //msg("value:");
-            const char* value = lines->at(lines->size()-1);
-            //msg(value);
-            (*last_remainder)[i]= value;
-            //msg("pushed");
-            lines->pop_back();
-            //msg("erased value");
-            //last_remainder[i] = lines[last_remainder->size()-extra_lines+i];
-        }
-        //msg("added them");
-        //msg(to_string(last_remainder->size()));
-        /*for(int i = 0; i < extra_lines; i++){
-            lines->erase(lines->end());
-        }*/
-        //msg("erased from lines");
+    if(extra_lines > 0){
+        for(size_t i = lines->size() - extra_lines; i < lines->size(); i++){
+            last_remainder.push_back(string(lines->at(i)));
+        }
+        lines->resize(lines->size() - extra_lines);
     }
+    last_lines_count = lines->size();
+    size_t carried = partial_line.length();
+    for(size_t i = 0; i < last_remainder.size(); i++) carried += last_remainder[i].length() + 1;
+    batch_end = records_end_offset(carried);
 
     return lines;
 }
 
 
+vector<const char*>* GZReader::read_records(PoolBlock &block){
+    /* The file is read in chunks and split in lines here, so lines can be of
+    any length; the block grows to hold the records. The batch ends with the
+    first record that takes it to batch_len bases. */
+    block = pool->acquire(block_bytes());
+    size_t used = pending.length();
+    memcpy(block.data, pending.data(), used);
+    pending.clear();
+
+    vector<size_t> starts;
+    size_t line_start = 0, scanned = 0;
+    size_t records_end = 0, record_lines = 0;
+    long bases = 0;
+    bool full = false;
+    while(!full){
+        while(scanned < used){
+            char* newline = (char*)memchr(block.data + scanned, '\n', used - scanned);
+            if(!newline){
+                scanned = used;
+                break;
+            }
+            size_t end = newline - block.data;
+            *newline = '\0';
+            starts.push_back(line_start);
+            if(starts.size() % 4 == 2) bases += end - line_start;
+            line_start = scanned = end + 1;
+            if(starts.size() % 4 == 0){
+                records_end = line_start;
+                record_lines = starts.size();
+                if(bases >= batch_len){
+                    full = true;
+                    break;
+                }
+            }
+        }
+        if(full) break;
+        if(file_done){
+            //a last line without a newline
+            if(line_start < used){
+                block.data[used] = '\0';
+                starts.push_back(line_start);
+                if(starts.size() % 4 == 0){
+                    records_end = used;
+                    record_lines = starts.size();
+                }
+            }
+            if(starts.size() > record_lines){
+                fprintf(stderr, "Warning: The last record of '%s' is incomplete, it is skipped.\n", path);
+            }
+            records_end = used;
+            break;
+        }
+        if(used + LONG_READ_CHUNK + 1 > block.capacity){
+            PoolBlock bigger = pool->acquire(2 * block.capacity);
+            memcpy(bigger.data, block.data, used);
+            pool->release(block);
+            block = bigger;
+        }
+        int chars_read = gzread(file, block.data + used, LONG_READ_CHUNK);
+        if(chars_read > 0){
+            used += chars_read;
+        }else if(open_next_file()){
+            //a file without a newline at its end still ends its last line
+            if(line_start < used) block.data[used++] = '\n';
+        }else if(follow && !follow_ended()){
+            if(record_lines > 0){
+                //the whole records so far are trimmed while the rest is written
+                for(size_t i = record_lines; i < starts.size(); i++) block.data[starts[i] + strlen(block.data + starts[i])] = '\n';
+                break;
+            }
+            follow_wait();
+        }else{
+            file_done = true;
+        }
+        if(follow && chars_read > 0) last_data = chrono::steady_clock::now();
+        consumed_bytes = finished_bytes + gzoffset(file);
+    }
+
+    pending.assign(block.data + records_end, used - records_end);
+    batch_end = records_end_offset(pending.length());
+    eof = file_done && pending.empty();
+    vector<const char*>* lines = new vector<const char*>();
+    lines->reserve(record_lines);
+    for(size_t i = 0; i < record_lines; i++) lines->push_back(block.data + starts[i]);
+    return lines;
+}
+
+
+vector<const char*>* GZReader::read_binary(PoolBlock &block){
+    /* Whole blocks are read, and their records decoded to the lines of FASTQ
+    records, so a batch always ends on a block and the rest of the pipeline
+    sees the same lines as with a FASTQ input */
+    block = pool->acquire(block_bytes());
+    vector<size_t> starts;
+    size_t used = 0;
+    for(size_t i = 0; i < last_remainder.size(); i++){
+        starts.push_back(used);
+        memcpy(block.data + used, last_remainder[i].c_str(), last_remainder[i].length() + 1);
+        used += last_remainder[i].length() + 1;
+    }
+    last_remainder.clear();
+
+    while(used < (size_t)batch_len){
+        char header[SQB_BLOCK_HEADER_LEN];
+        int got = gzread(file, header, SQB_BLOCK_HEADER_LEN);
+        if(got == 0){
+            if(open_next_file()) continue;
+            eof = true;
+            break;
+        }
+        uint32_t records;
+        uint64_t bytes;
+        memcpy(&records, header + 4, 4);
+        memcpy(&bytes, header + 8, 8);
+        bool valid = got == SQB_BLOCK_HEADER_LEN && memcmp(header, SQB_BLOCK_MAGIC, 4) == 0 && bytes <= INT_MAX;
+        if(valid){
+            binary_block.resize(bytes);
+            valid = gzread(file, binary_block.data(), bytes) == (int)bytes;
+        }
+        const char* data = binary_block.data();
+        size_t record_len, text_len, line_starts[4];
+        for(size_t pos = 0; valid && records > 0; records--, pos += record_len){
+            valid = sqb_record_size(data + pos, bytes - pos, record_len, text_len);
+            if(!valid) break;
+            if(used + text_len > block.capacity){
+                PoolBlock bigger = pool->acquire(max(2 * block.capacity, used + text_len));
+                memcpy(bigger.data, block.data, used);
+                pool->release(block);
+                block = bigger;
+            }
+            sqb_decode_record(data + pos, block.data + used, line_starts);
+            for(int i = 0; i < 4; i++) starts.push_back(used + line_starts[i]);
+            used += text_len;
+        }
+        if(!valid){
+            fprintf(stderr, "****Error: '%s' has a damaged or cut short block.\n\n", files[file_n].c_str());
+            throw TrimError{EXIT_FAILURE};
+        }
+        consumed_bytes = finished_bytes + gzoffset(file);
+    }
+
+    vector<const char*>* lines = new vector<const char*>();
+    //a pair split between blocks of an interleaved file goes on with the next batch
+    size_t whole = starts.size() - starts.size() % min_lines_in_batch;
+    for(size_t i = whole; i < starts.size(); i++) last_remainder.push_back(string(block.data + starts[i]));
+    lines->reserve(whole);
+    for(size_t i = 0; i < whole; i++) lines->push_back(block.data + starts[i]);
+    batch_end = last_remainder.empty() ? gztell(file) : -1;
+    return lines;
+}
+
 LoadException::LoadException(const std::string& message){
     this->message_ = message;
 }
@@ -144,6 +393,89 @@ bool GZReader::reached_end(){
     return eof;
 }
 
+void GZReader::set_batch_len(int batch_len){
+    this->batch_len = batch_len;
+}
+
+bool GZReader::open_next_file(){
+    if(file_n + 1 >= files.size()) return false;
+    finished_bytes += gzoffset(file);
+    gzclose(file);
+    file_n++;
+    msg(string("Reading ") + files[file_n]);
+    file = gzopen(files[file_n].c_str(), "r");
+    if(!file){
+        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", files[file_n].c_str());
+        throw TrimError{EXIT_FAILURE};
+    }
+    if(read_binary_header() != binary){
+        fprintf(stderr, "****Error: '%s' and '%s' are not both FASTQ or both --binary.\n\n", files[0].c_str(), files[file_n].c_str());
+        throw TrimError{EXIT_FAILURE};
+    }
+    return true;
+}
+
+bool GZReader::read_binary_header(){
+    char header[SQB_HEADER_LEN];
+    if(gzread(file, header, SQB_HEADER_LEN) == SQB_HEADER_LEN && memcmp(header, SQB_MAGIC, 4) == 0) return true;
+    gzrewind(file);
+    return false;
+}
+
+void GZReader::set_follow(const char* sentinel, int timeout){
+    follow = true;
+    follow_sentinel = sentinel ? sentinel : "";
+    follow_timeout = timeout;
+    last_data = chrono::steady_clock::now();
+}
+
+bool GZReader::follow_ended(){
+    if(follow_stopping) return true;
+    //what was written before the sentinel (or the timeout) is still read
+    bool sentinel = !follow_sentinel.empty() && access(follow_sentinel.c_str(), F_OK) == 0;
+    bool idle = follow_timeout > 0 && chrono::steady_clock::now() - last_data >= chrono::seconds(follow_timeout);
+    if(sentinel || idle) follow_stopping = true;
+    gzclearerr(file);
+    return false;
+}
+
+void GZReader::follow_wait(){
+    if(!follow_stopping) this_thread::sleep_for(chrono::milliseconds(FOLLOW_POLL_MS));
+    gzclearerr(file);
+}
+
+int64_t GZReader::records_end_offset(size_t carried){
+    /* The text carried to the next batch is the last one read from the
+    file, unless it started in an earlier file: then it is more than what was
+    read of this one (at least the newline added at the end of that file) */
+    int64_t read = gztell(file);
+    if(read < 0 || (uint64_t)read < carried) return -1;
+    return read - (int64_t)carried;
+}
+
+bool GZReader::seek(size_t file_n, int64_t offset){
+    if(offset < 0) return false;
+    while(this->file_n < file_n){
+        if(!open_next_file()) return false;
+    }
+    //gzip files are read up to the offset again, plain ones are seeked
+    if(this->file_n != file_n || gzseek(file, offset, SEEK_SET) != offset) return false;
+    consumed_bytes = finished_bytes + gzoffset(file);
+    return true;
+}
+
+bool GZReader::is_open(){
+    return opened;
+}
+
+size_t GZReader::file_count(){
+    return files.size();
+}
+
+void GZReader::set_long_reads(bool long_reads){
+    this->long_reads = long_reads;
+}
+
 /*
 
 int GZReader::buffer_len(){
@@ -2,35 +2,118 @@
 #define _GZREADER_
 
 #include <string>
+#include <vector>
 #include <zlib.h>
 #include <queue>
 #include <string_view>
 #include <tuple>
+#include <atomic>
+#include <chrono>
 #include "sickle.h"
 #include "Batch.h"
 
 using namespace std;
 
+/* Lines read between updates of consumed_bytes */
+#ifndef GZREADER_OFFSET_LINES
+#define GZREADER_OFFSET_LINES 4096
+#endif
+
+/* Bytes read at once from the file with --long-reads */
+#ifndef LONG_READ_CHUNK
+#define LONG_READ_CHUNK (1024*1024)
+#endif
+
+/* With --follow, how often the end of a file still being written is polled */
+#ifndef FOLLOW_POLL_MS
+#define FOLLOW_POLL_MS 200
+#endif
+
+/* Files of an input option: a comma separated list of files and glob
+patterns (in name order), which are read back to back as one input. Prints
+the error and returns EXIT_FAILURE if a file can't be read or a pattern
+matches nothing. */
+int input_files(const char* spec, vector<string> &files);
+//Total size of the files of spec, without the ones that can't be read
+uint64_t input_size(const char* spec);
+
 class GZReader{
 public:
-    GZReader(char* path, int batch_len, bool interleaved = false);
+    //without a pool, the reader uses one of its own; path can have several files, as for input_files
+    GZReader(char* path, int batch_len, bool interleaved = false, BufferPool* pool = NULL);
     ~GZReader();
     //std::string_view readline();
     //std::string_view* read4();
     Batch* get_batch_buffering_lines();
-    vector<const char*>* read_lines();
+    //bytes of the block the next batch is read into; it can grow for long records
+    size_t block_bytes();
+    //lines of the next batch, in block
+    vector<const char*>* read_lines(PoolBlock &block);
+    //lines of the next batch of records, of any length, with batch_len bases
+    vector<const char*>* read_records(PoolBlock &block);
+    //lines of the records of the next blocks of a --binary file, with batch_len bytes of text
+    vector<const char*>* read_binary(PoolBlock &block);
     bool reached_end();
+    //false if any of the files can't be read
+    bool is_open();
+    size_t file_count();
+    void set_batch_len(int batch_len);
+    //batches of read_records instead of read_lines
+    void set_long_reads(bool long_reads);
+    /* --follow: at the end of the last file, waits for more to be written
+    instead of ending, until sentinel exists (unless it is NULL) or nothing new
+    came for timeout seconds (unless it is 0). The records read when the end is
+    reached make a batch, so they are trimmed as they come. */
+    void set_follow(const char* sentinel, int timeout);
+    //--resume: goes on from the offset of the text of file file_n; false if it can't
+    bool seek(size_t file_n, int64_t offset);
 
     //int buffer_len();
     char* path;
+    //compressed bytes read from the file so far, for the progress reporter
+    std::atomic<int64_t> consumed_bytes;
 private:
     tuple<const char*, int> read_n_chars(int n_chars);
-    vector<const char*>* last_remainder = NULL;
+    //at the end of a file, goes on with the next one; false after the last one
+    bool open_next_file();
+    //true after the header of a --binary file, else the file is rewound
+    bool read_binary_header();
+    //with follow, true once the file is done; it is read once more after the sentinel or the timeout
+    bool follow_ended();
+    //with follow, no data yet: waits for some, clearing the end of file of zlib
+    void follow_wait();
+    //offset in the current file right after the whole records read, or -1 if they end in an earlier file
+    int64_t records_end_offset(size_t carried);
+    //lines after the last whole record, copied as the block goes with its batch
+    vector<string> last_remainder;
     gzFile file;
+    vector<string> files;
+    size_t file_n;
+    //end of the last batch, for Batch::end_offset
+    int64_t batch_end;
+    //compressed bytes of the files before the current one
+    int64_t finished_bytes;
+    bool opened;
     bool eof;
     int batch_len;
-    char* last_lines_buffer = NULL;
     int min_lines_in_batch;
+    size_t last_lines_count;
+    bool long_reads;
+    //the files are of --binary, and the blocks read from them
+    bool binary;
+    vector<char> binary_block;
+    //with long_reads, the text after the last whole record of the last batch
+    string pending;
+    bool file_done;
+    bool follow;
+    string follow_sentinel;
+    int follow_timeout;
+    bool follow_stopping;
+    std::chrono::steady_clock::time_point last_data;
+    //with follow, the start of a line still being written
+    string partial_line;
+    BufferPool* pool;
+    bool own_pool;
     //int more_buffer();
     //int find_newline_in_buffer();
     //void make_lines_from_buffer();
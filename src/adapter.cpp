@@ -0,0 +1,113 @@
+#include <ctype.h>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "adapter.h"
+
+using namespace std;
+
+/* bases are compared case-insensitively, setting the 0x20 bit folds a-z onto A-Z */
+int count_mismatches(const char* a, const char* b, int len, int limit){
+    int mismatches = 0;
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i fold = _mm_set1_epi8(0x20);
+    for(; i + 16 <= len; i += 16){
+        __m128i va = _mm_or_si128(_mm_loadu_si128((const __m128i*)(a + i)), fold);
+        __m128i vb = _mm_or_si128(_mm_loadu_si128((const __m128i*)(b + i)), fold);
+        unsigned equal = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+        mismatches += __builtin_popcount(~equal & 0xFFFF);
+        if(mismatches > limit) return mismatches;
+    }
+#endif
+    for(; i < len; i++){
+        if((a[i] | 0x20) != (b[i] | 0x20)){
+            mismatches++;
+            if(mismatches > limit) return mismatches;
+        }
+    }
+    return mismatches;
+}
+
+static inline char complement(char base){
+    switch(base){
+        case 'A': return 'T';
+        case 'C': return 'G';
+        case 'G': return 'C';
+        case 'T': return 'A';
+        case 'a': return 't';
+        case 'c': return 'g';
+        case 'g': return 'c';
+        case 't': return 'a';
+        default: return 'N';
+    }
+}
+
+AdapterMatcher::AdapterMatcher(int max_mismatches, int min_overlap){
+    this->max_mismatches = max_mismatches;
+    this->min_overlap = min_overlap;
+}
+
+void AdapterMatcher::add_adapter(const char* seq){
+    string adapter(seq);
+    for(size_t i = 0; i < adapter.length(); i++){
+        adapter[i] = toupper(adapter[i]);
+    }
+    if(adapter.length() > 0) adapters.push_back(adapter);
+}
+
+bool AdapterMatcher::empty(){
+    return adapters.empty();
+}
+
+const vector<string>& AdapterMatcher::sequences(){
+    return adapters;
+}
+
+int AdapterMatcher::allowed_mismatches(int overlap, int adapter_len){
+    /* partial adapters at the read end get a proportional share of the budget */
+    if(overlap >= adapter_len) return max_mismatches;
+    return (max_mismatches * overlap) / adapter_len;
+}
+
+int AdapterMatcher::find(std::string_view seq){
+    int seq_len = seq.length();
+    int best = seq_len;
+    for(size_t a = 0; a < adapters.size(); a++){
+        const string &adapter = adapters[a];
+        int adapter_len = adapter.length();
+        int last_start = min(best, seq_len - min(min_overlap, adapter_len));
+        for(int i = 0; i <= last_start; i++){
+            int overlap = min(adapter_len, seq_len - i);
+            int allowed = allowed_mismatches(overlap, adapter_len);
+            if(count_mismatches(seq.data() + i, adapter.data(), overlap, allowed) <= allowed){
+                best = i;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+int AdapterMatcher::find_insert_size(std::string_view seq1, std::string_view seq2){
+    /* if the insert is shorter than the reads, the start of seq1 matches the
+    end of the reverse complement of seq2, and both reads have adapters after it */
+    static thread_local string revcomp2;
+    int len1 = seq1.length();
+    int len2 = seq2.length();
+    revcomp2.resize(len2);
+    for(int i = 0; i < len2; i++){
+        revcomp2[len2-1-i] = complement(seq2[i]);
+    }
+
+    for(int offset = (len1 > len2 ? 0 : 1); len2 - offset >= OVERLAP_MIN_LEN; offset++){
+        int insert = len2 - offset;
+        if(insert > len1) continue;
+        int allowed = min(OVERLAP_MAX_MISMATCHES, insert / 5);
+        if(count_mismatches(seq1.data(), revcomp2.data() + offset, insert, allowed) <= allowed){
+            return insert;
+        }
+    }
+    return -1;
+}
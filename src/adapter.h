@@ -0,0 +1,50 @@
+#ifndef _ADAPTER_
+#define _ADAPTER_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef DEFAULT_ADAPTER_MISMATCHES
+#define DEFAULT_ADAPTER_MISMATCHES 2
+#endif
+
+#ifndef DEFAULT_ADAPTER_MIN_OVERLAP
+#define DEFAULT_ADAPTER_MIN_OVERLAP 3
+#endif
+
+/* minimum overlap and maximum mismatches for pe adapter detection by read overlap */
+#ifndef OVERLAP_MIN_LEN
+#define OVERLAP_MIN_LEN 30
+#endif
+#ifndef OVERLAP_MAX_MISMATCHES
+#define OVERLAP_MAX_MISMATCHES 5
+#endif
+
+/* Number of positions in which a and b differ, comparing 16 bytes at a time.
+Stops counting as soon as the result is bigger than limit. */
+int count_mismatches(const char* a, const char* b, int len, int limit);
+
+/* Semi-global matcher of adapter sequences against the 3' end of reads.
+An adapter may start anywhere in the read and may be cut by the read end,
+as long as at least min_overlap bases of it are present. */
+class AdapterMatcher{
+public:
+    AdapterMatcher(int max_mismatches, int min_overlap);
+    void add_adapter(const char* seq);
+    bool empty();
+    //The adapters added, in upper case
+    const std::vector<std::string>& sequences();
+    //Position where the first adapter starts, or seq.length() if there is none
+    int find(std::string_view seq);
+    //Insert size of a read pair whose mates overlap by their 3' ends, or -1
+    int find_insert_size(std::string_view seq1, std::string_view seq2);
+
+    int max_mismatches;
+    int min_overlap;
+private:
+    int allowed_mismatches(int overlap, int adapter_len);
+    std::vector<std::string> adapters;
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include <string.h>
+#include "binary.h"
+
+using namespace std;
+
+/* 2-bit codes of the bases, 4 for those that go to the exception runs, and
+the 4 bases of each packed byte */
+struct BaseCodes{
+    unsigned char code[256];
+    char unpacked[256][4];
+    BaseCodes(){
+        memset(code, 4, sizeof(code));
+        code['A'] = 0;
+        code['C'] = 1;
+        code['G'] = 2;
+        code['T'] = 3;
+        for(int byte = 0; byte < 256; byte++){
+            for(int i = 0; i < 4; i++) unpacked[byte][i] = "ACGT"[(byte >> (2 * i)) & 3];
+        }
+    }
+};
+
+static const BaseCodes base_codes;
+
+static void put_u32(char* at, uint32_t value){
+    memcpy(at, &value, 4);
+}
+
+static uint32_t get_u32(const char* at){
+    uint32_t value;
+    memcpy(&value, at, 4);
+    return value;
+}
+
+string_view sqb_file_header(){
+    static const char header[SQB_HEADER_LEN] = {'S', 'Q', 'B', 1, 0, 0, 0, 0};
+    return string_view(header, SQB_HEADER_LEN);
+}
+
+size_t sqb_output_len(size_t text_len, size_t records){
+    //the 3 u32 lengths of each record, of which the 4 newlines of its text pay for 1
+    size_t len = text_len + records * 8;
+    return len + (len / SQB_BLOCK_LEN + 1) * SQB_BLOCK_HEADER_LEN;
+}
+
+void sqb_append_record(OutputBuffer &out, string_view name, string_view seq, string_view qual){
+    if(out.frame_start < 0 || out.length() - out.frame_start >= SQB_BLOCK_HEADER_LEN + SQB_BLOCK_LEN){
+        out.frame_start = out.length();
+        char* header = out.extend(SQB_BLOCK_HEADER_LEN);
+        memcpy(header, SQB_BLOCK_MAGIC, 4);
+        memset(header + 4, 0, SQB_BLOCK_HEADER_LEN - 4);
+    }
+    if(!name.empty() && name[0] == '@') name.remove_prefix(1);
+    uint32_t bases = seq.length();
+    char* fields = out.extend(12 + name.length());
+    put_u32(fields, name.length());
+    memcpy(fields + 4, name.data(), name.length());
+    put_u32(fields + 4 + name.length(), bases);
+    put_u32(fields + 8 + name.length(), 0);
+    size_t runs_at = out.length() - 4;
+
+    unsigned char* packed = (unsigned char*)out.extend((bases + 3) / 4);
+    const char* s = seq.data();
+    bool other = false;
+    uint32_t i = 0;
+    for(; i + 4 <= bases; i += 4){
+        unsigned char c0 = base_codes.code[(unsigned char)s[i]], c1 = base_codes.code[(unsigned char)s[i+1]];
+        unsigned char c2 = base_codes.code[(unsigned char)s[i+2]], c3 = base_codes.code[(unsigned char)s[i+3]];
+        other |= (c0 | c1 | c2 | c3) > 3;
+        packed[i >> 2] = (c0 & 3) | (c1 & 3) << 2 | (c2 & 3) << 4 | (c3 & 3) << 6;
+    }
+    if(i < bases){
+        unsigned char last = 0;
+        for(uint32_t j = i; j < bases; j++){
+            unsigned char code = base_codes.code[(unsigned char)s[j]];
+            other |= code > 3;
+            last |= (code & 3) << (2 * (j - i));
+        }
+        packed[i >> 2] = last;
+    }
+    if(other){
+        //N and the like, as runs of the same base
+        uint32_t runs = 0;
+        for(uint32_t j = 0; j < bases;){
+            if(base_codes.code[(unsigned char)s[j]] <= 3){
+                j++;
+                continue;
+            }
+            uint32_t start = j;
+            while(j < bases && s[j] == s[start]) j++;
+            char* run = out.extend(9);
+            put_u32(run, start);
+            put_u32(run + 4, j - start);
+            run[8] = s[start];
+            runs++;
+        }
+        put_u32(out.data() + runs_at, runs);
+    }
+
+    char* quals = out.extend(bases);
+    size_t copied = min((size_t)bases, qual.length());
+    memcpy(quals, qual.data(), copied);
+    memset(quals + copied, '!', bases - copied);
+
+    char* header = out.data() + out.frame_start;
+    put_u32(header + 4, get_u32(header + 4) + 1);
+    uint64_t bytes = out.length() - out.frame_start - SQB_BLOCK_HEADER_LEN;
+    memcpy(header + 8, &bytes, 8);
+}
+
+bool sqb_record_size(const char* data, size_t len, size_t &record_len, size_t &text_len){
+    if(len < 4) return false;
+    uint64_t name_len = get_u32(data);
+    if(len < 12 + name_len) return false;
+    uint64_t bases = get_u32(data + 4 + name_len);
+    uint64_t runs = get_u32(data + 8 + name_len);
+    if(12 + name_len + (bases + 3) / 4 + 9 * runs + bases > len) return false;
+    record_len = 12 + name_len + (bases + 3) / 4 + 9 * runs + bases;
+    //@name, the bases, + and the qualities
+    text_len = name_len + 2 + bases + 1 + 2 + bases + 1;
+    return true;
+}
+
+void sqb_decode_record(const char* data, char* text, size_t line_starts[4]){
+    uint32_t name_len = get_u32(data);
+    uint32_t bases = get_u32(data + 4 + name_len);
+    uint32_t runs = get_u32(data + 8 + name_len);
+    const unsigned char* packed = (const unsigned char*)data + 12 + name_len;
+    const char* run = (const char*)packed + (bases + 3) / 4;
+    const char* qual = run + 9 * (size_t)runs;
+
+    line_starts[0] = 0;
+    text[0] = '@';
+    memcpy(text + 1, data + 4, name_len);
+    text[name_len + 1] = '\0';
+
+    line_starts[1] = name_len + 2;
+    char* seq = text + line_starts[1];
+    //whole bytes, up to 3 bases past the end, which the lines after overwrite
+    for(uint32_t i = 0; i < bases; i += 4) memcpy(seq + i, base_codes.unpacked[packed[i >> 2]], 4);
+    for(uint32_t i = 0; i < runs; i++, run += 9){
+        uint32_t start = get_u32(run);
+        uint32_t len = get_u32(run + 4);
+        if(start < bases) memset(seq + start, run[8], min(len, bases - start));
+    }
+    seq[bases] = '\0';
+
+    line_starts[2] = line_starts[1] + bases + 1;
+    text[line_starts[2]] = '+';
+    text[line_starts[2] + 1] = '\0';
+
+    line_starts[3] = line_starts[2] + 2;
+    memcpy(text + line_starts[3], qual, bases);
+    text[line_starts[3] + bases] = '\0';
+}
@@ -0,0 +1,46 @@
+#ifndef _BINARY_
+#define _BINARY_
+
+#include <stdint.h>
+#include <string_view>
+#include "pool.h"
+
+/* The binary format of --binary, for tools downstream of sickle that don't
+want to format and parse FASTQ text. Numbers are little endian.
+
+    file:   "SQB" 0x01, u32 flags (0), then blocks
+    block:  "SQBK", u32 records, u64 bytes of the records
+    record: u32 name length, name (without the @), u32 bases, u32 exception runs,
+            the bases packed 4 to a byte (A, C, G, T as 0 to 3, first base in the low bits),
+            the runs as u32 start, u32 length, u8 base, for N and any other base (packed as A),
+            the quality characters, one byte per base
+
+Every block starts where the last one ends and says its length, so a reader
+can mmap the file and hand whole blocks to several threads. The + line of
+FASTQ is a lone + when decoded. */
+#define SQB_MAGIC "SQB\x01"
+#define SQB_HEADER_LEN 8
+#define SQB_BLOCK_MAGIC "SQBK"
+#define SQB_BLOCK_HEADER_LEN 16
+
+/* Bytes of records after which a new block starts */
+#ifndef SQB_BLOCK_LEN
+#define SQB_BLOCK_LEN (1024*1024)
+#endif
+
+//The file header, written once at the start of each output
+std::string_view sqb_file_header();
+/* Bytes the binary records of a batch of text_len bytes of FASTQ in records
+records can take before their N runs: the bases and qualities are no longer
+than the text, the lengths of the fields and the block headers add to it. Each
+N run is 9 bytes more, so the output of reads full of them can grow past it. */
+size_t sqb_output_len(size_t text_len, size_t records);
+//Appends a record to out, in the last block of out unless it has SQB_BLOCK_LEN bytes already
+void sqb_append_record(OutputBuffer &out, std::string_view name, std::string_view seq, std::string_view qual);
+/* Sizes of the record at data, of at most len bytes: its own, and that of
+the text of its FASTQ record, NUL terminated lines. False if it is malformed. */
+bool sqb_record_size(const char* data, size_t len, size_t &record_len, size_t &text_len);
+//Decodes a record checked by sqb_record_size to text, with the starts of its 4 lines
+void sqb_decode_record(const char* data, char* text, size_t line_starts[4]);
+
+#endif
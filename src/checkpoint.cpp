@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include "checkpoint.h"
+
+using namespace std;
+
+#define CHECKPOINT_HEADER "sickle checkpoint 1"
+
+int write_checkpoint(const char* path, const Checkpoint &point){
+    string tmp = string(path) + ".tmp";
+    FILE* out = fopen(tmp.c_str(), "w");
+    if(!out){
+        fprintf(stderr, "****Error: Could not write checkpoint file '%s'.\n\n", tmp.c_str());
+        return EXIT_FAILURE;
+    }
+    fprintf(out, "%s\nrecords\t%ld\n", CHECKPOINT_HEADER, point.records);
+    for(size_t i = 0; i < point.inputs.size(); i++){
+        fprintf(out, "input\t%zu\t%lld\n", point.inputs[i].file, (long long)point.inputs[i].offset);
+    }
+    //the path goes last, it may have tabs
+    for(size_t i = 0; i < point.outputs.size(); i++){
+        fprintf(out, "output\t%llu\t%s\n", (unsigned long long)point.outputs[i].size, point.outputs[i].path.c_str());
+    }
+    for(map<string, long>::const_iterator it = point.counters.begin(); it != point.counters.end(); ++it){
+        fprintf(out, "counter\t%s\t%ld\n", it->first.c_str(), it->second);
+    }
+    //on disk before it replaces the last one, which is all a crash would leave
+    bool failed = fflush(out) != 0 || fsync(fileno(out)) != 0;
+    failed = fclose(out) != 0 || failed;
+    if(failed || rename(tmp.c_str(), path) != 0){
+        fprintf(stderr, "****Error: Could not write checkpoint file '%s'.\n\n", path);
+        unlink(tmp.c_str());
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+int read_checkpoint(const char* path, Checkpoint &point){
+    ifstream in(path);
+    string line;
+    if(!in || !getline(in, line) || line != CHECKPOINT_HEADER){
+        fprintf(stderr, "****Error: '%s' is not a sickle checkpoint.\n\n", path);
+        return EXIT_FAILURE;
+    }
+    point = Checkpoint();
+    point.records = 0;
+    while(getline(in, line)){
+        istringstream fields(line);
+        string kind;
+        getline(fields, kind, '\t');
+        bool ok = true;
+        if(kind == "records"){
+            ok = (bool)(fields >> point.records);
+        }else if(kind == "input"){
+            long long offset;
+            InputPosition input;
+            ok = (bool)(fields >> input.file >> offset);
+            input.offset = offset;
+            point.inputs.push_back(input);
+        }else if(kind == "output"){
+            unsigned long long size;
+            OutputPosition output;
+            ok = (bool)(fields >> size) && fields.get() == '\t' && getline(fields, output.path);
+            output.size = size;
+            point.outputs.push_back(output);
+        }else if(kind == "counter"){
+            string name;
+            long value;
+            ok = getline(fields, name, '\t') && (bool)(fields >> value);
+            point.counters[name] = value;
+        }else{
+            ok = line.empty();
+        }
+        if(!ok){
+            fprintf(stderr, "****Error: Bad line in checkpoint file '%s': %s\n\n", path, line.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
+
+int64_t file_size(const char* path){
+    struct stat info;
+    if(stat(path, &info) != 0) return -1;
+    return info.st_size;
+}
+
+bool sync_file(const char* path){
+    //fsync goes by the file, not by the descriptor that wrote it
+    int fd = open(path, O_WRONLY);
+    if(fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
@@ -0,0 +1,50 @@
+#ifndef _CHECKPOINT_
+#define _CHECKPOINT_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/* With --checkpoint, seconds between checkpoints, after the batch whose
+output ends past them (0 writes one after every batch) */
+#ifndef DEFAULT_CHECKPOINT_INTERVAL
+#define DEFAULT_CHECKPOINT_INTERVAL 60
+#endif
+
+/* Where an input goes on: the file of its list and the offset in its
+uncompressed text, or -1 if the batch doesn't say */
+struct InputPosition{
+    size_t file;
+    int64_t offset;
+};
+
+/* An output and its size when the checkpoint was taken */
+struct OutputPosition{
+    std::string path;
+    uint64_t size;
+};
+
+/* State of a run after a batch was written whole: resuming truncates the
+outputs back to their sizes, seeks the inputs and restores the counters,
+so the run goes on as if it never stopped */
+struct Checkpoint{
+    long records;
+    std::vector<InputPosition> inputs;
+    std::vector<OutputPosition> outputs;
+    //kept, discard and the like, by name
+    std::map<std::string, long> counters;
+};
+
+/* Writes point to a temporary file next to path and renames it, so path
+always has a whole checkpoint. Prints the error and returns EXIT_FAILURE if
+it can't. */
+int write_checkpoint(const char* path, const Checkpoint &point);
+//Prints the error and returns EXIT_FAILURE if path is not a checkpoint
+int read_checkpoint(const char* path, Checkpoint &point);
+//Size of the file at path, or -1 if it can't be read
+int64_t file_size(const char* path);
+//Puts what was written to the file at path on disk; false if it can't
+bool sync_file(const char* path);
+
+#endif
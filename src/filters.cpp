@@ -0,0 +1,141 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "sickle.h"
+#include "filters.h"
+
+void build_error_table(float* table, int qualtype){
+    for(int c = 0; c < 256; c++){
+        if(c < quality_constants[qualtype][Q_MIN] || c > quality_constants[qualtype][Q_MAX]){
+            table[c] = 1.0;
+            continue;
+        }
+        double q = c - quality_constants[qualtype][Q_OFFSET];
+        if(qualtype == SOLEXA){
+            /* solexa scores are odds, not probabilities */
+            table[c] = (float)(1.0 / (1.0 + pow(10.0, q / 10.0)));
+        }else{
+            table[c] = (float)pow(10.0, -q / 10.0);
+        }
+        if(table[c] > 1.0) table[c] = 1.0;
+    }
+}
+
+float expected_errors(std::string_view qual, const float* table){
+    const unsigned char* chars = (const unsigned char*)qual.data();
+    size_t len = qual.length();
+    size_t i = 0;
+    float sum = 0;
+#if defined(__SSE2__)
+    /* four independent partial sums, added together at the end */
+    __m128 partial = _mm_setzero_ps();
+    for(; i + 4 <= len; i += 4){
+        partial = _mm_add_ps(partial, _mm_set_ps(table[chars[i+3]], table[chars[i+2]],
+            table[chars[i+1]], table[chars[i]]));
+    }
+    __m128 high = _mm_movehl_ps(partial, partial);
+    partial = _mm_add_ps(partial, high);
+    partial = _mm_add_ss(partial, _mm_shuffle_ps(partial, partial, 1));
+    sum = _mm_cvtss_f32(partial);
+#endif
+    for(; i < len; i++){
+        sum += table[chars[i]];
+    }
+    return sum;
+}
+
+/* triplet index of the three bases at each position, or 64 if any is not ACGT */
+static void encode_triplets(const char* seq, int len, unsigned char* triplets){
+    static thread_local std::vector<unsigned char> codes;
+    codes.resize(len + 16);
+    unsigned char* code = codes.data();
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i a = _mm_set1_epi8('a'), c = _mm_set1_epi8('c');
+    const __m128i g = _mm_set1_epi8('g'), t = _mm_set1_epi8('t');
+    const __m128i one = _mm_set1_epi8(1), two = _mm_set1_epi8(2);
+    const __m128i three = _mm_set1_epi8(3), four = _mm_set1_epi8(4);
+    for(; i + 16 <= len; i += 16){
+        __m128i bases = _mm_or_si128(_mm_loadu_si128((const __m128i*)(seq + i)), lower);
+        __m128i is_a = _mm_cmpeq_epi8(bases, a);
+        __m128i is_c = _mm_cmpeq_epi8(bases, c);
+        __m128i is_g = _mm_cmpeq_epi8(bases, g);
+        __m128i is_t = _mm_cmpeq_epi8(bases, t);
+        __m128i other = _mm_andnot_si128(_mm_or_si128(_mm_or_si128(is_a, is_c), _mm_or_si128(is_g, is_t)),
+            _mm_set1_epi8(-1));
+        __m128i result = _mm_or_si128(_mm_or_si128(_mm_and_si128(is_c, one), _mm_and_si128(is_g, two)),
+            _mm_or_si128(_mm_and_si128(is_t, three), _mm_and_si128(other, four)));
+        _mm_storeu_si128((__m128i*)(code + i), result);
+    }
+#endif
+    for(; i < len; i++){
+        switch(seq[i] | 0x20){
+            case 'a': code[i] = 0; break;
+            case 'c': code[i] = 1; break;
+            case 'g': code[i] = 2; break;
+            case 't': code[i] = 3; break;
+            default: code[i] = 4;
+        }
+    }
+
+    int n_triplets = len - 2;
+    i = 0;
+#if defined(__SSE2__)
+    const __m128i invalid_index = _mm_set1_epi8(64);
+    for(; i + 16 <= n_triplets; i += 16){
+        __m128i first = _mm_loadu_si128((const __m128i*)(code + i));
+        __m128i second = _mm_loadu_si128((const __m128i*)(code + i + 1));
+        __m128i third = _mm_loadu_si128((const __m128i*)(code + i + 2));
+        /* codes are smaller than 8, so 16 bit shifts do not carry between bytes */
+        __m128i index = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(first, 4), _mm_slli_epi16(second, 2)), third);
+        __m128i invalid = _mm_cmpeq_epi8(_mm_max_epu8(_mm_max_epu8(first, second), third), four);
+        index = _mm_or_si128(_mm_and_si128(invalid, invalid_index), _mm_andnot_si128(invalid, index));
+        _mm_storeu_si128((__m128i*)(triplets + i), index);
+    }
+#endif
+    for(; i < n_triplets; i++){
+        if(code[i] == 4 || code[i+1] == 4 || code[i+2] == 4){
+            triplets[i] = 64;
+        }else{
+            triplets[i] = code[i]*16 + code[i+1]*4 + code[i+2];
+        }
+    }
+}
+
+static float window_dust(const unsigned char* triplets, int n_triplets){
+    if(n_triplets < 2) return 0;
+    int counts[65];
+    memset(counts, 0, sizeof(counts));
+    for(int i = 0; i < n_triplets; i++){
+        counts[triplets[i]]++;
+    }
+    int repeats = 0;
+    for(int i = 0; i < 64; i++){
+        repeats += counts[i] * (counts[i] - 1) / 2;
+    }
+    return (float)repeats / (float)(n_triplets - 1);
+}
+
+float dust_score(std::string_view seq){
+    static thread_local std::vector<unsigned char> triplets;
+    int len = seq.length();
+    if(len < 3) return 0;
+    triplets.resize(len);
+    encode_triplets(seq.data(), len, triplets.data());
+
+    float total = 0;
+    int windows = 0;
+    for(int start = 0; ; start += DUST_WINDOW / 2){
+        int window_len = std::min(DUST_WINDOW, len - start);
+        total += window_dust(triplets.data() + start, window_len - 2);
+        windows++;
+        if(start + DUST_WINDOW >= len) break;
+    }
+    /* 31 is the score of a window of 64 equal bases */
+    return (total / windows) * 100.0 / 31.0;
+}
@@ -0,0 +1,23 @@
+#ifndef _FILTERS_
+#define _FILTERS_
+
+#include <string_view>
+
+/* Fills table with the error probability of each quality char of qualtype.
+Chars outside of the valid range are counted as certain errors. */
+void build_error_table(float* table, int qualtype);
+
+/* Sum of the error probabilities of all the bases in qual */
+float expected_errors(std::string_view qual, const float* table);
+
+#ifndef DUST_WINDOW
+#define DUST_WINDOW 64
+#endif
+
+/* DUST score of seq, in the 0-100 scale of prinseq: the trinucleotide
+repetition of windows of DUST_WINDOW bases (moving by half a window),
+averaged. Random sequence scores about 2, and low complexity scores more
+than 7. Triplets with an N are not counted. */
+float dust_score(std::string_view seq);
+
+#endif
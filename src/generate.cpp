@@ -0,0 +1,503 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <algorithm>
+#include "sickle.h"
+#include "generate.h"
+
+using namespace std;
+
+/* Biggest BGZF block, header and footer included */
+#define BGZF_MAX_BLOCK 65536
+#define BGZF_HEADER_LEN 18
+#define BGZF_FOOTER_LEN 8
+
+static struct option gen_long_options[] = {
+    {"reads", required_argument, 0, 'n'},
+    {"output-file", required_argument, 0, 'o'},
+    {"output-pe2", required_argument, 0, 'p'},
+    {"output-interleaved", required_argument, 0, 'm'},
+    {"qual-type", required_argument, 0, 't'},
+    {"length", required_argument, 0, 'l'},
+    {"gzip-output", no_argument, 0, 'g'},
+    {"bgzf", no_argument, 0, GEN_BGZF_OPTION},
+    {"seed", required_argument, 0, GEN_SEED_OPTION},
+    {"qual-start", required_argument, 0, GEN_QUAL_START_OPTION},
+    {"qual-end", required_argument, 0, GEN_QUAL_END_OPTION},
+    {"n-rate", required_argument, 0, GEN_N_RATE_OPTION},
+    {"adapter-rate", required_argument, 0, GEN_ADAPTER_RATE_OPTION},
+    {"adapter", required_argument, 0, 'A'},
+    {"adapter2", required_argument, 0, GEN_ADAPTER2_OPTION},
+    {"poly-g-rate", required_argument, 0, GEN_POLY_G_RATE_OPTION},
+    {GETOPT_HELP_OPTION_DECL},
+    {GETOPT_VERSION_OPTION_DECL},
+    {NULL, 0, NULL, 0}
+};
+
+GenOutput::GenOutput(){
+    format = GEN_PLAIN;
+    file = NULL;
+    gz_file = NULL;
+}
+
+int GenOutput::open(const char* path, gen_format format){
+    this->format = format;
+    bool to_stdout = !strcmp(path, "-");
+    if(format == GEN_GZIP){
+        gz_file = to_stdout ? gzdopen(fileno(stdout), "w") : gzopen(path, "w");
+        if(!gz_file){
+            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", path);
+            return EXIT_FAILURE;
+        }
+    }else{
+        file = to_stdout ? stdout : fopen(path, "w");
+        if(!file){
+            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", path);
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
+
+int GenOutput::write(const std::string &content){
+    if(format == GEN_GZIP){
+        if(gzwrite_str(gz_file, content) != (int)content.length()) return EXIT_FAILURE;
+    }else if(format == GEN_PLAIN){
+        if(fwrite(content.c_str(), 1, content.length(), file) != content.length()) return EXIT_FAILURE;
+    }else{
+        pending += content;
+        size_t start = 0;
+        for(; pending.length() - start >= BGZF_BLOCK_LEN; start += BGZF_BLOCK_LEN){
+            if(write_bgzf_block(pending.c_str() + start, BGZF_BLOCK_LEN)) return EXIT_FAILURE;
+        }
+        pending.erase(0, start);
+    }
+    return 0;
+}
+
+/* Writes one gzip member with the BC extra field, that has the size of the
+block, so BGZF readers can seek to any block. Blocks that would not fit in
+64KB after compression are split in two. */
+int GenOutput::write_bgzf_block(const char* data, size_t len){
+    unsigned char block[BGZF_MAX_BLOCK];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return EXIT_FAILURE;
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = len;
+    zs.next_out = block + BGZF_HEADER_LEN;
+    zs.avail_out = BGZF_MAX_BLOCK - BGZF_HEADER_LEN - BGZF_FOOTER_LEN;
+    int res = deflate(&zs, Z_FINISH);
+    size_t compressed_len = zs.total_out;
+    deflateEnd(&zs);
+    if(res != Z_STREAM_END){
+        return write_bgzf_block(data, len/2) || write_bgzf_block(data + len/2, len - len/2);
+    }
+
+    size_t block_len = BGZF_HEADER_LEN + compressed_len + BGZF_FOOTER_LEN;
+    static const unsigned char header[] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0};
+    memcpy(block, header, sizeof(header));
+    block[16] = (block_len - 1) & 0xff;
+    block[17] = (block_len - 1) >> 8;
+    uint32_t crc = crc32(crc32(0, NULL, 0), (const Bytef*)data, len);
+    unsigned char* footer = block + BGZF_HEADER_LEN + compressed_len;
+    for(int i = 0; i < 4; i++){
+        footer[i] = (crc >> (8*i)) & 0xff;
+        footer[4+i] = (len >> (8*i)) & 0xff;
+    }
+    return fwrite(block, 1, block_len, file) == block_len ? 0 : EXIT_FAILURE;
+}
+
+int GenOutput::close(){
+    int res = 0;
+    if(format == GEN_GZIP){
+        if(gzclose(gz_file) != Z_OK) res = EXIT_FAILURE;
+        gz_file = NULL;
+        return res;
+    }
+    if(format == GEN_BGZF){
+        if(!pending.empty()) res = write_bgzf_block(pending.c_str(), pending.length());
+        pending.clear();
+        //an empty block marks the end of the file
+        if(res == 0) res = write_bgzf_block("", 0);
+    }
+    if(file == stdout){
+        if(fflush(file) != 0) res = EXIT_FAILURE;
+    }else if(fclose(file) != 0){
+        res = EXIT_FAILURE;
+    }
+    file = NULL;
+    return res;
+}
+
+void Generator::usage(int status, char const *msg) {
+
+    fprintf(stderr, "\nUsage: %s gen [options] -n <number of reads> -o <fastq file>\n\
+\tor: %s gen [options] -n <number of pairs> -o <forward fastq file> -p <reverse fastq file>\n\
+\tor: %s gen [options] -n <number of pairs> -m <interleaved fastq file>\n\
+\n\
+Writes synthetic reads, the same for the same seed and options. '-' as a file name is the standard output.\n\
+\n\
+Options:\n\
+-n, --reads, Number of reads, or pairs of reads (required)\n\
+-o, --output-file, Output fastq file, or forward fastq file with -p\n\
+-p, --output-pe2, Output reverse fastq file\n\
+-m, --output-interleaved, Output interleaved fastq file\n", PROGRAM_NAME, PROGRAM_NAME, PROGRAM_NAME);
+
+    fprintf(stderr, "-t, --qual-type, Type of quality values (solexa, illumina or sanger). Default sanger.\n\
+-l, --length, Read length: a fixed length (150), uniform between two lengths (50-150)\n\
+\tor normal with a mean and standard deviation (150:20). Default %d.\n\
+--qual-start, Quality at the 5' end of the reads. Default 38.\n\
+--qual-end, Quality at the 3' end of the reads, which decays quadratically from the 5' end. Default 15.\n\
+--n-rate, Fraction of bases that are N. Default 0.001.\n\
+--adapter-rate, Fraction of reads (or pairs) with an insert shorter than the read, followed by\n\
+\tthe adapter. Default 0.05.\n\
+-A, --adapter, Adapter after short inserts in se and forward reads. Default %s.\n\
+--adapter2, Adapter after short inserts in reverse reads. Default %s.\n\
+--poly-g-rate, Fraction of reads with a poly-G tail. Default 0.01.\n\
+-g, --gzip-output, Output gzipped files.\n\
+--bgzf, Output BGZF files (gzip made of independent blocks, as bgzip).\n\
+--seed, Seed of the random numbers. Default 1.\n\
+--help, display this help and exit\n\
+--version, output version information and exit\n\n", DEFAULT_GEN_READ_LEN, DEFAULT_GEN_ADAPTER1, DEFAULT_GEN_ADAPTER2);
+
+    if (msg) fprintf(stderr, "%s\n\n", msg);
+    exit(status);
+}
+
+Generator::Generator(){
+    seed = 1;
+    n_reads = -1;
+    qualtype = SANGER;
+    len_min = len_max = DEFAULT_GEN_READ_LEN;
+    len_mean = len_sd = 0;
+    qual_start = 38;
+    qual_end = 15;
+    n_rate = 0.001;
+    adapter_rate = 0.05;
+    poly_g_rate = 0.01;
+    adapter1 = DEFAULT_GEN_ADAPTER1;
+    adapter2 = DEFAULT_GEN_ADAPTER2;
+    format = GEN_PLAIN;
+    outfn = NULL;
+    outfn2 = NULL;
+    outfnc = NULL;
+}
+
+Generator::~Generator(){
+    free(outfn);
+    free(outfn2);
+    free(outfnc);
+}
+
+static int parse_rate(const char* optarg, double &rate, const char* name){
+    rate = atof(optarg);
+    if (rate < 0 || rate > 1) {
+        fprintf(stderr, "%s must be between 0 and 1\n", name);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+int Generator::parse_args(int argc, char *argv[]){
+    int optc;
+    extern char *optarg;
+    bool gzip_output = false, bgzf_output = false;
+
+    while (1) {
+        int option_index = 0;
+        optc = getopt_long(argc, argv, "n:o:p:m:t:l:gA:", gen_long_options, &option_index);
+
+        if (optc == -1)
+            break;
+
+        switch (optc) {
+        case 'n':
+            n_reads = atol(optarg);
+            if (n_reads < 0) {
+                fprintf(stderr, "Number of reads must be >= 0\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'o':
+            outfn = strdup(optarg);
+            break;
+
+        case 'p':
+            outfn2 = strdup(optarg);
+            break;
+
+        case 'm':
+            outfnc = strdup(optarg);
+            break;
+
+        case 't':
+            if (!strcmp(optarg, "illumina"))
+                qualtype = ILLUMINA;
+            else if (!strcmp(optarg, "solexa"))
+                qualtype = SOLEXA;
+            else if (!strcmp(optarg, "sanger"))
+                qualtype = SANGER;
+            else {
+                fprintf(stderr, "Error: Quality type '%s' is not a valid type.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'l':
+            if (strchr(optarg, '-')) {
+                len_min = atoi(optarg);
+                len_max = atoi(strchr(optarg, '-') + 1);
+            } else if (strchr(optarg, ':')) {
+                len_mean = atof(optarg);
+                len_sd = atof(strchr(optarg, ':') + 1);
+                len_min = 1;
+                len_max = 0;
+            } else {
+                len_min = len_max = atoi(optarg);
+            }
+            if ((len_max > 0 && (len_min < 1 || len_max < len_min)) || (len_max == 0 && (len_mean < 1 || len_sd < 0))) {
+                fprintf(stderr, "Error: Read length '%s' is not valid.\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'g':
+            gzip_output = true;
+            break;
+
+        case GEN_BGZF_OPTION:
+            bgzf_output = true;
+            break;
+
+        case GEN_SEED_OPTION:
+            seed = atol(optarg);
+            break;
+
+        case GEN_QUAL_START_OPTION:
+            qual_start = atoi(optarg);
+            break;
+
+        case GEN_QUAL_END_OPTION:
+            qual_end = atoi(optarg);
+            break;
+
+        case GEN_N_RATE_OPTION:
+            if (parse_rate(optarg, n_rate, "N rate")) return EXIT_FAILURE;
+            break;
+
+        case GEN_ADAPTER_RATE_OPTION:
+            if (parse_rate(optarg, adapter_rate, "Adapter rate")) return EXIT_FAILURE;
+            break;
+
+        case 'A':
+            adapter1 = optarg;
+            break;
+
+        case GEN_ADAPTER2_OPTION:
+            adapter2 = optarg;
+            break;
+
+        case GEN_POLY_G_RATE_OPTION:
+            if (parse_rate(optarg, poly_g_rate, "Poly-G rate")) return EXIT_FAILURE;
+            break;
+
+        case_GETOPT_HELP_CHAR(usage)
+        case_GETOPT_VERSION_CHAR(PROGRAM_NAME, VERSION, AUTHORS);
+
+        default:
+            usage(EXIT_FAILURE, NULL);
+            break;
+        }
+    }
+
+    if (n_reads < 0 || (!outfn && !outfnc)) {
+        usage(EXIT_FAILURE, "****Error: Must have the number of reads and an output file.");
+    }
+    if (outfnc && (outfn || outfn2)) {
+        usage(EXIT_FAILURE, "****Error: Cannot have -o or -p options with -m.");
+    }
+    if (outfn2 && !outfn) {
+        usage(EXIT_FAILURE, "****Error: -p needs the forward output file, -o.");
+    }
+    if (gzip_output && bgzf_output) {
+        usage(EXIT_FAILURE, "****Error: Cannot have both -g and --bgzf.");
+    }
+    format = bgzf_output ? GEN_BGZF : (gzip_output ? GEN_GZIP : GEN_PLAIN);
+
+    return 0;
+}
+
+uint64_t Generator::next_random(){
+    //xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+double Generator::random_fraction(){
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int Generator::read_length(){
+    if (len_max == len_min) return len_min;
+    if (len_max > 0) return len_min + next_random() % (len_max - len_min + 1);
+    //Box-Muller
+    double u1 = random_fraction(), u2 = random_fraction();
+    double normal = sqrt(-2.0 * log(1.0 - u1)) * cos(2 * M_PI * u2);
+    return max(1, (int)lround(len_mean + len_sd * normal));
+}
+
+void Generator::random_bases(std::string &seq, int len){
+    size_t start = seq.length();
+    seq.resize(start + len);
+    for (int i = 0; i < len; i += 32) {
+        //two bits of the random number per base
+        uint64_t bits = next_random();
+        for (int j = i; j < min(len, i + 32); j++, bits >>= 2) {
+            seq[start + j] = "ACGT"[bits & 3];
+        }
+    }
+}
+
+void Generator::make_qualities(std::string &qual, int len){
+    int offset = quality_constants[qualtype][Q_OFFSET];
+    int min_q = quality_constants[qualtype][Q_MIN] - offset;
+    int max_q = quality_constants[qualtype][Q_MAX] - offset;
+    qual.resize(len);
+    for (int pos = 0; pos < len; pos++) {
+        double decay = len > 1 ? (double)pos / (len - 1) : 0;
+        int q = qual_start + (int)lround((qual_end - qual_start) * decay * decay) + (int)(next_random() % 7) - 3;
+        q = max(min_q, min(max_q, q));
+        qual[pos] = (char)(q + offset);
+    }
+}
+
+void Generator::add_errors(std::string &seq, std::string &qual){
+    if (n_rate <= 0) return;
+    int offset = quality_constants[qualtype][Q_OFFSET];
+    int min_q = max(2, quality_constants[qualtype][Q_MIN] - offset);
+    for (size_t i = 0; i < seq.length(); i++) {
+        if (random_fraction() < n_rate) {
+            seq[i] = 'N';
+            qual[i] = (char)(min_q + offset);
+        }
+    }
+}
+
+/* Two-colour chemistry reads G when there is no signal, so the tail of the
+read is G, with qualities that do not drop much */
+void Generator::add_poly_g(std::string &seq, std::string &qual){
+    if (poly_g_rate <= 0 || random_fraction() >= poly_g_rate) return;
+    int len = seq.length();
+    if (len < 20) return;
+    int tail = 10 + next_random() % (len / 2 - 9);
+    int offset = quality_constants[qualtype][Q_OFFSET];
+    for (int i = len - tail; i < len; i++) {
+        seq[i] = 'G';
+        qual[i] = (char)(max(qual[i] - offset, qual_end) + offset);
+    }
+}
+
+static void reverse_complement(const std::string &seq, std::string &revcomp){
+    revcomp.resize(seq.length());
+    for (size_t i = 0; i < seq.length(); i++) {
+        char base;
+        switch (seq[seq.length() - 1 - i]) {
+            case 'A': base = 'T'; break;
+            case 'C': base = 'G'; break;
+            case 'G': base = 'C'; break;
+            case 'T': base = 'A'; break;
+            default: base = 'N';
+        }
+        revcomp[i] = base;
+    }
+}
+
+void Generator::make_single(long n, std::string &rec){
+    int len = read_length();
+    std::string seq, qual;
+    if (random_fraction() < adapter_rate) {
+        random_bases(seq, next_random() % len);
+        seq += adapter1;
+    }
+    if ((int)seq.length() < len) random_bases(seq, len - seq.length());
+    seq.resize(len);
+    make_qualities(qual, len);
+    add_errors(seq, qual);
+    add_poly_g(seq, qual);
+    rec += "@gen:" + to_string(seed) + ":" + to_string(n) + "\n" + seq + "\n+\n" + qual + "\n";
+}
+
+/* Both mates are read from the ends of the same fragment. Fragments shorter
+than the reads are followed by the adapters. */
+void Generator::make_pair(long n, std::string &rec1, std::string &rec2){
+    int len = read_length();
+    std::string fragment, seq1, seq2, qual1, qual2;
+    bool short_insert = random_fraction() < adapter_rate;
+    random_bases(fragment, short_insert ? next_random() % len : len + next_random() % (len + 1));
+    seq1 = fragment;
+    reverse_complement(fragment, seq2);
+    if (short_insert) {
+        seq1 += adapter1;
+        seq2 += adapter2;
+    }
+    if ((int)seq1.length() < len) random_bases(seq1, len - seq1.length());
+    if ((int)seq2.length() < len) random_bases(seq2, len - seq2.length());
+    seq1.resize(len);
+    seq2.resize(len);
+    make_qualities(qual1, len);
+    make_qualities(qual2, len);
+    add_errors(seq1, qual1);
+    add_errors(seq2, qual2);
+    add_poly_g(seq1, qual1);
+    add_poly_g(seq2, qual2);
+    std::string name = "@gen:" + to_string(seed) + ":" + to_string(n);
+    rec1 += name + "/1\n" + seq1 + "\n+\n" + qual1 + "\n";
+    rec2 += name + "/2\n" + seq2 + "\n+\n" + qual2 + "\n";
+}
+
+int Generator::generate_main(){
+    //splitmix64 of the seed, so close seeds give unrelated states (and never 0)
+    uint64_t z = (uint64_t)seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    rng_state = (z ^ (z >> 31)) | 1;
+
+    bool paired = outfn2 || outfnc;
+    GenOutput output, output2;
+    int res = output.open(outfnc ? outfnc : outfn, format);
+    if (res != 0) return res;
+    if (outfn2) {
+        res = output2.open(outfn2, format);
+        if (res != 0) return res;
+    }
+
+    std::string chunk, chunk2;
+    for (long n = 0; n < n_reads; ) {
+        chunk.clear();
+        chunk2.clear();
+        long last = min(n_reads, n + GEN_CHUNK_RECORDS);
+        for (; n < last; n++) {
+            if (!paired) make_single(n, chunk);
+            //interleaved pairs go one after the other in the same chunk
+            else if (outfnc) make_pair(n, chunk, chunk);
+            else make_pair(n, chunk, chunk2);
+        }
+        if (output.write(chunk) != 0 || (outfn2 && output2.write(chunk2) != 0)) {
+            fprintf(stderr, "****Error: Could not write the generated reads.\n\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    res = output.close();
+    if (res == 0 && outfn2) res = output2.close();
+    if (res != 0) {
+        fprintf(stderr, "****Error: Could not write the generated reads.\n\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#ifndef _GENERATE_
+#define _GENERATE_
+
+#include <stdio.h>
+#include <zlib.h>
+#include <cstdint>
+#include <string>
+
+#ifndef DEFAULT_GEN_READ_LEN
+#define DEFAULT_GEN_READ_LEN 150
+#endif
+
+/* Adapters appended to inserts shorter than the read, TruSeq by default */
+#ifndef DEFAULT_GEN_ADAPTER1
+#define DEFAULT_GEN_ADAPTER1 "AGATCGGAAGAGCACACGTCTGAACTCCAGTCA"
+#endif
+#ifndef DEFAULT_GEN_ADAPTER2
+#define DEFAULT_GEN_ADAPTER2 "AGATCGGAAGAGCGTCGTGTAGGGAAAGAGTGT"
+#endif
+
+/* Records generated before writing them out */
+#ifndef GEN_CHUNK_RECORDS
+#define GEN_CHUNK_RECORDS 4096
+#endif
+
+/* Uncompressed bytes per BGZF block, as bgzip */
+#ifndef BGZF_BLOCK_LEN
+#define BGZF_BLOCK_LEN 0xff00
+#endif
+
+typedef enum {
+    GEN_PLAIN,
+    GEN_GZIP,
+    GEN_BGZF
+} gen_format;
+
+/* Plain, gzip or BGZF (blocked gzip, as written by bgzip) output file */
+class GenOutput{
+public:
+    GenOutput();
+    int open(const char* path, gen_format format);
+    int write(const std::string &content);
+    int close();
+private:
+    int write_bgzf_block(const char* data, size_t len);
+    gen_format format;
+    FILE* file;
+    gzFile gz_file;
+    std::string pending;
+};
+
+/* `sickle gen`, writes synthetic FASTQ files with quality decay, Ns,
+adapters and poly-G tails, the same for the same seed and options */
+class Generator{
+public:
+    Generator();
+    ~Generator();
+    int parse_args(int argc, char *argv[]);
+    int generate_main();
+    void usage(int status, char const *msg);
+private:
+    uint64_t next_random();
+    double random_fraction();
+    int read_length();
+    void random_bases(std::string &seq, int len);
+    void make_qualities(std::string &qual, int len);
+    void add_errors(std::string &seq, std::string &qual);
+    void add_poly_g(std::string &seq, std::string &qual);
+    void make_pair(long n, std::string &rec1, std::string &rec2);
+    void make_single(long n, std::string &rec);
+
+    uint64_t rng_state;
+    long seed;
+    long n_reads;
+    int qualtype;
+    //length distribution: fixed (min == max), uniform between min and max, or normal
+    int len_min, len_max;
+    double len_mean, len_sd;
+    int qual_start, qual_end;
+    double n_rate;
+    double adapter_rate;
+    double poly_g_rate;
+    std::string adapter1, adapter2;
+    gen_format format;
+
+    char *outfn, *outfn2, *outfnc;
+};
+
+#endif
@@ -0,0 +1,428 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include "libsickle.h"
+#include "trim.h"
+
+using namespace std;
+
+/* The trimming of Abstract_Trimmer, configured from a TrimConfig instead of argv */
+class TrimmerCore: public Abstract_Trimmer{
+public:
+	TrimmerCore(const TrimConfig &config){
+		qualtype = config.qualtype;
+		qual_threshold = config.qual_threshold;
+		length_threshold = config.length_threshold;
+		no_fiveprime = config.no_fiveprime;
+		trunc_n = config.trunc_n;
+		threads = 1;
+		batch_len = 0;
+		input = NULL;
+		outfile_gzip = NULL;
+		outfn = NULL;
+		infn = NULL;
+		quiet = 1;
+		gzip_output = 0;
+		kept = discard = total = 0;
+		adapters->max_mismatches = config.adapter_mismatches;
+		adapters->min_overlap = config.adapter_min_overlap;
+		for (size_t i = 0; i < config.adapters.size(); i++) adapters->add_adapter(config.adapters[i].c_str());
+		polyx->min_len = config.polyx_min_len;
+		polyx->max_mismatches = config.polyx_mismatches;
+		if (!config.polyx_bases.empty()) polyx->add_bases(config.polyx_bases.c_str());
+		max_ee = config.max_ee;
+		max_dust = config.max_dust;
+		detect_overlap = config.detect_overlap;
+		debug = config.debug;
+		prepare_filters();
+	}
+	int parse_args(int argc, char *argv[]){ return 0; }
+	int trim_main(){ return 0; }
+	void usage(int status, char const *msg){}
+	//Position of the first quality out of the range of qualtype, or -1
+	long bad_quality(string_view qual){
+		for (size_t i = 0; i < qual.length(); i++) {
+			int value = (unsigned char) qual[i];
+			if (value < quality_constants[qualtype][Q_MIN] || value > quality_constants[qualtype][Q_MAX]) return i;
+		}
+		return -1;
+	}
+	cutsites trim(FQEntry &fqrec, int max_len = -1){
+		cutsites* cs = trim_read(fqrec, max_len);
+		cutsites result = *cs;
+		free(cs);
+		return result;
+	}
+	//Bases of a pair up to its insert size with detect_overlap, or -1
+	int insert_size(FQEntry &fqrec1, FQEntry &fqrec2){
+		if (!detect_overlap) return -1;
+		return adapters->find_insert_size(fqrec1.seq, fqrec2.seq);
+	}
+	//for the workers of a Pipeline
+	using Abstract_Trimmer::trim_read;
+	using Abstract_Trimmer::prepare_split_scan;
+	using Abstract_Trimmer::scan_split_range;
+	using Abstract_Trimmer::finish_split_scan;
+	bool detect_overlap;
+};
+
+Trimmer::Trimmer(const TrimConfig &config){
+	if (config.qualtype != SANGER && config.qualtype != ILLUMINA && config.qualtype != SOLEXA)
+		throw invalid_argument("Quality type must be SANGER, ILLUMINA or SOLEXA");
+	if (config.qual_threshold < 0) throw invalid_argument("Quality threshold must be >= 0");
+	if (config.length_threshold < 0) throw invalid_argument("Length threshold must be >= 0");
+	if (config.adapter_mismatches < 0) throw invalid_argument("Adapter mismatches must be >= 0");
+	if (config.adapter_min_overlap < 1) throw invalid_argument("Adapter minimum overlap must be >= 1");
+	if (strspn(config.polyx_bases.c_str(), "ACGTacgt") != config.polyx_bases.length())
+		throw invalid_argument("Poly-X bases must be some of A, C, G and T");
+	if (config.polyx_min_len < 1) throw invalid_argument("Poly-X minimum length must be >= 1");
+	if (config.polyx_mismatches < 0) throw invalid_argument("Poly-X mismatches must be >= 0");
+	core = new TrimmerCore(config);
+}
+
+Trimmer::~Trimmer(){
+	delete(core);
+}
+
+/* fqrec with a read given to trim or trim_pair, checked as sickle se
+does; it would print what is wrong and stop */
+static void checked_read(TrimmerCore* core, string_view seq, string_view qual, FQEntry &fqrec){
+	if (seq.length() != qual.length()) throw invalid_argument("Sequence and quality must have the same length");
+	long bad = core->bad_quality(qual);
+	if (bad >= 0)
+		throw invalid_argument("Quality char '" + string(1, qual[bad]) + "' at position " + to_string(bad + 1) + " is out of the range of the quality type");
+	fqrec.seq = seq;
+	fqrec.qual = qual;
+}
+
+cutsites Trimmer::trim(string_view seq, string_view qual) const{
+	FQEntry fqrec;
+	checked_read(core, seq, qual, fqrec);
+	return core->trim(fqrec);
+}
+
+void Trimmer::trim_pair(string_view seq1, string_view qual1, string_view seq2, string_view qual2,
+	cutsites &cs1, cutsites &cs2) const{
+	FQEntry fqrec1, fqrec2;
+	checked_read(core, seq1, qual1, fqrec1);
+	checked_read(core, seq2, qual2, fqrec2);
+	int insert_size = core->insert_size(fqrec1, fqrec2);
+	cs1 = core->trim(fqrec1, insert_size);
+	cs2 = core->trim(fqrec2, insert_size);
+}
+
+/* Next line of text from pos, without its newline; false at the end */
+static bool next_line(string_view text, size_t &pos, string_view &line){
+	if (pos >= text.length()) return false;
+	size_t end = text.find('\n', pos);
+	if (end == string_view::npos) end = text.length();
+	line = text.substr(pos, end - pos);
+	pos = end + 1;
+	return true;
+}
+
+long Trimmer::trim_fastq(string_view fastq, char* out, size_t capacity, TrimCounts* counts) const{
+	if (capacity < fastq.length() + 1) return -1;
+	size_t pos = 0;
+	char* next = out;
+	FQEntry fqrec;
+	while (next_line(fastq, pos, fqrec.name)) {
+		if (!next_line(fastq, pos, fqrec.seq) || !next_line(fastq, pos, fqrec.comment) || !next_line(fastq, pos, fqrec.qual)) return -1;
+		if (fqrec.name.empty() || fqrec.name[0] != '@' || fqrec.comment.empty() || fqrec.comment[0] != '+'
+			|| fqrec.seq.length() != fqrec.qual.length() || core->bad_quality(fqrec.qual) >= 0) return -1;
+		cutsites cs = core->trim(fqrec);
+		if (counts) counts->records++;
+		if (cs.three_prime_cut < 0) {
+			if (counts) counts->discarded++;
+			continue;
+		}
+		if (counts) counts->kept++;
+		size_t len = cs.three_prime_cut - cs.five_prime_cut;
+		string_view fields[] = {fqrec.name, fqrec.seq.substr(cs.five_prime_cut, len), fqrec.comment, fqrec.qual.substr(cs.five_prime_cut, len)};
+		for (string_view field: fields) {
+			memcpy(next, field.data(), field.length());
+			next += field.length();
+			*next++ = '\n';
+		}
+	}
+	return next - out;
+}
+
+/* Lowest and highest quality chars of the first max_records reads of the
+queues; reads are dealt to the queues in turns, so this goes in input order */
+static void quality_range(vector<vector<FQEntry*>* > &queues, long max_records, int &min_char, int &max_char){
+	long seen = 0;
+	for (size_t j = 0; seen < max_records; j++) {
+		bool any = false;
+		for (size_t i = 0; i < queues.size() && seen < max_records; i++) {
+			if (j >= queues[i]->size()) continue;
+			string_view qual = queues[i]->at(j)->qual;
+			for (size_t k = 0; k < qual.length(); k++) {
+				int c = (unsigned char) qual[k];
+				if (c < min_char) min_char = c;
+				if (c > max_char) max_char = c;
+			}
+			seen++;
+			any = true;
+		}
+		if (!any) break;
+	}
+}
+
+/* The quality type the chars fit, or -1 (and the error printed) if none */
+static int detected_qualtype(int min_char, int max_char){
+	/* the lowest quality char sets the offset: solexa starts around ';'
+	and illumina 1.3+ at '@' */
+	int qualtype;
+	if (min_char < quality_constants[SANGER][Q_MIN]) {
+		fprintf(stderr, "****Error: Quality char (%d) is below every known encoding.\n", min_char);
+		return -1;
+	} else if (min_char < quality_constants[SOLEXA][Q_MIN]) {
+		qualtype = SANGER;
+	} else if (min_char < quality_constants[ILLUMINA][Q_MIN]) {
+		qualtype = SOLEXA;
+	} else if (max_char <= 'J') {
+		/* only high qualities, as sanger Q31 to Q41; illumina 1.3+ goes further */
+		qualtype = SANGER;
+		fprintf(stderr, "Warning: Quality chars from '%c' to '%c' fit both sanger and illumina, using sanger.\n",
+			min_char, max_char);
+	} else {
+		qualtype = ILLUMINA;
+	}
+	if (max_char > quality_constants[qualtype][Q_MAX]) {
+		fprintf(stderr, "****Error: Quality chars from '%c' to '%c' do not fit any known encoding.\n", min_char, max_char);
+		return -1;
+	}
+	return qualtype;
+}
+
+Pipeline::Pipeline(const TrimConfig &config, RecordSource &source, RecordSink &sink, const PipelineOptions &options):
+	config(config), source(source), sink(sink), options(options){
+	if (options.parts < 1) throw invalid_argument("Parts must be >= 1");
+	if (options.output_batches < 1) throw invalid_argument("Output batches must be >= 1");
+	//a config of QUALTYPE_AUTO is checked as sanger, its Trimmer is made again once the type is detected
+	TrimConfig checked = config;
+	if (checked.qualtype == QUALTYPE_AUTO) checked.qualtype = SANGER;
+	trimmer = new Trimmer(checked);
+	workers = NULL;
+	queue = -1;
+	failed = false;
+	split_scans.resize(options.parts);
+	part_counts.resize(options.parts);
+	next_write = 0;
+	in_flight = 0;
+	writing = false;
+}
+
+Pipeline::~Pipeline(){
+	delete(trimmer);
+}
+
+TrimCounts Pipeline::run(){
+	WorkerPool* own_workers = NULL;
+	workers = options.workers;
+	if (!workers) workers = own_workers = new WorkerPool(options.parts + options.output_batches);
+	queue = workers->open_queue();
+	TaskGroup outputs(workers, queue);
+	bool started = false;
+	long batch_n = 0;
+	while (!failed) {
+		RecordBatch* batch;
+		try {
+			batch = source.next(options.parts);
+		} catch (...) {
+			fail(current_exception());
+			break;
+		}
+		if (!batch) break;
+		batch->n = batch_n++;
+		try {
+			if (!started) {
+				if (config.qualtype == QUALTYPE_AUTO) detect_qualtype(batch);
+				sink.start(config.qualtype);
+				started = true;
+			}
+			trim(batch);
+			for (int part = 0; part < batch->parts; part++) {
+				counts.records += part_counts[part].records;
+				counts.kept += part_counts[part].kept;
+				counts.discarded += part_counts[part].discarded;
+			}
+			if (!failed) source.trimmed(batch);
+		} catch (...) {
+			fail(current_exception());
+		}
+
+		/* a batch failed or not goes through the output, which releases the
+		batches in input order; only output_batches are held at once */
+		timepoint wait_start;
+		if (batch->stats) wait_start = stats_now();
+		TRACE_BEGIN("output wait", batch->n);
+		{
+			unique_lock<mutex> guard(output_lock);
+			output_done.wait(guard, [this]{ return in_flight < options.output_batches; });
+			in_flight++;
+		}
+		TRACE_END("output wait", batch->n);
+		if (batch->stats) batch->stats->output_wait = seconds_between(wait_start, stats_now());
+		outputs.run([this, batch]{ finish(batch); });
+	}
+
+	outputs.wait();
+	workers->close_queue(queue);
+	delete(own_workers);
+	if (error) rethrow_exception(error);
+	return counts;
+}
+
+void Pipeline::detect_qualtype(RecordBatch* batch){
+	int min_char = 255, max_char = 0;
+	for (int mate = 0; mate < batch->mates; mate++)
+		quality_range(batch->records[mate]->queues, AUTO_QUALTYPE_SAMPLE, min_char, max_char);
+	int qualtype = detected_qualtype(min_char, max_char);
+	if (qualtype < 0) throw TrimError{EXIT_FAILURE};
+	config.qualtype = qualtype;
+	delete(trimmer);
+	trimmer = new Trimmer(config);
+}
+
+void Pipeline::trim(RecordBatch* batch){
+	TaskGroup parts(workers, queue);
+	bool split = options.split_bases > 0 && batch->mates == 1 && batch->parts > 1;
+	timepoint start;
+	if (batch->stats) start = stats_now();
+	TRACE_BEGIN("trim", batch->n);
+	for (int part = 0; part < batch->parts; part++) part_counts[part] = TrimCounts();
+	if (split) {
+		/* The window scans of the long reads of the batch are split between
+		all the parts: each part prepares its own reads, scans its range of
+		every read once they all are, then finishes its reads as it trims them */
+		for (int part = 0; part < batch->parts; part++) parts.run([this, batch, part]{ prepare_part(batch, part); });
+		parts.wait();
+		for (int part = 0; part < batch->parts; part++) parts.run([this, batch, part]{ scan_part(batch, part); });
+		parts.wait();
+	}
+	for (int part = 0; part < batch->parts; part++) parts.run([this, batch, part, split]{ trim_part(batch, part, split); });
+	parts.wait();
+	TRACE_END("trim", batch->n);
+	if (batch->stats) batch->stats->seconds[STAGE_TRIM] = seconds_between(start, stats_now());
+}
+
+void Pipeline::prepare_part(RecordBatch* batch, int part){
+	TRACE_THREAD(TRACE_TID_WORKER + part, "worker", part);
+	timepoint start;
+	if (batch->stats) start = stats_now();
+	source.localize(batch, part);
+	vector<FQEntry*> &reads = *batch->records[0]->queues[part];
+	vector<SplitScan> &splits = split_scans[part];
+	splits.clear();
+	for (size_t j = 0; j < reads.size(); j++) {
+		if (reads[j]->seq.length() < (size_t)options.split_bases) continue;
+		splits.emplace_back();
+		trimmer->core->prepare_split_scan(*reads[j], batch->parts, splits.back());
+	}
+	if (batch->stats) batch->stats->worker_seconds[part] += seconds_between(start, stats_now());
+}
+
+void Pipeline::scan_part(RecordBatch* batch, int part){
+	TRACE_THREAD(TRACE_TID_WORKER + part, "worker", part);
+	timepoint start;
+	if (batch->stats) start = stats_now();
+	try {
+		for (size_t i = 0; i < split_scans.size() && !failed; i++) {
+			for (size_t k = 0; k < split_scans[i].size() && !failed; k++) trimmer->core->scan_split_range(split_scans[i][k], part);
+		}
+	} catch (...) {
+		fail(current_exception());
+	}
+	if (batch->stats) batch->stats->worker_seconds[part] += seconds_between(start, stats_now());
+}
+
+void Pipeline::trim_part(RecordBatch* batch, int part, bool split){
+	TRACE_THREAD(TRACE_TID_WORKER + part, "worker", part);
+	timepoint start;
+	if (batch->stats) start = stats_now();
+	if (!split) source.localize(batch, part);
+	TRACE_BEGIN("trim reads", batch->n);
+	TrimmerCore* core = trimmer->core;
+	RecordArrays* records1 = batch->records[0];
+	RecordArrays* records2 = batch->records[1];
+	vector<FQEntry*> &reads1 = *records1->queues[part];
+	TrimCounts &part_count = part_counts[part];
+	//next long read of this part in split_scans
+	size_t next_split = 0;
+	try {
+		//a failed part stops the others, the rest of the batch is only released
+		for (size_t j = 0; j < reads1.size() && !failed; j++) {
+			FQEntry* read1 = reads1[j];
+			if (batch->mates == 1) {
+				if (split && read1->seq.length() >= (size_t)options.split_bases)
+					records1->cuts[part][j] = core->finish_split_scan(split_scans[part][next_split++]);
+				else
+					records1->cuts[part][j] = core->trim_read(*read1);
+			} else {
+				FQEntry* read2 = records2->queues[part]->at(j);
+				int insert_size = core->insert_size(*read1, *read2);
+				records1->cuts[part][j] = core->trim_read(*read1, insert_size);
+				records2->cuts[part][j] = core->trim_read(*read2, insert_size);
+			}
+			for (int mate = 0; mate < batch->mates; mate++) {
+				RecordArrays* records = batch->records[mate];
+				part_count.records++;
+				if (records->cuts[part][j]->three_prime_cut >= 0) {
+					part_count.kept++;
+				} else {
+					records->filtered[part][j] = true;
+					part_count.discarded++;
+				}
+			}
+		}
+		if (!failed) sink.part_trimmed(batch, part);
+	} catch (...) {
+		fail(current_exception());
+	}
+	TRACE_END("trim reads", batch->n);
+	if (batch->stats) batch->stats->worker_seconds[part] += seconds_between(start, stats_now());
+}
+
+void Pipeline::finish(RecordBatch* batch){
+	TRACE_THREAD(TRACE_TID_OUTPUT + batch->n, "output", batch->n);
+	if (!failed) {
+		try {
+			sink.format(batch);
+		} catch (...) {
+			fail(current_exception());
+		}
+	}
+	unique_lock<mutex> guard(output_lock);
+	formatted[batch->n] = batch;
+	//the worker writing takes this batch in its turn
+	if (writing) return;
+	writing = true;
+	map<long, RecordBatch*>::iterator next;
+	while ((next = formatted.find(next_write)) != formatted.end()) {
+		RecordBatch* turn = next->second;
+		formatted.erase(next);
+		guard.unlock();
+		TRACE_THREAD(TRACE_TID_OUTPUT + turn->n, "output", turn->n);
+		if (!failed) {
+			try {
+				sink.write(turn);
+			} catch (...) {
+				fail(current_exception());
+			}
+		}
+		source.release(turn);
+		guard.lock();
+		next_write++;
+		in_flight--;
+		output_done.notify_all();
+	}
+	writing = false;
+}
+
+void Pipeline::fail(exception_ptr thrown){
+	lock_guard<mutex> guard(output_lock);
+	if (!error) error = thrown;
+	failed = true;
+}
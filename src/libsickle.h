@@ -0,0 +1,190 @@
+#ifndef _LIBSICKLE_
+#define _LIBSICKLE_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "sickle.h"
+#include "adapter.h"
+#include "polyx.h"
+#include "FQEntry.h"
+#include "pool.h"
+#include "stats.h"
+#include "workers.h"
+
+/* libsickle: the trimming of sickle se and pe for programs that have the
+reads in memory already (as a demultiplexer or an aligner front end), with
+no files or argv in between. A Trimmer trims records one at a time, and a
+Pipeline streams the batches of a RecordSource through the worker threads
+into a RecordSink; sickle se and pe are a Pipeline from their input files
+to their output files. `make lib` builds libsickle.a; see the README. */
+
+/* Options of a Trimmer, as those of sickle se and pe */
+struct TrimConfig{
+    //SANGER, ILLUMINA or SOLEXA; QUALTYPE_AUTO only for a Pipeline, which detects it from the first batch
+    int qualtype = SANGER;
+    int qual_threshold = 20;
+    int length_threshold = 20;
+    bool no_fiveprime = false;
+    bool trunc_n = false;
+    std::vector<std::string> adapters;
+    int adapter_mismatches = DEFAULT_ADAPTER_MISMATCHES;
+    int adapter_min_overlap = DEFAULT_ADAPTER_MIN_OVERLAP;
+    //homopolymer tails to trim, as "G" for --poly-g
+    std::string polyx_bases;
+    int polyx_min_len = DEFAULT_POLYX_MIN_LEN;
+    int polyx_mismatches = DEFAULT_POLYX_MISMATCHES;
+    //-1 is no limit
+    float max_ee = -1;
+    float max_dust = -1;
+    //pairs whose reads overlap are cut at the insert size, as pe --detect-overlap
+    bool detect_overlap = false;
+    //prints the window scan of each read on stdout, as -d
+    bool debug = false;
+};
+
+struct TrimCounts{
+    long records = 0;
+    long kept = 0;
+    long discarded = 0;
+};
+
+class TrimmerCore;
+struct SplitScan;
+
+/* Trims reads with a TrimConfig. It is not changed by trimming, so one
+Trimmer can be used by any number of threads at once. */
+class Trimmer{
+public:
+    //throws std::invalid_argument for a config sickle se would refuse
+    Trimmer(const TrimConfig &config);
+    ~Trimmer();
+    Trimmer(const Trimmer&) = delete;
+    Trimmer& operator=(const Trimmer&) = delete;
+    /* Bases [five_prime_cut, three_prime_cut) of the read are kept, or both are
+    -1 if it is discarded. Throws std::invalid_argument if seq and qual have
+    different lengths, or a quality is out of the range of the quality type. */
+    cutsites trim(std::string_view seq, std::string_view qual) const;
+    /* Trims the whole FASTQ records of fastq into out, as sickle se writes them.
+    The output is never longer than the input and a newline. Returns the bytes
+    written, or -1 if capacity is less than that or a record is malformed or
+    has a quality out of the range of the quality type. */
+    long trim_fastq(std::string_view fastq, char* out, size_t capacity, TrimCounts* counts = NULL) const;
+    //Both reads of a pair, each trimmed as trim does, cut at their insert size with detect_overlap
+    void trim_pair(std::string_view seq1, std::string_view qual1, std::string_view seq2, std::string_view qual2,
+        cutsites &cs1, cutsites &cs2) const;
+private:
+    friend class Pipeline;
+    TrimmerCore* core;
+};
+
+/* Reads going through a Pipeline together. Mate m of read j of part p is
+records[m]->queues[p]->at(j); each part is trimmed by one worker, which
+sets its filtered flags and cutsites. */
+struct RecordBatch{
+    virtual ~RecordBatch(){}
+    //1, or 2 for pairs
+    int mates = 1;
+    int parts = 0;
+    RecordArrays* records[2] = {NULL, NULL};
+    //set by the Pipeline, 0 for the first batch of the run
+    long n = 0;
+    //NULL unless the source keeps stats, the Pipeline adds its trim stage and output wait
+    BatchStats* stats = NULL;
+};
+
+/* Where a Pipeline gets its batches, all on the thread of run() */
+class RecordSource{
+public:
+    virtual ~RecordSource(){}
+    /* The next batch, its reads dealt between parts, with the arrays fit
+    to them; NULL at the end of the input. Throws TrimError if the input
+    can't be read. */
+    virtual RecordBatch* next(int parts) = 0;
+    //Once the reads of the batch are trimmed, before it is written
+    virtual void trimmed(RecordBatch* batch){}
+    //Frees the batch once it is written, or given up after a failure; on any thread
+    virtual void release(RecordBatch* batch) = 0;
+    //On the worker of a part, before it trims it (as --numa does)
+    virtual void localize(RecordBatch* batch, int part){}
+};
+
+/* Where a Pipeline puts the trimmed batches */
+class RecordSink{
+public:
+    virtual ~RecordSink(){}
+    //Before the first batch, with the quality type of the run (detected if the config says QUALTYPE_AUTO)
+    virtual void start(int qualtype){}
+    //On the worker that trimmed the part
+    virtual void part_trimmed(RecordBatch* batch, int part){}
+    //On a worker, with up to output_batches of them formatted at once
+    virtual void format(RecordBatch* batch) = 0;
+    //One at a time, in input order, once formatted; throws TrimError if it can't
+    virtual void write(RecordBatch* batch) = 0;
+};
+
+struct PipelineOptions{
+    //parts of a batch, trimmed at once
+    int parts = 1;
+    //NULL for threads of the pipeline's own, parts and output_batches of them
+    WorkerPool* workers = NULL;
+    //batches trimmed but not written yet; the next one waits for a place after its trimming
+    int output_batches = 1;
+    //reads of at least this many bases have their window scan split between the parts, 0 for none
+    long split_bases = 0;
+};
+
+/* Trims the batches of a source into a sink. A batch is read, its parts
+trimmed at once by the workers, and it is formatted and written by the
+workers while the next ones are read and trimmed. */
+class Pipeline{
+public:
+    Pipeline(const TrimConfig &config, RecordSource &source, RecordSink &sink, const PipelineOptions &options);
+    ~Pipeline();
+    /* Reads, counted by mate. Throws what the source, the sink or the
+    Trimmer threw (TrimError for a quality out of the range of the quality
+    type), once the batches in flight are released; the ones after a
+    failure are not written. */
+    TrimCounts run();
+private:
+    void detect_qualtype(RecordBatch* batch);
+    void trim(RecordBatch* batch);
+    //the steps of the part of a worker: the split scans of --long-reads first, then its reads
+    void prepare_part(RecordBatch* batch, int part);
+    void scan_part(RecordBatch* batch, int part);
+    void trim_part(RecordBatch* batch, int part, bool split);
+    void finish(RecordBatch* batch);
+    //keeps the first exception, the batches after it are only released
+    void fail(std::exception_ptr thrown);
+
+    TrimConfig config;
+    RecordSource &source;
+    RecordSink &sink;
+    PipelineOptions options;
+    Trimmer* trimmer;
+    WorkerPool* workers;
+    int queue;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+    TrimCounts counts;
+    //counted by the worker of each part
+    std::vector<TrimCounts> part_counts;
+    //the long reads of each part of the batch being trimmed, with --long-reads
+    std::vector<std::vector<SplitScan> > split_scans;
+
+    std::mutex output_lock;
+    std::condition_variable output_done;
+    //formatted batches waiting for their turn to be written, by number
+    std::map<long, RecordBatch*> formatted;
+    long next_write;
+    int in_flight;
+    //a worker is writing the formatted batches in order, the others leave theirs to it
+    bool writing;
+};
+
+#endif
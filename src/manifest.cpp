@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "manifest.h"
+
+using namespace std;
+
+ManifestRunner::ManifestRunner() : runner("--samples", DEFAULT_SAMPLES_IN_FLIGHT){
+    manifest_fn = NULL;
+    report_fn = NULL;
+    quiet = 0;
+    next_sample = 0;
+}
+
+ManifestRunner::~ManifestRunner(){
+    for(size_t i = 0; i < samples.size(); i++) delete(samples[i].trimmer);
+    free(manifest_fn);
+    free(report_fn);
+}
+
+void ManifestRunner::usage(int status, char const *msg){
+    fprintf(stderr, "\nUsage: %s batch --manifest <samples tsv> [--samples N] [--report <report tsv>] -t <quality type> [options]\n\
+\n\
+Options:\n\
+--manifest, TSV file with a sample per line: its name, its type (se, pe or interleaved) and its files (required):\n\
+\tse: input output; pe: input1 input2 output1 output2 singles; interleaved: input output singles.\n\
+\tEmpty lines and lines starting with # are skipped.\n\
+--samples, Samples trimmed at once, sharing the threads and batch buffers. Default %d.\n\
+--report, Write the records, kept and discarded reads, time and status of each sample to this TSV file.\n\
+--quiet, Don't print each sample as it finishes.\n\
+--help, display this help and exit\n\
+\n\
+The other options are those of se and pe (-t, -q, -l, -x, -n, -g, -b, the filters, --max-memory...)\n\
+and apply to every sample. -a is the total of threads, split between the samples trimmed at once,\n\
+and --max-memory the limit of all of them.\n\n", PROGRAM_NAME, DEFAULT_SAMPLES_IN_FLIGHT);
+
+    if (msg) fprintf(stderr, "%s\n\n", msg);
+    exit(status);
+}
+
+int ManifestRunner::parse_args(int argc, char *argv[]){
+    for(int i = 2; i < argc; i++){
+        int res = runner.parse_arg(argc, argv, i);
+        if(res == 0) continue;
+        if(res != -1) return res;
+        string arg = argv[i];
+        string name = arg.substr(0, arg.find('='));
+        bool inline_value = name.length() < arg.length();
+        if(name == "--manifest" || name == "--report"){
+            const char* value;
+            if(inline_value){
+                value = argv[i] + name.length() + 1;
+            }else if(i + 1 < argc){
+                value = argv[++i];
+            }else{
+                fprintf(stderr, "****Error: %s needs a value.\n\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+            if(name == "--manifest"){
+                free(manifest_fn);
+                manifest_fn = strdup(value);
+            }else{
+                free(report_fn);
+                report_fn = strdup(value);
+            }
+        }else if(arg == "--help"){
+            usage(EXIT_SUCCESS, NULL);
+        }else if(arg == "--quiet"){
+            quiet = 1;
+        }else if(job_option_in_list(job_file_options, name) || job_option_in_list(job_report_options, name)
+            || job_option_in_list(job_process_options, name) || job_option_in_list(job_checkpoint_options, name)){
+            //the files come from the manifest, and the per run reports would be written by every sample to the same file
+            fprintf(stderr, "****Error: %s is not an option of batch, the files of each sample are in the manifest.\n\n", name.c_str());
+            return EXIT_FAILURE;
+        }else{
+            trim_args.push_back(arg);
+        }
+    }
+
+    if(!manifest_fn){
+        usage(EXIT_FAILURE, "****Error: Must have a manifest.");
+    }
+    bool has_qualtype = false;
+    for(size_t i = 0; i < trim_args.size(); i++){
+        if(trim_args[i] == "-t" || job_option_name("se", trim_args[i].substr(0, trim_args[i].find('='))) == "--qual-type") has_qualtype = true;
+    }
+    if(!has_qualtype){
+        usage(EXIT_FAILURE, "****Error: Must have quality type.");
+    }
+    return read_manifest();
+}
+
+int ManifestRunner::read_manifest(){
+    ifstream manifest(manifest_fn);
+    if(!manifest.is_open()){
+        fprintf(stderr, "****Error: Could not open manifest '%s'.\n\n", manifest_fn);
+        return EXIT_FAILURE;
+    }
+    string line;
+    int line_n = 0;
+    while(getline(manifest, line)){
+        line_n++;
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        if(line.empty() || line[0] == '#') continue;
+        vector<string> fields;
+        stringstream columns(line);
+        string field;
+        while(getline(columns, field, '\t')) fields.push_back(field);
+
+        Sample sample;
+        sample.trimmer = NULL;
+        sample.records = sample.kept = sample.discarded = 0;
+        sample.seconds = 0;
+        sample.status = EXIT_FAILURE;
+        size_t files = 0;
+        if(fields.size() >= 2){
+            sample.name = fields[0];
+            sample.type = fields[1];
+            if(sample.type == "se") files = 2;
+            else if(sample.type == "pe") files = 5;
+            else if(sample.type == "interleaved") files = 3;
+        }
+        if(files == 0){
+            fprintf(stderr, "****Error: Line %d of '%s' must start with a sample name and a type, se, pe or interleaved.\n\n", line_n, manifest_fn);
+            return EXIT_FAILURE;
+        }
+        if(fields.size() != files + 2){
+            fprintf(stderr, "****Error: Line %d of '%s' must have %zu files for a %s sample.\n\n", line_n, manifest_fn, files, sample.type.c_str());
+            return EXIT_FAILURE;
+        }
+        //the inputs come first, and are checked now rather than after the samples before them
+        size_t inputs = sample.type == "pe" ? 2 : 1;
+        for(size_t i = 2; i < 2 + inputs; i++){
+            vector<string> files;
+            if(input_files(fields[i].c_str(), files) != 0) return EXIT_FAILURE;
+        }
+
+        const char* se_files[] = {"-f", "-o"};
+        const char* pe_files[] = {"-f", "-r", "-o", "-p", "-s"};
+        const char* interleaved_files[] = {"-c", "-m", "-s"};
+        const char** flags = sample.type == "se" ? se_files : (sample.type == "pe" ? pe_files : interleaved_files);
+        sample.args.insert(sample.args.end(), trim_args.begin(), trim_args.end());
+        for(size_t i = 0; i < files; i++){
+            sample.args.push_back(flags[i]);
+            sample.args.push_back(fields[i+2]);
+        }
+        samples.push_back(sample);
+    }
+    if(samples.empty()){
+        fprintf(stderr, "****Error: No samples in manifest '%s'.\n\n", manifest_fn);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+int ManifestRunner::prepare_sample(Sample &sample){
+    sample.trimmer = runner.prepare_job(sample.type == "se" ? "se" : "pe", sample.args);
+    if(!sample.trimmer){
+        fprintf(stderr, "****Error: Invalid options for sample '%s'.\n\n", sample.name.c_str());
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+void ManifestRunner::run_samples(){
+    while(true){
+        size_t index;
+        {
+            lock_guard<mutex> guard(lock);
+            if(next_sample >= samples.size()) return;
+            index = next_sample++;
+        }
+        Sample &sample = samples[index];
+        //the other samples go on if it fails
+        if(prepare_sample(sample) == 0){
+            JobResult result = runner.run_job(sample.trimmer);
+            sample.status = result.status;
+            sample.records = result.records;
+            sample.kept = result.kept;
+            sample.discarded = result.discarded;
+            sample.seconds = result.seconds;
+            delete(sample.trimmer);
+            sample.trimmer = NULL;
+        }
+
+        if(!quiet){
+            lock_guard<mutex> guard(lock);
+            fprintf(stdout, "%s (%s): %ld records, %ld kept, %ld discarded, %.2f s%s\n", sample.name.c_str(), sample.type.c_str(),
+                sample.records, sample.kept, sample.discarded, sample.seconds, sample.status == 0 ? "" : ", failed");
+            fflush(stdout);
+        }
+    }
+}
+
+int ManifestRunner::write_report(){
+    FILE* report = fopen(report_fn, "w");
+    if(!report){
+        fprintf(stderr, "****Error: Could not open report file '%s'.\n\n", report_fn);
+        return EXIT_FAILURE;
+    }
+    fprintf(report, "sample\ttype\trecords\tkept\tdiscarded\tseconds\tstatus\n");
+    for(size_t i = 0; i < samples.size(); i++){
+        Sample &sample = samples[i];
+        fprintf(report, "%s\t%s\t%ld\t%ld\t%ld\t%.3f\t%s\n", sample.name.c_str(), sample.type.c_str(),
+            sample.records, sample.kept, sample.discarded, sample.seconds, sample.status == 0 ? "ok" : "failed");
+    }
+    fclose(report);
+    return 0;
+}
+
+int ManifestRunner::run_main(){
+    runner.start();
+
+    //all samples are checked before trimming any, their trimmers are made again as they are trimmed
+    for(size_t i = 0; i < samples.size(); i++){
+        int res = prepare_sample(samples[i]);
+        if(res != 0) return res;
+        delete(samples[i].trimmer);
+        samples[i].trimmer = NULL;
+    }
+
+    timepoint start = stats_now();
+    vector<thread> running;
+    for(size_t i = 0; i < (size_t)runner.jobs && i < samples.size(); i++){
+        running.push_back(thread(&ManifestRunner::run_samples, this));
+    }
+    for(size_t i = 0; i < running.size(); i++) running[i].join();
+
+    int failed = 0;
+    for(size_t i = 0; i < samples.size(); i++) if(samples[i].status != 0) failed++;
+    if(!quiet) fprintf(stdout, "\nSamples: %zu, failed: %d, total time %.2f s\n\n", samples.size(), failed, seconds_between(start, stats_now()));
+
+    if(report_fn){
+        int res = write_report();
+        if(res != 0) return res;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+#ifndef _MANIFEST_
+#define _MANIFEST_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include "runner.h"
+
+/* Samples of sickle batch trimmed at the same time */
+#ifndef DEFAULT_SAMPLES_IN_FLIGHT
+#define DEFAULT_SAMPLES_IN_FLIGHT 2
+#endif
+
+/* A line of the manifest and its results */
+struct Sample{
+    std::string name;
+    std::string type;
+    //options of the sample for se or pe, with its files
+    std::vector<std::string> args;
+    //only while the sample is in flight
+    Abstract_Trimmer* trimmer;
+    long records, kept, discarded;
+    double seconds;
+    int status;
+};
+
+/* `sickle batch`, trims the se, pe and interleaved samples of a TSV
+manifest in one process. A few samples are in flight at once, sharing the
+batch buffers (and the --max-memory budget) and the worker threads, so the
+small ones don't each pay for starting up and warming a new pipeline. The
+options of all samples are checked first, but the trimmer of a sample is
+only made once it is in flight. */
+class ManifestRunner{
+public:
+    ManifestRunner();
+    ~ManifestRunner();
+    int parse_args(int argc, char *argv[]);
+    int run_main();
+    void usage(int status, char const *msg);
+private:
+    int read_manifest();
+    int prepare_sample(Sample &sample);
+    void run_samples();
+    int write_report();
+
+    char* manifest_fn;
+    char* report_fn;
+    int quiet;
+    //options given for all samples, as for sickle se and pe
+    std::vector<std::string> trim_args;
+    std::vector<Sample> samples;
+
+    //--samples, -a, --max-memory and --hugepages
+    JobRunner runner;
+    std::mutex lock;
+    size_t next_sample;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include <ctype.h>
+#include "memory.h"
+
+using namespace std;
+
+uint64_t batch_memory(uint64_t block_bytes, uint64_t text_bytes, long lines){
+    return block_bytes + (BATCH_TEXT_COPIES - 1) * text_bytes + lines * BATCH_LINE_OVERHEAD + (lines / 4) * BATCH_RECORD_OVERHEAD;
+}
+
+MemoryBudget::MemoryBudget(uint64_t limit){
+    this->limit = limit;
+    in_use = 0;
+}
+
+void MemoryBudget::reserve(uint64_t bytes){
+    unique_lock<mutex> guard(lock);
+    //a batch bigger than the limit still goes through, on its own
+    released.wait(guard, [this, bytes]{ return in_use == 0 || in_use + bytes <= limit; });
+    in_use += bytes;
+}
+
+void MemoryBudget::resize(uint64_t reserved, uint64_t bytes){
+    lock_guard<mutex> guard(lock);
+    in_use = in_use - reserved + bytes;
+    if(bytes < reserved) released.notify_all();
+}
+
+void MemoryBudget::release(uint64_t bytes){
+    {
+        lock_guard<mutex> guard(lock);
+        in_use -= bytes;
+    }
+    released.notify_all();
+}
+
+uint64_t parse_memory_size(const char* text){
+    char* end;
+    double value = strtod(text, &end);
+    if(end == text || value <= 0) return 0;
+    double unit = 1024*1024;
+    switch(toupper(*end)){
+        case 'K': unit = 1024; end++; break;
+        case 'M': end++; break;
+        case 'G': unit = 1024.0*1024*1024; end++; break;
+        case 'T': unit = 1024.0*1024*1024*1024; end++; break;
+    }
+    if(toupper(*end) == 'B') end++;
+    if(*end != '\0') return 0;
+    return (uint64_t)(value * unit);
+}
@@ -0,0 +1,69 @@
+#ifndef _MEMORY_
+#define _MEMORY_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/* Estimate of the memory of a batch: the input block holding its text
+(bigger than the text, and grown for long records), the output buffer, and
+the allocations around each line and record (line pointers and views,
+FQEntry, cutsites) */
+#ifndef BATCH_TEXT_COPIES
+#define BATCH_TEXT_COPIES 2
+#endif
+#ifndef BATCH_LINE_OVERHEAD
+#define BATCH_LINE_OVERHEAD 28
+#endif
+#ifndef BATCH_RECORD_OVERHEAD
+#define BATCH_RECORD_OVERHEAD 130
+#endif
+/* Bytes expected per byte of batch_len, for sizing batch_len in a limit */
+#ifndef BATCH_MEMORY_FACTOR
+#define BATCH_MEMORY_FACTOR 4
+#endif
+/* Bytes expected per byte of batch_len besides the input block, reserved
+with the block before reading a batch */
+#ifndef BATCH_OUTPUT_FACTOR
+#define BATCH_OUTPUT_FACTOR 2
+#endif
+
+/* With --max-memory, batches are sized so that a batch takes about this
+long to go through at the throughput seen so far, within the memory limit */
+#ifndef BATCH_TARGET_SECONDS
+#define BATCH_TARGET_SECONDS 1.0
+#endif
+#ifndef MIN_ADAPTIVE_BATCH_LEN
+#define MIN_ADAPTIVE_BATCH_LEN (1024*1024)
+#endif
+/* Batches that fit in the memory limit at the same time: one being read and
+trimmed, and the ones waiting for or doing their output */
+#ifndef BATCHES_IN_MEMORY
+#define BATCHES_IN_MEMORY 3
+#endif
+
+uint64_t batch_memory(uint64_t block_bytes, uint64_t text_bytes, long lines);
+
+/* Bytes held by the batches in flight, for --max-memory. The reading
+thread reserves the memory of a batch before reading it, and waits while
+the batches in flight use too much; the output thread of the batch
+releases it when it is written. */
+class MemoryBudget{
+public:
+    MemoryBudget(uint64_t limit);
+    //Blocks until bytes more fit in the limit, or nothing else is held
+    void reserve(uint64_t bytes);
+    //Changes a reservation to the actual size of the batch, without blocking
+    void resize(uint64_t reserved, uint64_t bytes);
+    void release(uint64_t bytes);
+    uint64_t limit;
+private:
+    std::mutex lock;
+    std::condition_variable released;
+    uint64_t in_use;
+};
+
+/* Parses a size like 512M, 4G or 800000K; plain numbers are MB. Returns 0 if invalid. */
+uint64_t parse_memory_size(const char* text);
+
+#endif
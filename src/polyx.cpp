@@ -0,0 +1,72 @@
+#include <ctype.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "polyx.h"
+
+using namespace std;
+
+int homopolymer_tail_start(const char* seq, int len, char base, int max_mismatches){
+    int mismatches = 0;
+    int start = len;
+    int i = len;
+#if defined(__SSE2__)
+    __m128i run_base = _mm_set1_epi8(base);
+    while(i >= 16){
+        __m128i block = _mm_loadu_si128((const __m128i*)(seq + i - 16));
+        unsigned equal = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, run_base));
+        int block_mismatches = __builtin_popcount(~equal & 0xFFFF);
+        /* the run ends inside this block, find where one base at a time */
+        if(mismatches + block_mismatches > max_mismatches) break;
+        mismatches += block_mismatches;
+        i -= 16;
+        if(equal != 0) start = i + __builtin_ctz(equal);
+    }
+#endif
+    for(; i > 0; i--){
+        if(seq[i-1] == base){
+            start = i-1;
+        }else if(++mismatches > max_mismatches){
+            break;
+        }
+    }
+    return start;
+}
+
+PolyXMatcher::PolyXMatcher(int min_len, int max_mismatches){
+    this->min_len = min_len;
+    this->max_mismatches = max_mismatches;
+}
+
+void PolyXMatcher::add_bases(const char* new_bases){
+    for(size_t i = 0; i < strlen(new_bases); i++){
+        char base = toupper(new_bases[i]);
+        if(bases.find(base) == string::npos) bases.push_back(base);
+    }
+}
+
+bool PolyXMatcher::empty(){
+    return bases.empty();
+}
+
+const string& PolyXMatcher::tail_bases(){
+    return bases;
+}
+
+int PolyXMatcher::find(std::string_view seq){
+    /* a poly-A may come before a poly-G, so keep going while some tail is cut */
+    int end = seq.length();
+    bool found = true;
+    while(found && end > 0){
+        found = false;
+        for(size_t b = 0; b < bases.size(); b++){
+            int start = homopolymer_tail_start(seq.data(), end, bases[b], max_mismatches);
+            if(end - start >= min_len){
+                end = start;
+                found = true;
+            }
+        }
+    }
+    return end;
+}
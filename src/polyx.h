@@ -0,0 +1,38 @@
+#ifndef _POLYX_
+#define _POLYX_
+
+#include <string>
+#include <string_view>
+
+#ifndef DEFAULT_POLYX_MIN_LEN
+#define DEFAULT_POLYX_MIN_LEN 10
+#endif
+
+#ifndef DEFAULT_POLYX_MISMATCHES
+#define DEFAULT_POLYX_MISMATCHES 1
+#endif
+
+/* First base of the run of base at the end of seq, or len if there is none.
+The run is extended towards the 5' end, 16 bases at a time, until it has more
+than max_mismatches other bases. */
+int homopolymer_tail_start(const char* seq, int len, char base, int max_mismatches);
+
+/* Finds homopolymer tails (like the poly-G of two-colour chemistry, where
+no signal is read as a high quality G) at the 3' end of reads. */
+class PolyXMatcher{
+public:
+    PolyXMatcher(int min_len, int max_mismatches);
+    void add_bases(const char* bases);
+    bool empty();
+    //The bases added, in upper case
+    const std::string& tail_bases();
+    //Position where the tails start, or seq.length() if there are none
+    int find(std::string_view seq);
+
+    int min_len;
+    int max_mismatches;
+private:
+    std::string bases;
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "pool.h"
+
+using namespace std;
+
+BufferPool::BufferPool(bool hugepages){
+    this->hugepages = hugepages;
+}
+
+BufferPool::~BufferPool(){
+    for(size_t i = 0; i < free_blocks.size(); i++) deallocate(free_blocks[i]);
+}
+
+PoolBlock BufferPool::acquire(size_t bytes){
+    {
+        lock_guard<mutex> guard(lock);
+        int best = -1;
+        for(size_t i = 0; i < free_blocks.size(); i++){
+            if(free_blocks[i].capacity >= bytes && (best < 0 || free_blocks[i].capacity < free_blocks[best].capacity)){
+                best = i;
+            }
+        }
+        if(best >= 0){
+            PoolBlock block = free_blocks[best];
+            free_blocks.erase(free_blocks.begin() + best);
+            return block;
+        }
+    }
+    return allocate(bytes);
+}
+
+void BufferPool::release(PoolBlock block){
+    if(!block.data) return;
+    PoolBlock smallest = {NULL, 0, false};
+    {
+        lock_guard<mutex> guard(lock);
+        free_blocks.push_back(block);
+        if(free_blocks.size() > POOL_FREE_BLOCKS){
+            size_t index = 0;
+            for(size_t i = 1; i < free_blocks.size(); i++){
+                if(free_blocks[i].capacity < free_blocks[index].capacity) index = i;
+            }
+            smallest = free_blocks[index];
+            free_blocks.erase(free_blocks.begin() + index);
+        }
+    }
+    if(smallest.data) deallocate(smallest);
+}
+
+PoolBlock BufferPool::allocate(size_t bytes){
+    PoolBlock block = {NULL, bytes, false};
+    if(hugepages && bytes >= HUGE_PAGE_SIZE){
+        size_t capacity = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(data == MAP_FAILED){
+            //no huge pages reserved, transparent ones are the fallback
+            data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(data != MAP_FAILED) madvise(data, capacity, MADV_HUGEPAGE);
+        }
+        if(data != MAP_FAILED){
+            block.data = (char*)data;
+            block.capacity = capacity;
+            block.mapped = true;
+            return block;
+        }
+    }
+    block.data = (char*)malloc(bytes);
+    if(!block.data){
+        error("Could not allocate the memory of a batch");
+        exit(EXIT_FAILURE);
+    }
+    return block;
+}
+
+void BufferPool::deallocate(PoolBlock block){
+    if(block.mapped) munmap(block.data, block.capacity);
+    else free(block.data);
+}
+
+OutputBuffer::OutputBuffer(BufferPool* pool, size_t bytes){
+    this->pool = pool;
+    block = pool->acquire(bytes > 0 ? bytes : 1);
+    used = 0;
+    frame_start = -1;
+}
+
+OutputBuffer::~OutputBuffer(){
+    pool->release(block);
+}
+
+void OutputBuffer::grow(size_t bytes){
+    PoolBlock bigger = pool->acquire(max(bytes, block.capacity * 2));
+    memcpy(bigger.data, block.data, used);
+    pool->release(block);
+    block = bigger;
+}
+
+void OutputBuffer::append(string_view text){
+    if(used + text.length() > block.capacity) grow(used + text.length());
+    memcpy(block.data + used, text.data(), text.length());
+    used += text.length();
+}
+
+void OutputBuffer::append(char c){
+    if(used + 1 > block.capacity) grow(used + 1);
+    block.data[used++] = c;
+}
+
+char* OutputBuffer::extend(size_t bytes){
+    if(used + bytes > block.capacity) grow(used + bytes);
+    char* end = block.data + used;
+    used += bytes;
+    return end;
+}
+
+char* OutputBuffer::data(){
+    return block.data;
+}
+
+string_view OutputBuffer::content(){
+    return string_view(block.data, used);
+}
+
+size_t OutputBuffer::length(){
+    return used;
+}
+
+RecordArrays::~RecordArrays(){
+    for(size_t i = 0; i < queues.size(); i++){
+        delete(queues[i]);
+        delete[](filtered[i]);
+        delete[](cuts[i]);
+    }
+}
+
+void RecordArrays::reset(int threads){
+    while((int)queues.size() < threads){
+        queues.push_back(new vector<FQEntry*>());
+        filtered.push_back(NULL);
+        cuts.push_back(NULL);
+        capacity.push_back(0);
+    }
+    for(size_t i = 0; i < queues.size(); i++) queues[i]->clear();
+}
+
+void RecordArrays::fit(const vector<long> &last_index){
+    for(size_t i = 0; i < last_index.size(); i++){
+        size_t records = last_index[i] + 1;
+        if(records > capacity[i] || filtered[i] == NULL){
+            delete[](filtered[i]);
+            delete[](cuts[i]);
+            capacity[i] = records + records / 4;
+            filtered[i] = new bool[capacity[i]];
+            cuts[i] = new cutsites*[capacity[i]];
+        }
+        memset(filtered[i], false, sizeof(bool) * records);
+        memset(cuts[i], 0, sizeof(cutsites*) * records);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef _POOL_
+#define _POOL_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "sickle.h"
+
+class FQEntry;
+
+/* With --hugepages, blocks at least this big are mapped with huge pages
+(MAP_HUGETLB, or transparent huge pages through madvise when none are
+reserved), rounded up to whole huge pages */
+#ifndef HUGE_PAGE_SIZE
+#define HUGE_PAGE_SIZE (2*1024*1024)
+#endif
+
+/* Free blocks kept for the next batches; the smallest ones go back to the
+system beyond this */
+#ifndef POOL_FREE_BLOCKS
+#define POOL_FREE_BLOCKS 8
+#endif
+
+struct PoolBlock{
+    char* data;
+    size_t capacity;
+    bool mapped;
+};
+
+/* Large blocks for the input lines and the output of the batches, which
+live for the whole run: a block released by the output thread of a batch is
+handed to the reading thread of a later one instead of going back to the
+system, so big batches don't page fault their way through fresh memory. */
+class BufferPool{
+public:
+    BufferPool(bool hugepages = false);
+    ~BufferPool();
+    //Smallest free block of at least bytes, or a new one
+    PoolBlock acquire(size_t bytes);
+    void release(PoolBlock block);
+    bool hugepages;
+private:
+    PoolBlock allocate(size_t bytes);
+    void deallocate(PoolBlock block);
+    std::mutex lock;
+    std::vector<PoolBlock> free_blocks;
+};
+
+/* Output of a batch, appended in a pooled block that grows if needed */
+class OutputBuffer{
+public:
+    OutputBuffer(BufferPool* pool, size_t bytes);
+    ~OutputBuffer();
+    void append(std::string_view text);
+    void append(char c);
+    //bytes more at the end, to be written at the pointer before anything else is appended
+    char* extend(size_t bytes);
+    char* data();
+    std::string_view content();
+    size_t length();
+    //with --binary, where the last block of records starts, or -1 before the first one
+    long frame_start;
+private:
+    void grow(size_t bytes);
+    BufferPool* pool;
+    PoolBlock block;
+    size_t used;
+};
+
+/* Objects given back by the batches written for the next ones */
+template<typename T> class RecyclePool{
+public:
+    ~RecyclePool(){
+        for(T* item: items) delete(item);
+    }
+    T* get(){
+        std::lock_guard<std::mutex> guard(lock);
+        if(items.empty()) return new T();
+        T* item = items.back();
+        items.pop_back();
+        return item;
+    }
+    void put(T* item){
+        std::lock_guard<std::mutex> guard(lock);
+        items.push_back(item);
+    }
+private:
+    std::mutex lock;
+    std::vector<T*> items;
+};
+
+/* The record queues of the processing threads in a batch (of one mate),
+with their filtered flags and cutsites. They are recycled whole, so the
+arrays keep their capacity from batch to batch. */
+class RecordArrays{
+public:
+    ~RecordArrays();
+    //Empty queues for threads processing threads
+    void reset(int threads);
+    //Sizes the filtered flags, all false, and the cutsites, all NULL until trimmed, to the records of each queue
+    void fit(const std::vector<long> &last_index);
+    std::vector<std::vector<FQEntry*>* > queues;
+    std::vector<bool*> filtered;
+    std::vector<cutsites**> cuts;
+private:
+    std::vector<size_t> capacity;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <experimental/filesystem>
+#include "progress.h"
+
+using namespace std;
+
+ProgressReporter::ProgressReporter(int interval, bool print): reads(0), kept(0), discarded(0){
+    this->interval = interval;
+    this->print = print;
+    input_size = 0;
+    to_terminal = isatty(fileno(stderr));
+    stopping = false;
+}
+
+ProgressReporter::~ProgressReporter(){
+    stop();
+}
+
+void ProgressReporter::add_input(GZReader* reader){
+    //snapshot can be reading them from another thread
+    lock_guard<mutex> guard(lock);
+    readers.push_back(reader);
+    input_size += ::input_size(reader->path);
+}
+
+void ProgressReporter::start(){
+    start_time = stats_now();
+    if(print) thread = std::thread(&ProgressReporter::run, this);
+}
+
+void ProgressReporter::stop(){
+    if(!thread.joinable()) return;
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+    report(true);
+}
+
+void ProgressReporter::add(uint64_t reads, uint64_t kept, uint64_t discarded){
+    this->reads.fetch_add(reads, memory_order_relaxed);
+    this->kept.fetch_add(kept, memory_order_relaxed);
+    this->discarded.fetch_add(discarded, memory_order_relaxed);
+}
+
+void ProgressReporter::snapshot(uint64_t &reads, uint64_t &kept, uint64_t &discarded, double &done){
+    reads = this->reads.load(memory_order_relaxed);
+    kept = this->kept.load(memory_order_relaxed);
+    discarded = this->discarded.load(memory_order_relaxed);
+    lock_guard<mutex> guard(lock);
+    uint64_t consumed = 0;
+    for(size_t i = 0; i < readers.size(); i++) consumed += readers[i]->consumed_bytes.load(memory_order_relaxed);
+    done = input_size > 0 ? min(1.0, (double)consumed / input_size) : 0;
+}
+
+void ProgressReporter::run(){
+    unique_lock<mutex> guard(lock);
+    while(!wake.wait_for(guard, chrono::seconds(interval), [this]{ return stopping; })){
+        report(false);
+    }
+}
+
+void ProgressReporter::report(bool last){
+    double elapsed = seconds_between(start_time, stats_now());
+    uint64_t n_reads = reads.load(memory_order_relaxed);
+    uint64_t n_kept = kept.load(memory_order_relaxed);
+    uint64_t n_discarded = discarded.load(memory_order_relaxed);
+    uint64_t consumed = 0;
+    for(size_t i = 0; i < readers.size(); i++) consumed += readers[i]->consumed_bytes.load(memory_order_relaxed);
+    uint64_t decided = n_kept + n_discarded;
+
+    char eta[32] = "-";
+    double done = 0;
+    if(input_size > 0){
+        done = min(1.0, (double)consumed / input_size);
+        if(consumed > 0 && !last){
+            long seconds = (long)((input_size - min(consumed, input_size)) * elapsed / consumed);
+            snprintf(eta, sizeof(eta), "%ld:%02ld:%02ld", seconds / 3600, (seconds / 60) % 60, seconds % 60);
+        }
+    }
+    //on a terminal the line is rewritten, in a log each report gets its own line
+    fprintf(stderr, "%sProgress: %lu reads, %.0f reads/s, %.1f MB/s input, kept %.1f%%, discarded %.1f%%, %.1f%% done, ETA %s%s",
+        to_terminal ? "\r" : "",
+        (unsigned long)n_reads, elapsed > 0 ? n_reads / elapsed : 0, elapsed > 0 ? consumed / elapsed / (1024*1024) : 0,
+        decided ? 100.0 * n_kept / decided : 0, decided ? 100.0 * n_discarded / decided : 0,
+        100.0 * (last ? 1.0 : done), eta,
+        to_terminal ? (last ? "\033[K\n" : "\033[K") : "\n");
+    fflush(stderr);
+}
@@ -0,0 +1,54 @@
+#ifndef _PROGRESS_
+#define _PROGRESS_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "GZReader.h"
+#include "stats.h"
+
+/* Seconds between progress lines */
+#ifndef PROGRESS_INTERVAL
+#define PROGRESS_INTERVAL 5
+#endif
+
+/* Thread that prints the rate, kept and discarded reads and ETA of a run on
+stderr, for --progress. The processing threads add their counts once per
+batch, and the readers publish how much of the (compressed) input they have
+consumed, so reporting never blocks the pipeline. A reporter that doesn't
+print only counts, for sickle serve to stream the progress of its jobs. */
+class ProgressReporter{
+public:
+    ProgressReporter(int interval, bool print = true);
+    ~ProgressReporter();
+    void add_input(GZReader* reader);
+    void start();
+    //Prints the last line and joins the thread
+    void stop();
+    void add(uint64_t reads, uint64_t kept, uint64_t discarded);
+    //Counts so far, and the fraction of the input consumed (0 while its size is unknown)
+    void snapshot(uint64_t &reads, uint64_t &kept, uint64_t &discarded, double &done);
+private:
+    void run();
+    void report(bool last);
+
+    int interval;
+    std::vector<GZReader*> readers;
+    uint64_t input_size;
+    std::atomic<uint64_t> reads;
+    std::atomic<uint64_t> kept;
+    std::atomic<uint64_t> discarded;
+    timepoint start_time;
+    bool to_terminal;
+    bool print;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+};
+
+#endif
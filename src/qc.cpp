@@ -0,0 +1,165 @@
+#include <string.h>
+#include <algorithm>
+#include "qc.h"
+
+using namespace std;
+
+#define QUAL_BINS (QC_MAX_QUAL+1)
+
+static const char base_names[5] = {'A', 'C', 'G', 'T', 'N'};
+
+struct BaseIndex{
+    unsigned char index[256];
+    BaseIndex(){
+        memset(index, 4, sizeof(index));
+        index['A'] = index['a'] = 0;
+        index['C'] = index['c'] = 1;
+        index['G'] = index['g'] = 2;
+        index['T'] = index['t'] = 3;
+    }
+};
+static const BaseIndex base_index;
+
+#define GROUPS_PER_RANGE (QC_EXACT_POSITIONS/2)
+
+/* Group of a position, and the first position of a group */
+static size_t position_group(size_t pos){
+    if(pos < QC_EXACT_POSITIONS) return pos;
+    //range r has positions [QC_EXACT_POSITIONS << r, QC_EXACT_POSITIONS << (r+1)) in groups of 2 << r
+    int range = 63 - __builtin_clzll(pos / QC_EXACT_POSITIONS);
+    return QC_EXACT_POSITIONS + range * GROUPS_PER_RANGE + ((pos - ((size_t)QC_EXACT_POSITIONS << range)) >> (range + 1));
+}
+
+static size_t group_start(size_t group){
+    if(group < QC_EXACT_POSITIONS) return group;
+    size_t range = (group - QC_EXACT_POSITIONS) / GROUPS_PER_RANGE;
+    size_t index = (group - QC_EXACT_POSITIONS) % GROUPS_PER_RANGE;
+    return ((size_t)QC_EXACT_POSITIONS << range) + (index << (range + 1));
+}
+
+QCStats::QCStats(){
+    reads = 0;
+    bases = 0;
+}
+
+void QCStats::grow(size_t len){
+    size_t groups = len ? position_group(len - 1) + 1 : 0;
+    if(base_counts.size() < groups*5){
+        qual_counts.resize(groups*QUAL_BINS, 0);
+        base_counts.resize(groups*5, 0);
+    }
+}
+
+void QCStats::add(std::string_view seq, std::string_view qual, int qual_offset){
+    size_t len = seq.length();
+    if(len < QC_EXACT_LENGTHS){
+        if(lengths.size() <= len) lengths.resize(len+1, 0);
+        lengths[len]++;
+    }else{
+        long_lengths[len]++;
+    }
+    reads++;
+    bases += len;
+    grow(len);
+
+    uint64_t* quals = qual_counts.data();
+    uint64_t* base_count = base_counts.data();
+    const unsigned char* seq_chars = (const unsigned char*)seq.data();
+    const unsigned char* qual_chars = (const unsigned char*)qual.data();
+    //the positions of each group, one by one at first
+    size_t i = 0;
+    for(size_t group = 0; i < len; group++){
+        size_t end = group < QC_EXACT_POSITIONS ? group + 1 : std::min(len, group_start(group + 1));
+        for(; i < end; i++){
+            int q = qual_chars[i] - qual_offset;
+            if(q < 0) q = 0;
+            else if(q > QC_MAX_QUAL) q = QC_MAX_QUAL;
+            quals[group*QUAL_BINS + q]++;
+            base_count[group*5 + base_index.index[seq_chars[i]]]++;
+        }
+    }
+}
+
+void QCStats::merge(const QCStats &other){
+    reads += other.reads;
+    bases += other.bases;
+    size_t groups = other.base_counts.size() / 5;
+    grow(groups ? group_start(groups - 1) + 1 : 0);
+    for(size_t i = 0; i < other.qual_counts.size(); i++) qual_counts[i] += other.qual_counts[i];
+    for(size_t i = 0; i < other.base_counts.size(); i++) base_counts[i] += other.base_counts[i];
+    if(lengths.size() < other.lengths.size()) lengths.resize(other.lengths.size(), 0);
+    for(size_t i = 0; i < other.lengths.size(); i++) lengths[i] += other.lengths[i];
+    for(auto &length: other.long_lengths) long_lengths[length.first] += length.second;
+}
+
+void QCStats::write_json(std::ostream &out, const char* indent){
+    size_t positions = base_counts.size() / 5;
+    int max_qual = 0;
+    for(size_t i = 0; i < qual_counts.size(); i++){
+        if(qual_counts[i] > 0 && (int)(i % QUAL_BINS) > max_qual) max_qual = i % QUAL_BINS;
+    }
+
+    out << "{\n";
+    out << indent << "  \"reads\": " << reads << ",\n";
+    out << indent << "  \"bases\": " << bases << ",\n";
+
+    out << indent << "  \"length_distribution\": [";
+    bool first = true;
+    for(size_t len = 0; len < lengths.size(); len++){
+        if(lengths[len] == 0) continue;
+        out << (first ? "" : ", ") << "[" << len << ", " << lengths[len] << "]";
+        first = false;
+    }
+    for(auto &length: long_lengths){
+        out << (first ? "" : ", ") << "[" << length.first << ", " << length.second << "]";
+        first = false;
+    }
+    out << "],\n";
+
+    //first and last base (from 1) of each group of the per position counts
+    out << indent << "  \"positions\": [";
+    for(size_t pos = 0; pos < positions; pos++){
+        out << (pos ? ", " : "") << "[" << group_start(pos) + 1 << ", " << group_start(pos + 1) << "]";
+    }
+    out << "],\n";
+
+    out << indent << "  \"mean_quality\": [";
+    for(size_t pos = 0; pos < positions; pos++){
+        uint64_t total = 0, sum = 0;
+        for(int q = 0; q < QUAL_BINS; q++){
+            total += qual_counts[pos*QUAL_BINS + q];
+            sum += q * qual_counts[pos*QUAL_BINS + q];
+        }
+        out << (pos ? ", " : "") << (total ? (double)sum / total : 0.0);
+    }
+    out << "],\n";
+
+    out << indent << "  \"quality_counts\": [";
+    for(size_t pos = 0; pos < positions; pos++){
+        out << (pos ? ",\n" : "\n") << indent << "    [";
+        for(int q = 0; q <= max_qual; q++){
+            out << (q ? ", " : "") << qual_counts[pos*QUAL_BINS + q];
+        }
+        out << "]";
+    }
+    out << "\n" << indent << "  ],\n";
+
+    out << indent << "  \"base_content\": {";
+    for(int b = 0; b < 5; b++){
+        out << (b ? ",\n" : "\n") << indent << "    \"" << base_names[b] << "\": [";
+        for(size_t pos = 0; pos < positions; pos++){
+            out << (pos ? ", " : "") << base_counts[pos*5 + b];
+        }
+        out << "]";
+    }
+    out << "\n" << indent << "  },\n";
+
+    out << indent << "  \"n_content\": [";
+    for(size_t pos = 0; pos < positions; pos++){
+        uint64_t total = 0;
+        for(int b = 0; b < 5; b++) total += base_counts[pos*5 + b];
+        out << (pos ? ", " : "") << (total ? (double)base_counts[pos*5 + 4] / total : 0.0);
+    }
+    out << "]\n";
+    out << indent << "}";
+}
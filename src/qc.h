@@ -0,0 +1,57 @@
+#ifndef _QC_
+#define _QC_
+
+#include <string_view>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <cstdint>
+
+/* Biggest quality value counted apart, the ones above it are added to it */
+#ifndef QC_MAX_QUAL
+#define QC_MAX_QUAL 93
+#endif
+
+/* Positions counted one by one. Past them, as FastQC does, positions are
+grouped: QC_EXACT_POSITIONS/2 groups of 2 bases up to twice QC_EXACT_POSITIONS,
+then as many of 4 bases up to 4 times, and so on, so a read of megabases
+needs a few thousand groups rather than a count per base. */
+#ifndef QC_EXACT_POSITIONS
+#define QC_EXACT_POSITIONS 512
+#endif
+
+/* Read lengths counted in an array, longer ones in a map */
+#ifndef QC_EXACT_LENGTHS
+#define QC_EXACT_LENGTHS 65536
+#endif
+
+/* Read statistics in the spirit of FastQC: quality and base composition per
+position (or group of positions) and the length distribution. Each processing
+thread fills its own instance, which are merged when the run finishes. */
+class QCStats{
+public:
+    QCStats();
+    void add(std::string_view seq, std::string_view qual, int qual_offset);
+    void merge(const QCStats &other);
+    void write_json(std::ostream &out, const char* indent);
+
+    uint64_t reads;
+    uint64_t bases;
+private:
+    //groups of the positions of a read of len bases
+    void grow(size_t len);
+    //QC_MAX_QUAL+1 counts per group of positions
+    std::vector<uint64_t> qual_counts;
+    //A, C, G, T and N counts per group of positions
+    std::vector<uint64_t> base_counts;
+    std::vector<uint64_t> lengths;
+    std::map<size_t, uint64_t> long_lengths;
+};
+
+/* Statistics of one input stream (se reads or one of the pe mates) */
+struct QCReport{
+    QCStats before;
+    QCStats after;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "sickle.h"
+#include "qualbin.h"
+
+QualityBinner::QualityBinner(){
+    for(int q = 0; q <= QUAL_BIN_MAX_SCORE; q++) bins[q] = -1;
+    for(int c = 0; c < 256; c++) table[c] = c;
+    steps = 0;
+    first = last = 0;
+}
+
+bool QualityBinner::parse(const char* spec){
+    std::string map;
+    if(strcmp(spec, "illumina8") == 0) map = QUAL_BIN_ILLUMINA8;
+    else if(strncmp(spec, "custom:", 7) == 0) map = spec + 7;
+    else return false;
+    //ranges as from-to=bin or score=bin, separated by commas
+    size_t start = 0;
+    while(start < map.length()){
+        size_t comma = map.find(',', start);
+        if(comma == std::string::npos) comma = map.length();
+        std::string range = map.substr(start, comma - start);
+        start = comma + 1;
+        int from, to, bin, used = 0;
+        if(sscanf(range.c_str(), "%d-%d=%d%n", &from, &to, &bin, &used) != 3 || used != (int)range.length()){
+            used = 0;
+            if(sscanf(range.c_str(), "%d=%d%n", &from, &bin, &used) != 2 || used != (int)range.length()) return false;
+            to = from;
+        }
+        if(from < 0 || from > to || to > QUAL_BIN_MAX_SCORE || bin < 0 || bin > QUAL_BIN_MAX_SCORE) return false;
+        for(int q = from; q <= to; q++) bins[q] = bin;
+    }
+    return !map.empty();
+}
+
+void QualityBinner::build(int qualtype){
+    int offset = quality_constants[qualtype][Q_OFFSET];
+    for(int c = 0; c < 256; c++) table[c] = c;
+    for(int q = 0; q <= QUAL_BIN_MAX_SCORE && offset + q < 256; q++){
+        if(bins[q] >= 0) table[offset + q] = offset + bins[q];
+    }
+
+    //the chars that change, from first to last, as steps of the same bin if there are few
+    steps = 0;
+    int low = 0, high = 255;
+    while(low < 256 && table[low] == low) low++;
+    while(high >= 0 && table[high] == high) high--;
+    if(low < 1 || high > 254 || low > high) return;
+    int found = 0;
+    for(int c = low; c <= high; c++){
+        if(c > low && table[c] == table[c-1]) continue;
+        //a score kept as it is in the middle of the map, or too many bins
+        if(found == QUAL_BIN_MAX_STEPS || (c - offset >= 0 && bins[c - offset] < 0)) return;
+        step_chars[found] = c;
+        step_values[found] = table[c];
+        found++;
+    }
+    first = low;
+    last = high;
+    steps = found;
+}
+
+void QualityBinner::apply(char* qual, size_t len) const{
+    size_t i = 0;
+#if defined(__SSE2__)
+    if(steps > 0){
+        /* bytes are compared as signed, so they are flipped around 0x80 first;
+        each step from its char on adds the difference to the bin before */
+        const __m128i flip = _mm_set1_epi8((char)0x80);
+        const __m128i below_first = _mm_set1_epi8((char)((first - 1) ^ 0x80));
+        const __m128i above_last = _mm_set1_epi8((char)((last + 1) ^ 0x80));
+        const __m128i base = _mm_set1_epi8((char)step_values[0]);
+        for(; i + 16 <= len; i += 16){
+            __m128i chars = _mm_loadu_si128((const __m128i*)(qual + i));
+            __m128i flipped = _mm_xor_si128(chars, flip);
+            __m128i binned = base;
+            for(int s = 1; s < steps; s++){
+                __m128i from = _mm_cmpgt_epi8(flipped, _mm_set1_epi8((char)((step_chars[s] - 1) ^ 0x80)));
+                binned = _mm_add_epi8(binned, _mm_and_si128(from, _mm_set1_epi8((char)(step_values[s] - step_values[s-1]))));
+            }
+            __m128i mapped = _mm_and_si128(_mm_cmpgt_epi8(flipped, below_first), _mm_cmpgt_epi8(above_last, flipped));
+            chars = _mm_or_si128(_mm_and_si128(mapped, binned), _mm_andnot_si128(mapped, chars));
+            _mm_storeu_si128((__m128i*)(qual + i), chars);
+        }
+    }
+#endif
+    for(; i < len; i++) qual[i] = table[(unsigned char)qual[i]];
+}
@@ -0,0 +1,42 @@
+#ifndef _QUALBIN_
+#define _QUALBIN_
+
+#include <stddef.h>
+
+/* Highest quality score of the maps, that of '~' in sanger */
+#define QUAL_BIN_MAX_SCORE 93
+
+/* The 8 levels of Illumina's binning, as a custom map */
+#define QUAL_BIN_ILLUMINA8 "2-9=6,10-19=15,20-24=22,25-29=27,30-34=33,35-39=37,40-93=40"
+
+/* Steps of a map done with SSE2 compares, more go through the table */
+#ifndef QUAL_BIN_MAX_STEPS
+#define QUAL_BIN_MAX_STEPS 16
+#endif
+
+/* --qual-bin: rewrites the quality chars of the kept reads, as they are
+formatted, through a table of all 256 chars. The reads are trimmed and
+filtered with their own qualities before. */
+class QualityBinner{
+public:
+    QualityBinner();
+    //illumina8, or custom: and ranges of scores with their bin, as custom:0-9=5,10-29=20,30-93=35; false if it is neither
+    bool parse(const char* spec);
+    //the table for the chars of qualtype; scores out of the map keep their char
+    void build(int qualtype);
+    //bins the len chars at qual in place
+    void apply(char* qual, size_t len) const;
+private:
+    //bin of each score, or -1 to keep it
+    int bins[QUAL_BIN_MAX_SCORE + 1];
+    unsigned char table[256];
+    /* the chars from first to last as steps: step_values[0] from first on,
+    and step_values[i] from step_chars[i] on; steps is 0 if the map has
+    more than QUAL_BIN_MAX_STEPS, or gaps */
+    int steps;
+    unsigned char first, last;
+    unsigned char step_chars[QUAL_BIN_MAX_STEPS];
+    unsigned char step_values[QUAL_BIN_MAX_STEPS];
+};
+
+#endif
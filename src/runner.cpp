@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <algorithm>
+#include "runner.h"
+#include "trim_single.h"
+#include "trim_paired.h"
+
+using namespace std;
+
+const char* const job_file_options[] = {
+    "-f", "-r", "-c", "-o", "-p", "-m", "-M", "-s",
+    "--fastq-file", "--output-file", "--pe-file1", "--pe-file2", "--pe-interleaved",
+    "--output-pe1", "--output-pe2", "--output-single", "--output-interleaved", NULL
+};
+
+const char* const job_report_options[] = {"--qc-json", "--stats-json", NULL};
+
+/* the jobs print nothing, and the memory and buffers are those of the runner */
+const char* const job_process_options[] = {
+    "--trace", "--progress", "--max-memory", "--hugepages", "--help", "--version", NULL
+};
+
+const char* const job_checkpoint_options[] = {"--checkpoint", "--checkpoint-interval", "--resume", NULL};
+
+bool in_option_list(const char* const* list, const string &name){
+    for(int i = 0; list[i]; i++) if(name == list[i]) return true;
+    return false;
+}
+
+string job_option_name(const string &type, const string &name){
+    if(name.length() <= 2 || name.compare(0, 2, "--") != 0) return name;
+    const struct option* options = type == "se" ? single_long_options : paired_long_options;
+    string prefix = name.substr(2);
+    const char* found = NULL;
+    for(int i = 0; options[i].name; i++){
+        if(prefix == options[i].name) return name;
+        if(strncmp(options[i].name, prefix.c_str(), prefix.length()) == 0){
+            //getopt rejects a prefix of more than one
+            if(found) return name;
+            found = options[i].name;
+        }
+    }
+    return found ? string("--") + found : name;
+}
+
+bool job_option_in_list(const char* const* list, const string &name){
+    return in_option_list(list, job_option_name("se", name)) || in_option_list(list, job_option_name("pe", name));
+}
+
+JobRunner::JobRunner(const char* jobs_option, int default_jobs){
+    this->jobs_option = jobs_option;
+    jobs = default_jobs;
+    total_threads = DEFAULT_THREADS;
+    hugepages = 0;
+    pool = NULL;
+    budget = NULL;
+    workers = NULL;
+}
+
+JobRunner::~JobRunner(){
+    delete(workers);
+    delete(pool);
+    delete(budget);
+}
+
+int JobRunner::parse_arg(int argc, char *argv[], int &i){
+    string arg = argv[i];
+    if(arg == "--hugepages"){
+        hugepages = 1;
+        return 0;
+    }
+    string name = arg.substr(0, arg.find('='));
+    if(name != jobs_option && name != "--threads" && name != "-a" && name != "--max-memory") return -1;
+    const char* value;
+    if(name.length() < arg.length()){
+        value = argv[i] + name.length() + 1;
+    }else if(i + 1 < argc){
+        value = argv[++i];
+    }else{
+        fprintf(stderr, "****Error: %s needs a value.\n\n", name.c_str());
+        return EXIT_FAILURE;
+    }
+    if(name == jobs_option){
+        jobs = atoi(value);
+        if(jobs < 1){
+            fprintf(stderr, "****Error: %s must be at least 1.\n\n", jobs_option);
+            return EXIT_FAILURE;
+        }
+    }else if(name == "--max-memory"){
+        if(parse_memory_size(value) == 0){
+            fprintf(stderr, "****Error: Invalid --max-memory '%s', use a size like 512M or 4G.\n\n", value);
+            return EXIT_FAILURE;
+        }
+        max_memory = value;
+    }else{
+        total_threads = atoi(value);
+        if(total_threads < 1){
+            fprintf(stderr, "****Error: -a must be at least 1.\n\n");
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
+
+void JobRunner::start(){
+    pool = new BufferPool(hugepages);
+    if(!max_memory.empty()) budget = new MemoryBudget(parse_memory_size(max_memory.c_str()));
+    workers = new WorkerPool(jobs * (job_threads() + 1));
+}
+
+int JobRunner::job_threads(){
+    return max(1, total_threads / jobs);
+}
+
+Abstract_Trimmer* JobRunner::prepare_job(const string &type, const vector<string> &options){
+    Abstract_Trimmer* trimmer;
+    if(type == "se") trimmer = new Trim_Single();
+    else trimmer = new Trim_Paired();
+    trimmer->throw_on_usage();
+
+    vector<string> args;
+    args.push_back(PROGRAM_NAME);
+    args.push_back(type);
+    args.insert(args.end(), options.begin(), options.end());
+    args.push_back("-a");
+    args.push_back(to_string(job_threads()));
+    //each job sizes its batches for its share of the budget
+    if(!max_memory.empty()){
+        args.push_back("--max-memory");
+        args.push_back(max_memory);
+    }
+    args.push_back("--quiet");
+    vector<char*> argv;
+    for(size_t i = 0; i < args.size(); i++) argv.push_back((char*)args[i].c_str());
+    argv.push_back(NULL);
+
+    int res;
+    {
+        lock_guard<mutex> guard(parse_lock);
+        //getopt starts over for each job
+        optind = 0;
+        try{
+            res = trimmer->parse_args(argv.size() - 1, argv.data());
+        }catch(UsageError &){
+            res = EXIT_FAILURE;
+        }
+    }
+    if(res != 0){
+        delete(trimmer);
+        return NULL;
+    }
+    trimmer->share(pool, budget, workers, jobs);
+    return trimmer;
+}
+
+JobResult JobRunner::run_job(Abstract_Trimmer* trimmer){
+    JobResult result;
+    timepoint start = stats_now();
+    try{
+        result.status = trimmer->trim_main();
+    }catch(UsageError &){
+        //pe finds some conflicting options when opening the files
+        result.status = EXIT_FAILURE;
+    }catch(TrimError &error){
+        //a bad record or output fails its job, not the others
+        result.status = error.status;
+    }
+    result.seconds = seconds_between(start, stats_now());
+    trimmer->counts(result.records, result.kept, result.discarded);
+    return result;
+}
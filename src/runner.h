@@ -0,0 +1,73 @@
+#ifndef _RUNNER_
+#define _RUNNER_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "trim.h"
+
+/* Options of se and pe naming the input and output files of a run */
+extern const char* const job_file_options[];
+/* Options of se and pe writing a report of the whole run */
+extern const char* const job_report_options[];
+/* Options of se and pe that belong to the process running the jobs */
+extern const char* const job_process_options[];
+extern const char* const job_checkpoint_options[];
+
+//Whether name is in list, which ends with NULL
+bool in_option_list(const char* const* list, const std::string &name);
+/* The whole name of the long option of se or pe (by type) that name is
+for: getopt takes any unique prefix of one, as --prog for --progress, so
+the lists are checked with the whole name. Other names are kept as they are. */
+std::string job_option_name(const std::string &type, const std::string &name);
+//Whether name is in list as an option of se or of pe, for the runners with jobs of both
+bool job_option_in_list(const char* const* list, const std::string &name);
+
+/* A job once it is done */
+struct JobResult{
+    int status;
+    long records, kept, discarded;
+    double seconds;
+};
+
+/* What sickle serve, batch and watch share to trim many se and pe jobs in
+one process: a few jobs at once, splitting the threads between them, with
+the batch buffers and the --max-memory budget of all of them. The worker
+threads are started once for all the jobs, which take turns on them. */
+class JobRunner{
+public:
+    //jobs_option is the name of the option of the jobs at once, as --jobs
+    JobRunner(const char* jobs_option, int default_jobs);
+    ~JobRunner();
+    /* Takes the option at argv[i], and its value, if it is one of the
+    runner: -a/--threads, jobs_option, --max-memory or --hugepages. Returns 0
+    if it was, -1 if it is not one of them, or EXIT_FAILURE. */
+    int parse_arg(int argc, char *argv[], int &i);
+    //The buffers, the budget and the workers of the jobs, once the options are parsed
+    void start();
+    //Threads of each job
+    int job_threads();
+    /* A trimmer for se or pe with the options of a job, which get the threads
+    of the job, --max-memory and --quiet. NULL if they are not valid, with the
+    reason printed by the trimmer. */
+    Abstract_Trimmer* prepare_job(const std::string &type, const std::vector<std::string> &options);
+    /* Runs a trimmer of prepare_job; it fails on its own if its options or its
+    records are wrong. The caller deletes the trimmer, which closes its outputs. */
+    JobResult run_job(Abstract_Trimmer* trimmer);
+
+    int jobs;
+    int total_threads;
+private:
+    const char* jobs_option;
+    //as given, for the jobs to size their batches
+    std::string max_memory;
+    int hugepages;
+    BufferPool* pool;
+    MemoryBudget* budget;
+    //the parts of every job at once, and the batch each one writes
+    WorkerPool* workers;
+    //getopt is global, so the jobs are parsed one at a time
+    std::mutex parse_lock;
+};
+
+#endif
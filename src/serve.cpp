@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <algorithm>
+#include "serve.h"
+
+using namespace std;
+
+static volatile sig_atomic_t serve_signalled = 0;
+
+static void serve_signal(int){
+    serve_signalled = 1;
+}
+
+/* Options with a file, made absolute with the directory of the client */
+static bool file_option(const string &name){
+    return in_option_list(job_file_options, name) || in_option_list(job_report_options, name)
+        || name == "--checkpoint" || name == "--follow-sentinel";
+}
+
+/* Each file of a comma separated list, relative to dir unless it is absolute */
+static string absolute_paths(const string &dir, const string &paths){
+    if(dir.empty()) return paths;
+    string absolute;
+    size_t start = 0;
+    while(true){
+        size_t end = paths.find(',', start);
+        string path = paths.substr(start, end == string::npos ? string::npos : end - start);
+        if(!path.empty() && path[0] != '/') path = dir + "/" + path;
+        absolute += path;
+        if(end == string::npos) return absolute;
+        absolute += ",";
+        start = end + 1;
+    }
+}
+
+static int socket_address(const char* path, struct sockaddr_un &addr){
+    if(strlen(path) >= sizeof(addr.sun_path)){
+        fprintf(stderr, "****Error: Socket path '%s' is too long.\n\n", path);
+        return EXIT_FAILURE;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    return 0;
+}
+
+static bool send_all(int fd, const string &text){
+    size_t sent = 0;
+    while(sent < text.length()){
+        ssize_t n = send(fd, text.data() + sent, text.length() - sent, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+TrimServer::TrimServer() : runner("--jobs", DEFAULT_JOBS_IN_FLIGHT){
+    socket_fn = NULL;
+    quiet = 0;
+    listen_fd = -1;
+    next_id = 0;
+    stopping = false;
+}
+
+TrimServer::~TrimServer(){
+    free(socket_fn);
+}
+
+void TrimServer::usage(int status, char const *msg){
+    fprintf(stderr, "\nUsage: %s serve --socket <socket path> [--jobs N] [-a threads] [--max-memory size] [options]\n\
+\n\
+Options:\n\
+--socket, Unix socket to listen on, only open to the user running the server (required).\n\
+--jobs, Jobs trimmed at once, sharing the threads and batch buffers. Default %d.\n\
+-a, --threads, Threads of all the jobs trimmed at once. Default %d.\n\
+--max-memory, Memory limit of the batches of all the jobs, as for se and pe.\n\
+--hugepages, Back the batch buffers with transparent huge pages.\n\
+--quiet, Don't print each job as it finishes.\n\
+--help, display this help and exit\n\
+\n\
+Jobs are sent with %s submit --socket <socket path> se|pe <options>, and run with the options\n\
+of se and pe except -a, --trace, --progress, --max-memory and --hugepages. The server stops\n\
+on SIGINT, SIGTERM or %s submit --socket <socket path> --shutdown, after its running jobs.\n\n",
+        PROGRAM_NAME, DEFAULT_JOBS_IN_FLIGHT, DEFAULT_THREADS, PROGRAM_NAME, PROGRAM_NAME);
+
+    if (msg) fprintf(stderr, "%s\n\n", msg);
+    exit(status);
+}
+
+int TrimServer::parse_args(int argc, char *argv[]){
+    for(int i = 2; i < argc; i++){
+        int res = runner.parse_arg(argc, argv, i);
+        if(res == 0) continue;
+        if(res != -1) return res;
+        string arg = argv[i];
+        string name = arg.substr(0, arg.find('='));
+        if(name == "--socket"){
+            const char* value;
+            if(name.length() < arg.length()){
+                value = argv[i] + name.length() + 1;
+            }else if(i + 1 < argc){
+                value = argv[++i];
+            }else{
+                fprintf(stderr, "****Error: %s needs a value.\n\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+            free(socket_fn);
+            socket_fn = strdup(value);
+        }else if(arg == "--help"){
+            usage(EXIT_SUCCESS, NULL);
+        }else if(arg == "--quiet"){
+            quiet = 1;
+        }else{
+            fprintf(stderr, "****Error: Unknown option '%s' of serve, the trimming options are given with each job.\n\n", arg.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(!socket_fn){
+        usage(EXIT_FAILURE, "****Error: Must have a socket.");
+    }
+    return 0;
+}
+
+int TrimServer::open_socket(){
+    struct sockaddr_un addr;
+    if(socket_address(socket_fn, addr) != 0) return EXIT_FAILURE;
+
+    //a socket left by a server that is gone is replaced, one that answers isn't
+    struct stat st;
+    if(stat(socket_fn, &st) == 0){
+        if(!S_ISSOCK(st.st_mode)){
+            fprintf(stderr, "****Error: '%s' exists and is not a socket.\n\n", socket_fn);
+            return EXIT_FAILURE;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool answered = probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        if(probe >= 0) close(probe);
+        if(answered){
+            fprintf(stderr, "****Error: A server is already listening on '%s'.\n\n", socket_fn);
+            return EXIT_FAILURE;
+        }
+        unlink(socket_fn);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    //the socket is private to the user from the start, no one else can connect before a chmod
+    mode_t mask = umask(0077);
+    int bound = listen_fd < 0 ? -1 : bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if(bound != 0){
+        fprintf(stderr, "****Error: Could not create socket '%s': %s.\n\n", socket_fn, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if(listen(listen_fd, SOMAXCONN) != 0){
+        fprintf(stderr, "****Error: Could not listen on socket '%s': %s.\n\n", socket_fn, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+void TrimServer::send_line(ServeClient* client, const string &line){
+    lock_guard<mutex> guard(client->write_lock);
+    //a client that went away still gets its jobs done
+    send_all(client->fd, line + "\n");
+}
+
+void TrimServer::serve_client(ServeClient* client){
+    string buffer;
+    char chunk[4096];
+    ssize_t n;
+    while((n = read(client->fd, chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR)){
+        if(n < 0) continue;
+        buffer.append(chunk, n);
+        size_t end;
+        while((end = buffer.find('\n')) != string::npos){
+            string line = buffer.substr(0, end);
+            buffer.erase(0, end + 1);
+            if(!line.empty() && line.back() == '\r') line.pop_back();
+            if(line.empty()) continue;
+            if(line == "shutdown"){
+                send_line(client, "stopping");
+                stop();
+            }else if(line.compare(0, 4, "job\t") == 0){
+                submit_job(client, line);
+            }else{
+                send_line(client, "error\tunknown request, expected job or shutdown");
+            }
+        }
+    }
+
+    //the connection stays open until the jobs of the client are done
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [client]{ return client->queued.empty() && client->running == 0 && client->sending == 0; });
+    auto position = find(clients.begin(), clients.end(), client);
+    if(next_client == position) ++next_client;
+    clients.erase(position);
+    close(client->fd);
+    delete(client);
+    finished.push_back(this_thread::get_id());
+}
+
+void TrimServer::submit_job(ServeClient* client, const string &line){
+    //job, the directory of the client, se or pe and the options, separated by tabs
+    vector<string> fields;
+    size_t start = 0;
+    while(true){
+        size_t end = line.find('\t', start);
+        fields.push_back(line.substr(start, end == string::npos ? string::npos : end - start));
+        if(end == string::npos) break;
+        start = end + 1;
+    }
+    if(fields.size() < 3 || (fields[2] != "se" && fields[2] != "pe")){
+        send_line(client, "error\ta job is job, the directory of its relative paths, se or pe and its options, separated by tabs");
+        return;
+    }
+    const string &dir = fields[1];
+    const string &type = fields[2];
+
+    ServeJob* job = new ServeJob();
+    job->client = client;
+    job->trimmer = NULL;
+    job->progress = NULL;
+    job->type = type;
+    for(size_t i = 3; i < fields.size(); i++){
+        string arg = fields[i];
+        size_t equals = arg.find('=');
+        //by its whole name, as getopt takes --prog for --progress
+        string name = job_option_name(type, arg.substr(0, equals));
+        arg = name + (equals == string::npos ? "" : arg.substr(equals));
+        //the server prints nothing for its jobs, and the memory and buffers are its own
+        if(in_option_list(job_process_options, name)){
+            send_line(client, "error\t" + name + " is not an option of the jobs of sickle serve");
+            delete(job);
+            return;
+        }
+        if(file_option(name)){
+            if(name.length() < arg.length()){
+                arg = name + "=" + absolute_paths(dir, arg.substr(name.length() + 1));
+            }else if(i + 1 < fields.size()){
+                job->args.push_back(arg);
+                arg = absolute_paths(dir, fields[++i]);
+            }
+        }else if(arg.length() > 2 && arg[0] == '-' && arg[1] != '-' && file_option(arg.substr(0, 2))){
+            //-fFILE
+            arg = arg.substr(0, 2) + absolute_paths(dir, arg.substr(2));
+        }
+        job->args.push_back(arg);
+    }
+
+    job->trimmer = runner.prepare_job(type, job->args);
+    if(!job->trimmer){
+        send_line(client, "error\tinvalid options, the server log has the reason");
+        delete(job);
+        return;
+    }
+    job->progress = job->trimmer->track_progress();
+
+    {
+        lock_guard<mutex> guard(lock);
+        job->id = ++next_id;
+    }
+    //queued is sent before a worker can send started
+    send_line(client, "queued\t" + to_string(job->id));
+    {
+        lock_guard<mutex> guard(lock);
+        if(!stopping){
+            client->queued.push_back(job);
+            job = NULL;
+        }
+    }
+    if(job){
+        send_line(client, "cancelled\t" + to_string(job->id));
+        delete(job->trimmer);
+        delete(job);
+        return;
+    }
+    changed.notify_all();
+}
+
+ServeJob* TrimServer::next_job(){
+    if(clients.empty()) return NULL;
+    if(next_client == clients.end()) next_client = clients.begin();
+    list<ServeClient*>::iterator candidate = next_client;
+    do{
+        ServeClient* client = *candidate;
+        if(++candidate == clients.end()) candidate = clients.begin();
+        if(!client->queued.empty()){
+            ServeJob* job = client->queued.front();
+            client->queued.pop_front();
+            client->running++;
+            //the next job comes from the next client with one
+            next_client = candidate;
+            return job;
+        }
+    }while(candidate != next_client);
+    return NULL;
+}
+
+void TrimServer::run_jobs(){
+    while(true){
+        ServeJob* job;
+        unique_lock<mutex> guard(lock);
+        while(!(job = next_job()) && !stopping) changed.wait(guard);
+        if(!job) return;
+        running.push_back(job);
+        guard.unlock();
+
+        send_line(job->client, "started\t" + to_string(job->id));
+        //a bad record or output fails its job, not the server
+        JobResult result = runner.run_job(job->trimmer);
+
+        guard.lock();
+        running.erase(find(running.begin(), running.end(), job));
+        delete(job->trimmer);
+        guard.unlock();
+
+        char done[160];
+        snprintf(done, sizeof(done), "done\t%ld\t%s\t%ld\t%ld\t%ld\t%.3f", job->id, result.status == 0 ? "ok" : "failed",
+            result.records, result.kept, result.discarded, result.seconds);
+        send_line(job->client, done);
+        if(!quiet){
+            guard.lock();
+            fprintf(stdout, "Job %ld (%s): %ld records, %ld kept, %ld discarded, %.2f s%s\n", job->id, job->type.c_str(),
+                result.records, result.kept, result.discarded, result.seconds, result.status == 0 ? "" : ", failed");
+            fflush(stdout);
+            guard.unlock();
+        }
+
+        guard.lock();
+        job->client->running--;
+        delete(job);
+        guard.unlock();
+        changed.notify_all();
+    }
+}
+
+void TrimServer::report_progress(){
+    unique_lock<mutex> guard(lock);
+    while(!stopping){
+        timepoint next = stats_now() + chrono::seconds(PROGRESS_INTERVAL);
+        while(!stopping && changed.wait_until(guard, next) != cv_status::timeout);
+        if(stopping) return;
+
+        //sent without the lock, the clients are kept until then
+        vector<pair<ServeClient*, string> > lines;
+        for(size_t i = 0; i < running.size(); i++){
+            uint64_t reads, kept, discarded;
+            double done;
+            running[i]->progress->snapshot(reads, kept, discarded, done);
+            char line[160];
+            snprintf(line, sizeof(line), "progress\t%ld\t%lu\t%lu\t%lu\t%.1f", running[i]->id,
+                (unsigned long)reads, (unsigned long)kept, (unsigned long)discarded, 100.0 * done);
+            running[i]->client->sending++;
+            lines.push_back({running[i]->client, line});
+        }
+        guard.unlock();
+        for(size_t i = 0; i < lines.size(); i++) send_line(lines[i].first, lines[i].second);
+        guard.lock();
+        for(size_t i = 0; i < lines.size(); i++) lines[i].first->sending--;
+        changed.notify_all();
+    }
+}
+
+void TrimServer::stop(){
+    vector<ServeJob*> cancelled;
+    {
+        lock_guard<mutex> guard(lock);
+        if(stopping) return;
+        stopping = true;
+        //the running jobs finish, the queued ones are dropped
+        for(ServeClient* client: clients){
+            for(size_t i = 0; i < client->queued.size(); i++){
+                cancelled.push_back(client->queued[i]);
+                client->sending++;
+            }
+            client->queued.clear();
+            shutdown(client->fd, SHUT_RD);
+        }
+    }
+    changed.notify_all();
+    for(size_t i = 0; i < cancelled.size(); i++){
+        send_line(cancelled[i]->client, "cancelled\t" + to_string(cancelled[i]->id));
+        delete(cancelled[i]->trimmer);
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        for(size_t i = 0; i < cancelled.size(); i++){
+            cancelled[i]->client->sending--;
+            delete(cancelled[i]);
+        }
+    }
+    changed.notify_all();
+}
+
+void TrimServer::join_finished(){
+    vector<thread::id> ids;
+    {
+        lock_guard<mutex> guard(lock);
+        ids.swap(finished);
+    }
+    for(size_t i = 0; i < ids.size(); i++){
+        connections[ids[i]].join();
+        connections.erase(ids[i]);
+    }
+}
+
+int TrimServer::run_main(){
+    runner.start();
+    if(open_socket() != 0) return EXIT_FAILURE;
+
+    //clients that go away must not end the server
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serve_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    next_client = clients.end();
+    vector<thread> workers;
+    for(int i = 0; i < runner.jobs; i++) workers.push_back(thread(&TrimServer::run_jobs, this));
+    thread progress_thread(&TrimServer::report_progress, this);
+    if(!quiet){
+        fprintf(stdout, "Serving on '%s', %d jobs at once with %d threads each\n", socket_fn, runner.jobs, runner.job_threads());
+        fflush(stdout);
+    }
+
+    while(!stopping && !serve_signalled){
+        struct pollfd waiting = {listen_fd, POLLIN, 0};
+        if(poll(&waiting, 1, 500) <= 0){
+            join_finished();
+            continue;
+        }
+        int fd = accept(listen_fd, NULL, NULL);
+        if(fd < 0) continue;
+        ServeClient* client = new ServeClient();
+        client->fd = fd;
+        client->running = 0;
+        client->sending = 0;
+        {
+            lock_guard<mutex> guard(lock);
+            clients.push_back(client);
+        }
+        thread connection(&TrimServer::serve_client, this, client);
+        connections[connection.get_id()] = move(connection);
+        join_finished();
+    }
+
+    stop();
+    close(listen_fd);
+    unlink(socket_fn);
+    for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+    progress_thread.join();
+    for(auto &connection: connections) connection.second.join();
+    if(!quiet) fprintf(stdout, "Stopped serving on '%s'\n", socket_fn);
+    return EXIT_SUCCESS;
+}
+
+static void submit_usage(int status, char const *msg){
+    fprintf(stderr, "\nUsage: %s submit --socket <socket path> se|pe <options>\n\
+       %s submit --socket <socket path> --shutdown\n\
+\n\
+Sends a se or pe job to %s serve, with the options of se and pe; relative paths are from the\n\
+current directory. Prints the lines of the server until the job is done:\n\
+\tqueued <id>, started <id>, progress <id> <reads> <kept> <discarded> <%% of the input done>,\n\
+\tand done <id> ok|failed <records> <kept> <discarded> <seconds> (or error <reason>, cancelled <id>).\n\
+Exits with 0 if the job is done ok. --shutdown stops the server after its running jobs.\n\n",
+        PROGRAM_NAME, PROGRAM_NAME, PROGRAM_NAME);
+
+    if (msg) fprintf(stderr, "%s\n\n", msg);
+    exit(status);
+}
+
+int submit_main(int argc, char *argv[]){
+    const char* socket_fn = NULL;
+    bool shutdown_server = false;
+    int job_start = argc;
+    for(int i = 2; i < argc; i++){
+        string arg = argv[i];
+        if(arg == "se" || arg == "pe"){
+            job_start = i;
+            break;
+        }else if(arg == "--socket" && i + 1 < argc){
+            socket_fn = argv[++i];
+        }else if(arg.compare(0, 9, "--socket=") == 0){
+            socket_fn = argv[i] + 9;
+        }else if(arg == "--shutdown"){
+            shutdown_server = true;
+        }else if(arg == "--help"){
+            submit_usage(EXIT_SUCCESS, NULL);
+        }else{
+            submit_usage(EXIT_FAILURE, ("****Error: Unknown option '" + arg + "'.").c_str());
+        }
+    }
+    if(!socket_fn) submit_usage(EXIT_FAILURE, "****Error: Must have a socket.");
+    if(shutdown_server == (job_start < argc)) submit_usage(EXIT_FAILURE, "****Error: Must have either a se or pe job or --shutdown.");
+
+    string request;
+    if(shutdown_server){
+        request = "shutdown\n";
+    }else{
+        char dir[PATH_MAX];
+        if(!getcwd(dir, sizeof(dir))){
+            fprintf(stderr, "****Error: Could not get the current directory.\n\n");
+            return EXIT_FAILURE;
+        }
+        request = string("job\t") + dir;
+        for(int i = job_start; i < argc; i++){
+            if(strpbrk(argv[i], "\t\n")){
+                fprintf(stderr, "****Error: Options of a job can't have tabs or newlines.\n\n");
+                return EXIT_FAILURE;
+            }
+            request += string("\t") + argv[i];
+        }
+        request += "\n";
+    }
+
+    struct sockaddr_un addr;
+    if(socket_address(socket_fn, addr) != 0) return EXIT_FAILURE;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        fprintf(stderr, "****Error: Could not connect to '%s': %s.\n\n", socket_fn, strerror(errno));
+        if(fd >= 0) close(fd);
+        return EXIT_FAILURE;
+    }
+    if(!send_all(fd, request)){
+        fprintf(stderr, "****Error: Could not send the job to '%s'.\n\n", socket_fn);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    //the server answers until the job is done, then closes the connection
+    shutdown(fd, SHUT_WR);
+
+    int status = shutdown_server ? EXIT_SUCCESS : EXIT_FAILURE;
+    string buffer;
+    char chunk[4096];
+    ssize_t n;
+    while((n = read(fd, chunk, sizeof(chunk))) > 0 || (n < 0 && errno == EINTR)){
+        if(n < 0) continue;
+        buffer.append(chunk, n);
+        size_t end;
+        while((end = buffer.find('\n')) != string::npos){
+            string line = buffer.substr(0, end);
+            buffer.erase(0, end + 1);
+            fprintf(stdout, "%s\n", line.c_str());
+            fflush(stdout);
+            if(line.compare(0, 5, "done\t") == 0 && line.find("\tok\t") != string::npos) status = EXIT_SUCCESS;
+        }
+    }
+    close(fd);
+    return status;
+}
@@ -0,0 +1,93 @@
+#ifndef _SERVE_
+#define _SERVE_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "runner.h"
+
+/* Jobs of sickle serve trimmed at the same time */
+#ifndef DEFAULT_JOBS_IN_FLIGHT
+#define DEFAULT_JOBS_IN_FLIGHT 2
+#endif
+
+/* A job sent by a client, from its queue to its done line */
+struct ServeJob{
+    long id;
+    struct ServeClient* client;
+    //se or pe, and the options of the job
+    std::string type;
+    std::vector<std::string> args;
+    Abstract_Trimmer* trimmer;
+    //counts of the running job, owned by trimmer
+    ProgressReporter* progress;
+};
+
+/* A connection, and the jobs it sent that haven't finished */
+struct ServeClient{
+    int fd;
+    std::deque<ServeJob*> queued;
+    int running;
+    //progress and cancelled lines being sent to it without the lock of the server
+    int sending;
+    //the lines of a client are written whole, by its reader and the workers
+    std::mutex write_lock;
+};
+
+/* `sickle serve`, a local daemon trimming the se and pe jobs of its clients
+on a Unix socket, so a pipeline submitting many small jobs doesn't pay for
+starting a process and warming its buffers for each of them. A few jobs run
+at once, taken round robin from the clients so none of them waits behind the
+queue of another, and sharing the threads, the batch buffers and the
+--max-memory budget. Each client gets the progress of its jobs while they run
+and their counts when they finish; `sickle submit` is such a client. */
+class TrimServer{
+public:
+    TrimServer();
+    ~TrimServer();
+    int parse_args(int argc, char *argv[]);
+    int run_main();
+    void usage(int status, char const *msg);
+private:
+    int open_socket();
+    void serve_client(ServeClient* client);
+    void submit_job(ServeClient* client, const std::string &line);
+    ServeJob* next_job();
+    void run_jobs();
+    void report_progress();
+    void send_line(ServeClient* client, const std::string &line);
+    void stop();
+    //joins the connection threads that are done
+    void join_finished();
+
+    char* socket_fn;
+    int quiet;
+    //--jobs, -a, --max-memory and --hugepages
+    JobRunner runner;
+
+    int listen_fd;
+
+    //clients, their queues and the running jobs; the round robin goes on from next_client
+    std::mutex lock;
+    std::condition_variable changed;
+    std::list<ServeClient*> clients;
+    std::list<ServeClient*>::iterator next_client;
+    std::vector<ServeJob*> running;
+    long next_id;
+    std::atomic<bool> stopping;
+    //threads reading the connections, and the ones that are done
+    std::map<std::thread::id, std::thread> connections;
+    std::vector<std::thread::id> finished;
+};
+
+/* `sickle submit`, sends a se or pe job to sickle serve and prints what the
+server answers until it is done */
+int submit_main(int argc, char *argv[]);
+
+#endif
@@ -1,35 +1,29 @@
-#include <assert.h>
-#include <ctype.h>
 #include <stdlib.h>
-#include <limits.h>
-#include <zlib.h>
 #include <stdio.h>
-#include <getopt.h>
 #include <string.h>
-#include <thread>
-#include <algorithm>
-#include <iostream>
-#include <cstring>
-
-// for mmap:
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <queue>
-#include <vector>
-#include "GZReader.h"
 #include "sickle.h"
-#include "trim.h"
 #include "trim_single.h"
 #include "trim_paired.h"
+#include "generate.h"
+#include "manifest.h"
+#include "serve.h"
+#include "watch.h"
+
+/* The sickle command line: each command is a class of libsickle (se and pe
+a Pipeline of their files), this only picks it */
 
-void main_usage (int status) {
+static void main_usage (int status) {
 
 	fprintf (stdout, "\nUsage: %s <command> [options]\n\
 \n\
 Command:\n\
 pe\tpaired-end sequence trimming\n\
 se\tsingle-end sequence trimming\n\
+batch\tse and pe samples of a manifest, several at once\n\
+serve\tdaemon trimming the se and pe jobs sent to a Unix socket\n\
+submit\tsend a job to sickle serve\n\
+watch\tfiles written to a directory, as they are closed\n\
+gen\tsynthetic fastq files for testing\n\
 \n\
 --help, display this help and exit\n\
 --version, output version information and exit\n\n", PROGRAM_NAME);
@@ -43,6 +37,11 @@ int main (int argc, char *argv[]) {
 
 	if (argc < 2 || (strcmp (argv[1],"pe") != 0
 		&& strcmp (argv[1],"se") != 0
+		&& strcmp (argv[1],"gen") != 0
+		&& strcmp (argv[1],"batch") != 0
+		&& strcmp (argv[1],"serve") != 0
+		&& strcmp (argv[1],"submit") != 0
+		&& strcmp (argv[1],"watch") != 0
 		&& strcmp (argv[1],"--version") != 0
 		&& strcmp (argv[1],"--help") != 0)) {
 		main_usage (EXIT_FAILURE);
@@ -55,6 +54,28 @@ int main (int argc, char *argv[]) {
 		exit (EXIT_SUCCESS);
 	} else if (strcmp (argv[1],"--help") == 0) {
 		main_usage (EXIT_SUCCESS);
+	} else if (strcmp (argv[1],"gen") == 0) {
+		Generator generator;
+		retval = generator.parse_args(argc, argv);
+		if(retval != 0) return retval;
+		return generator.generate_main();
+	} else if (strcmp (argv[1],"batch") == 0) {
+		ManifestRunner runner;
+		retval = runner.parse_args(argc, argv);
+		if(retval != 0) return retval;
+		return runner.run_main();
+	} else if (strcmp (argv[1],"serve") == 0) {
+		TrimServer server;
+		retval = server.parse_args(argc, argv);
+		if(retval != 0) return retval;
+		return server.run_main();
+	} else if (strcmp (argv[1],"submit") == 0) {
+		return submit_main(argc, argv);
+	} else if (strcmp (argv[1],"watch") == 0) {
+		DirectoryWatcher watcher;
+		retval = watcher.parse_args(argc, argv);
+		if(retval != 0) return retval;
+		return watcher.run_main();
 	} else if (strcmp (argv[1],"pe") == 0 || strcmp (argv[1],"se") == 0) {
 		msg("Initializing trimmer.");
 		if (strcmp (argv[1],"pe") == 0){
@@ -66,7 +87,11 @@ int main (int argc, char *argv[]) {
 			msg("Finished parsing trimmer arguments");
 
 			msg("Starting to trim!");
-			retval = trimmer.trim_main();
+			try {
+				retval = trimmer.trim_main();
+			} catch (TrimError &error) {
+				retval = error.status;
+			}
 		}else{
 			msg("It will be single.");
 			Trim_Single trimmer;
@@ -77,7 +102,11 @@ int main (int argc, char *argv[]) {
 			msg("Finished parsing trimmer arguments");
 
 			msg("Starting to trim!");
-			retval = trimmer.trim_main();
+			try {
+				retval = trimmer.trim_main();
+			} catch (TrimError &error) {
+				retval = error.status;
+			}
 		}
 		return retval;
 	}
@@ -4,6 +4,7 @@
 #include <limits.h>
 #include <zlib.h>
 #include <iostream>
+#include <string_view>
 #include <thread>
 
 #define BUFFER_SIZE 4096
@@ -20,8 +21,9 @@
 #define VERSION 0.0
 #endif
 
+/* available_cpus() is in topology.h */
 #ifndef DEFAULT_THREADS
-#define DEFAULT_THREADS std::thread::hardware_concurrency();
+#define DEFAULT_THREADS available_cpus()
 #endif
 
 #ifndef DEFAULT_BATCH_LEN
@@ -58,6 +60,49 @@ exit(EXIT_SUCCESS);
 #endif
 /* end code drawn from system.h */
 
+/* Values for options that only have a long form, shared by se and pe */
+enum {
+  ADAPTER_MISMATCHES_OPTION = (CHAR_MIN - 4),
+  ADAPTER_OVERLAP_OPTION = (CHAR_MIN - 5),
+  DETECT_OVERLAP_OPTION = (CHAR_MIN - 6),
+  POLY_X_OPTION = (CHAR_MIN - 7),
+  POLY_MIN_LEN_OPTION = (CHAR_MIN - 8),
+  POLY_MISMATCHES_OPTION = (CHAR_MIN - 9),
+  MAX_EE_OPTION = (CHAR_MIN - 10),
+  MAX_DUST_OPTION = (CHAR_MIN - 11),
+  QC_JSON_OPTION = (CHAR_MIN - 12),
+  STATS_JSON_OPTION = (CHAR_MIN - 13),
+  STATS_PER_BATCH_OPTION = (CHAR_MIN - 14),
+  TRACE_OPTION = (CHAR_MIN - 15),
+  PROGRESS_OPTION = (CHAR_MIN - 16),
+  MAX_MEMORY_OPTION = (CHAR_MIN - 17),
+  NUMA_OPTION = (CHAR_MIN - 18),
+  HUGEPAGES_OPTION = (CHAR_MIN - 19),
+  LONG_READS_OPTION = (CHAR_MIN - 20),
+  SPLIT_READS_OPTION = (CHAR_MIN - 21),
+  SPLIT_PARTS_OPTION = (CHAR_MIN - 22),
+  FOLLOW_OPTION = (CHAR_MIN - 23),
+  FOLLOW_SENTINEL_OPTION = (CHAR_MIN - 24),
+  FOLLOW_TIMEOUT_OPTION = (CHAR_MIN - 25),
+  CHECKPOINT_OPTION = (CHAR_MIN - 26),
+  CHECKPOINT_INTERVAL_OPTION = (CHAR_MIN - 27),
+  RESUME_OPTION = (CHAR_MIN - 28),
+  BINARY_OPTION = (CHAR_MIN - 29),
+  QUAL_BIN_OPTION = (CHAR_MIN - 30)
+};
+
+/* Values for the long-only options of gen */
+enum {
+  GEN_BGZF_OPTION = (CHAR_MIN - 4),
+  GEN_SEED_OPTION = (CHAR_MIN - 5),
+  GEN_QUAL_START_OPTION = (CHAR_MIN - 6),
+  GEN_QUAL_END_OPTION = (CHAR_MIN - 7),
+  GEN_N_RATE_OPTION = (CHAR_MIN - 8),
+  GEN_ADAPTER_RATE_OPTION = (CHAR_MIN - 9),
+  GEN_ADAPTER2_OPTION = (CHAR_MIN - 10),
+  GEN_POLY_G_RATE_OPTION = (CHAR_MIN - 11)
+};
+
 typedef enum {
   PHRED,
   SANGER,
@@ -90,13 +135,28 @@ static const int quality_constants[4][3] = {
   {64, 64, 110} /* ILLUMINA */
 };
 
+/* qualtype of -t auto, until it is detected from the first batch */
+#ifndef QUALTYPE_AUTO
+#define QUALTYPE_AUTO -2
+#endif
+
+#ifndef AUTO_QUALTYPE_SAMPLE
+#define AUTO_QUALTYPE_SAMPLE 10000
+#endif
+
 typedef struct __cutsites_ {
     int five_prime_cut;
 	int three_prime_cut;
 } cutsites;
 
+/* Debug messages are only printed by `make debug` builds. The stages of
+each batch are followed with --trace instead (see trace.h). */
 #ifndef _DEBUGMODE_
+#ifdef DEBUG
 #define _DEBUGMODE_ true
+#else
+#define _DEBUGMODE_ false
+#endif
 #endif
 
 inline void msg(const char * content){
@@ -119,4 +179,18 @@ inline void error(std::string content){
     std::flush(std::cerr);
 }
 
+/* Thrown where a run can't go on, once the reason is printed: a record or a
+quality char that doesn't fit, an input cut short, an output that can't be
+written. sickle se and pe exit with status; a job of serve, batch or watch
+fails on its own. */
+struct TrimError{
+    int status;
+};
+
+/* gzprintf would treat the content as a format string and truncate it to its
+internal buffer, so whole batches are written with gzwrite */
+inline int gzwrite_str(gzFile file, std::string_view content){
+    return gzwrite(file, content.data(), content.length());
+}
+
 #endif /*SICKLE_H*/
@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <climits>
+#include <algorithm>
+#include <thread>
+#include "split.h"
+
+using namespace std;
+
+string chunk_path(const string &path, long chunk){
+    char number[24];
+    snprintf(number, sizeof(number), "_%03ld", chunk + 1);
+    size_t name_start = path.rfind('/');
+    name_start = name_start == string::npos ? 0 : name_start + 1;
+    //before the extension, so the chunks keep it
+    const char* extensions[] = {".fastq", ".fq", ".gz", NULL};
+    for(int i = 0; extensions[i]; i++){
+        size_t position = path.find(extensions[i], name_start);
+        if(position != string::npos && position > name_start){
+            return path.substr(0, position) + number + path.substr(position);
+        }
+    }
+    return path + number;
+}
+
+OutputSplitter::OutputSplitter(long split_reads, int split_parts, bool gzip){
+    this->split_reads = split_reads;
+    this->split_parts = split_parts;
+    this->gzip = gzip;
+    records = 0;
+    kept = 0;
+    opened_any = false;
+    write_failed = false;
+}
+
+OutputSplitter::~OutputSplitter(){
+    close();
+}
+
+void OutputSplitter::add_output(const char* path, bool singles){
+    Output output;
+    output.path = path;
+    output.singles = singles;
+    outputs.push_back(output);
+}
+
+int OutputSplitter::open(){
+    for(int chunk = 0; chunk < split_parts; chunk++){
+        int res = open_chunk(chunk);
+        if(res != 0) return res;
+    }
+    return 0;
+}
+
+int OutputSplitter::open_chunk(long chunk){
+    //the chunk is opened in all outputs at once, so they have the same ones
+    for(size_t i = 0; i < outputs.size(); i++){
+        if(outputs[i].chunks.count(chunk)) continue;
+        string path = chunk_path(outputs[i].path, chunk);
+        Chunk opened = {NULL, NULL, string()};
+        if(gzip) opened.gz_file = gzopen(path.c_str(), "w");
+        else opened.file = fopen(path.c_str(), "w");
+        if(!opened.file && !opened.gz_file){
+            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", path.c_str());
+            return EXIT_FAILURE;
+        }
+        outputs[i].chunks[chunk] = opened;
+    }
+    opened_any = true;
+    return 0;
+}
+
+void OutputSplitter::flush(Chunk* chunk, const string* path, char* written_all){
+    size_t written;
+    if(chunk->gz_file) written = gzwrite_str(chunk->gz_file, chunk->pending);
+    else written = fwrite(chunk->pending.data(), 1, chunk->pending.length(), chunk->file);
+    *written_all = written == chunk->pending.length();
+    if(!*written_all) fprintf(stderr, "****Error: Could not write to a chunk of '%s'.\n\n", path->c_str());
+    chunk->pending.clear();
+}
+
+void OutputSplitter::write(const vector<char> &kinds, const vector<SplitText> &texts){
+    vector<size_t> next(outputs.size(), 0), start(outputs.size(), 0);
+    for(size_t r = 0; r < kinds.size(); r++){
+        long chunk = split_parts ? records % split_parts : kept / split_reads;
+        records++;
+        if(kinds[r] == SPLIT_DISCARDED) continue;
+        if(!split_parts && open_chunk(chunk) != 0) throw TrimError{EXIT_FAILURE};
+        for(size_t i = 0; i < outputs.size(); i++){
+            if(outputs[i].singles != (kinds[r] == SPLIT_SINGLE)) continue;
+            size_t end = texts[i].ends->at(next[i]++);
+            outputs[i].chunks[chunk].pending.append(texts[i].text.substr(start[i], end - start[i]));
+            start[i] = end;
+        }
+        if(kinds[r] == SPLIT_KEPT) kept++;
+    }
+
+    vector<pair<Chunk*, const string*> > touched;
+    for(size_t i = 0; i < outputs.size(); i++){
+        for(auto &chunk: outputs[i].chunks){
+            if(!chunk.second.pending.empty()) touched.push_back({&chunk.second, &outputs[i].path});
+        }
+    }
+    vector<char> written(touched.size(), false);
+    if(gzip && touched.size() > 1){
+        vector<thread> compressing;
+        for(size_t i = 0; i < touched.size(); i++) compressing.push_back(thread(flush, touched[i].first, touched[i].second, &written[i]));
+        for(size_t i = 0; i < compressing.size(); i++) compressing[i].join();
+    }else{
+        for(size_t i = 0; i < touched.size(); i++) flush(touched[i].first, touched[i].second, &written[i]);
+    }
+    if(find(written.begin(), written.end(), false) != written.end()){
+        write_failed = true;
+        throw TrimError{EXIT_FAILURE};
+    }
+    //no record goes to the full chunks any more
+    if(!split_parts && close_chunks_before(kept / split_reads) != 0) throw TrimError{EXIT_FAILURE};
+}
+
+int OutputSplitter::close_chunks_before(long chunk){
+    int res = 0;
+    for(size_t i = 0; i < outputs.size(); i++){
+        map<long, Chunk> &chunks = outputs[i].chunks;
+        while(!chunks.empty() && chunks.begin()->first < chunk){
+            Chunk &closing = chunks.begin()->second;
+            //what the chunk still buffers is written as it closes
+            bool closed = closing.gz_file ? gzclose(closing.gz_file) == Z_OK : fclose(closing.file) == 0;
+            if(!closed){
+                //once is enough, the chunks after it fail as well
+                if(!write_failed) fprintf(stderr, "****Error: Could not write to a chunk of '%s'.\n\n", outputs[i].path.c_str());
+                write_failed = true;
+                res = EXIT_FAILURE;
+            }
+            chunks.erase(chunks.begin());
+        }
+    }
+    return res;
+}
+
+int OutputSplitter::close(){
+    //with no reads kept, the outputs still get an empty first chunk
+    if(!opened_any && !outputs.empty() && open_chunk(0) != 0) return EXIT_FAILURE;
+    return close_chunks_before(LONG_MAX);
+}
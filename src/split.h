@@ -0,0 +1,69 @@
+#ifndef _SPLIT_
+#define _SPLIT_
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+#include "sickle.h"
+
+/* What the output thread did with a record, or a pair of reads */
+enum { SPLIT_DISCARDED = 0, SPLIT_KEPT = 1, SPLIT_SINGLE = 2 };
+
+/* Text of a batch for an output, with the end of each of its records (or pairs) */
+struct SplitText{
+    std::string_view text;
+    const std::vector<size_t>* ends;
+};
+
+/* Name of a chunk of an output file: out.fq.gz is out_001.fq.gz, out_002.fq.gz... */
+std::string chunk_path(const std::string &path, long chunk);
+
+/* --split-reads and --split-parts: each output is written as numbered chunk
+files instead of one file. With --split-reads N a chunk has N kept reads (or
+pairs), and the singles of the pairs read meanwhile; with --split-parts K the
+records go round robin to K chunks, by their position in the output. Either
+way chunk n of -o, -p and -s comes from the same input records. With -g, the
+chunks a batch goes to are compressed at once, each by its own thread. */
+class OutputSplitter{
+public:
+    OutputSplitter(long split_reads, int split_parts, bool gzip);
+    ~OutputSplitter();
+    //An output, of the kept records or of the singles, in the order of the texts given to write
+    void add_output(const char* path, bool singles);
+    //Opens the chunks of --split-parts; the ones of --split-reads are opened as they are reached
+    int open();
+    //Writes a batch: what happened to each record, in output order, and the text of each output; throws TrimError if it can't
+    void write(const std::vector<char> &kinds, const std::vector<SplitText> &texts);
+    //EXIT_FAILURE if a chunk couldn't be written whole
+    int close();
+private:
+    struct Chunk{
+        FILE* file;
+        gzFile gz_file;
+        std::string pending;
+    };
+    struct Output{
+        std::string path;
+        bool singles;
+        std::map<long, Chunk> chunks;
+    };
+    int open_chunk(long chunk);
+    int close_chunks_before(long chunk);
+    //written_all is false, and the error printed, if the chunk couldn't take all of its text
+    static void flush(Chunk* chunk, const std::string* path, char* written_all);
+    long split_reads;
+    int split_parts;
+    bool gzip;
+    std::vector<Output> outputs;
+    //records (or pairs) and kept ones written so far
+    long records;
+    long kept;
+    bool opened_any;
+    //a chunk couldn't take its text, the error is printed
+    bool write_failed;
+};
+
+#endif
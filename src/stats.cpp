@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <fstream>
+#include "stats.h"
+
+using namespace std;
+
+static const char stage_names[N_STAGES][10] = {
+    {"read"},
+    {"parse"},
+    {"trim"},
+    {"format"},
+    {"compress"},
+    {"write"}
+};
+
+BatchStats::BatchStats(int threads){
+    index = 0;
+    records = 0;
+    input_bytes = 0;
+    output_bytes = 0;
+    memset(seconds, 0, sizeof(seconds));
+    worker_seconds.resize(threads, 0);
+    output_wait = 0;
+}
+
+PipelineStats::PipelineStats(int threads, bool per_batch): totals(threads){
+    this->threads = threads;
+    this->per_batch = per_batch;
+    batches = 0;
+    start = stats_now();
+}
+
+BatchStats* PipelineStats::new_batch(){
+    lock_guard<mutex> guard(lock);
+    BatchStats* batch = new BatchStats(threads);
+    batch->index = batches++;
+    return batch;
+}
+
+void PipelineStats::finish_batch(BatchStats* batch){
+    lock_guard<mutex> guard(lock);
+    totals.records += batch->records;
+    totals.input_bytes += batch->input_bytes;
+    totals.output_bytes += batch->output_bytes;
+    for(int i = 0; i < N_STAGES; i++) totals.seconds[i] += batch->seconds[i];
+    for(int i = 0; i < threads; i++) totals.worker_seconds[i] += batch->worker_seconds[i];
+    totals.output_wait += batch->output_wait;
+    if(per_batch) finished.push_back(*batch);
+    delete(batch);
+}
+
+static void write_batch_json(ofstream &out, BatchStats &batch, int threads, const char* indent){
+    double busy = 0;
+    for(int i = 0; i < threads; i++) busy += batch.worker_seconds[i];
+    out << indent << "\"records\": " << batch.records << ",\n";
+    out << indent << "\"input_bytes\": " << batch.input_bytes << ",\n";
+    out << indent << "\"output_bytes\": " << batch.output_bytes << ",\n";
+    out << indent << "\"stage_seconds\": {";
+    for(int i = 0; i < N_STAGES; i++){
+        out << (i ? ", " : "") << "\"" << stage_names[i] << "\": " << batch.seconds[i];
+    }
+    out << "},\n";
+    out << indent << "\"worker_busy_seconds\": " << busy << ",\n";
+    out << indent << "\"worker_barrier_wait_seconds\": " << (batch.seconds[STAGE_TRIM] * threads - busy) << ",\n";
+    out << indent << "\"output_wait_seconds\": " << batch.output_wait;
+}
+
+int PipelineStats::write_json(const char* path){
+    lock_guard<mutex> guard(lock);
+    double wall = seconds_between(start, stats_now());
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    ofstream out(path);
+    if(!out){
+        fprintf(stderr, "****Error: Could not open stats output file '%s'.\n\n", path);
+        return EXIT_FAILURE;
+    }
+    out << "{\n";
+    out << "  \"wall_seconds\": " << wall << ",\n";
+    out << "  \"threads\": " << threads << ",\n";
+    out << "  \"batches\": " << batches << ",\n";
+    out << "  \"records_per_second\": " << (wall > 0 ? totals.records / wall : 0) << ",\n";
+    out << "  \"input_mb_per_second\": " << (wall > 0 ? totals.input_bytes / wall / (1024*1024) : 0) << ",\n";
+    out << "  \"peak_rss_kb\": " << usage.ru_maxrss << ",\n";
+    write_batch_json(out, totals, threads, "  ");
+    if(per_batch){
+        out << ",\n  \"per_batch\": [";
+        for(size_t i = 0; i < finished.size(); i++){
+            out << (i ? ",\n" : "\n") << "    {\n      \"batch\": " << finished[i].index << ",\n";
+            write_batch_json(out, finished[i], threads, "      ");
+            out << "\n    }";
+        }
+        out << "\n  ]";
+    }
+    out << "\n}\n";
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef _STATS_
+#define _STATS_
+
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+typedef std::chrono::steady_clock::time_point timepoint;
+
+inline timepoint stats_now(){
+    return std::chrono::steady_clock::now();
+}
+
+inline double seconds_between(timepoint start, timepoint end){
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/* Stages of the handling of a batch. Read includes the decompression of
+gzipped inputs, and for gzipped outputs compress includes writing them. */
+typedef enum {
+    STAGE_READ,
+    STAGE_PARSE,
+    STAGE_TRIM,
+    STAGE_FORMAT,
+    STAGE_COMPRESS,
+    STAGE_WRITE,
+    N_STAGES
+} pipeline_stage;
+
+/* Filled by the main thread up to the trimming and by the worker that
+formats and writes the batch after it, so it never has two writers at once */
+struct BatchStats{
+    BatchStats(int threads);
+    long index;
+    long records;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    double seconds[N_STAGES];
+    //busy time of each processing thread, the rest of the trim stage is barrier wait
+    std::vector<double> worker_seconds;
+    //time the main thread waited for the output of the previous batch
+    double output_wait;
+};
+
+/* Throughput and latency of a whole run, for --stats-json */
+class PipelineStats{
+public:
+    PipelineStats(int threads, bool per_batch);
+    BatchStats* new_batch();
+    //Adds a finished batch to the totals and deletes it
+    void finish_batch(BatchStats* batch);
+    int write_json(const char* path);
+private:
+    std::mutex lock;
+    timepoint start;
+    int threads;
+    bool per_batch;
+    long batches;
+    BatchStats totals;
+    std::vector<BatchStats> finished;
+};
+
+#endif
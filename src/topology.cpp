@@ -0,0 +1,141 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include "topology.h"
+
+using namespace std;
+
+/* Quota over period of the cgroup, or 0 if there is no quota */
+static double cgroup_cpu_limit(){
+    string v2_path, v1_path;
+    ifstream cgroups("/proc/self/cgroup");
+    string line;
+    while(getline(cgroups, line)){
+        size_t first = line.find(':'), second = line.find(':', first + 1);
+        if(first == string::npos || second == string::npos) continue;
+        string controllers = line.substr(first + 1, second - first - 1);
+        string path = line.substr(second + 1);
+        if(path == "/") path = "";
+        if(controllers.empty()) v2_path = path;
+        stringstream list(controllers);
+        string controller;
+        while(getline(list, controller, ',')){
+            if(controller == "cpu") v1_path = path;
+        }
+    }
+
+    //cgroup v2: "max 100000" or "<quota> <period>"
+    const string v2_files[] = {"/sys/fs/cgroup" + v2_path + "/cpu.max", "/sys/fs/cgroup/cpu.max"};
+    for(const string &file: v2_files){
+        ifstream cpu_max(file);
+        string quota;
+        double period;
+        if(cpu_max >> quota >> period){
+            if(quota == "max" || period <= 0) return 0;
+            return atof(quota.c_str()) / period;
+        }
+    }
+    //cgroup v1, where -1 is no quota
+    const string v1_dirs[] = {"/sys/fs/cgroup/cpu,cpuacct" + v1_path, "/sys/fs/cgroup/cpu" + v1_path, "/sys/fs/cgroup/cpu"};
+    for(const string &dir: v1_dirs){
+        ifstream quota_file(dir + "/cpu.cfs_quota_us"), period_file(dir + "/cpu.cfs_period_us");
+        double quota, period;
+        if(quota_file >> quota && period_file >> period){
+            if(quota <= 0 || period <= 0) return 0;
+            return quota / period;
+        }
+    }
+    return 0;
+}
+
+int available_cpus(){
+    int cpus = 0;
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) cpus = CPU_COUNT(&allowed);
+    if(cpus < 1) cpus = std::thread::hardware_concurrency();
+    double limit = cgroup_cpu_limit();
+    if(limit > 0 && ceil(limit) < cpus) cpus = (int)ceil(limit);
+    return cpus < 1 ? 1 : cpus;
+}
+
+/* Parses a sysfs CPU list, as 0-3,8-11 */
+static void parse_cpulist(const string &list, cpu_set_t &cpus){
+    CPU_ZERO(&cpus);
+    stringstream ranges(list);
+    string range;
+    while(getline(ranges, range, ',')){
+        if(range.empty()) continue;
+        int first = atoi(range.c_str()), last = first;
+        size_t dash = range.find('-');
+        if(dash != string::npos) last = atoi(range.c_str() + dash + 1);
+        for(int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &cpus);
+    }
+}
+
+NumaTopology::NumaTopology(){
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+    DIR* dir = opendir("/sys/devices/system/node");
+    if(!dir) return;
+    vector<int> node_ids;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL){
+        if(strncmp(entry->d_name, "node", 4) == 0 && isdigit(entry->d_name[4])){
+            node_ids.push_back(atoi(entry->d_name + 4));
+        }
+    }
+    closedir(dir);
+    sort(node_ids.begin(), node_ids.end());
+    for(int id: node_ids){
+        ifstream cpulist("/sys/devices/system/node/node" + to_string(id) + "/cpulist");
+        string list;
+        if(!getline(cpulist, list)) continue;
+        cpu_set_t cpus;
+        parse_cpulist(list, cpus);
+        CPU_AND(&cpus, &cpus, &allowed);
+        if(CPU_COUNT(&cpus) > 0) node_cpus.push_back(cpus);
+    }
+}
+
+int NumaTopology::nodes(){
+    return node_cpus.size();
+}
+
+int NumaTopology::node_of(int thread_n, int threads){
+    if(node_cpus.empty()) return 0;
+    return (long)thread_n * node_cpus.size() / threads;
+}
+
+bool NumaTopology::pin_to_node(int node){
+    if(node < 0 || node >= (int)node_cpus.size()) return false;
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &node_cpus[node]) == 0;
+}
+
+void localize_records(std::vector<FQEntry*>* queue, long last_index, std::vector<char> &arena){
+    size_t total = 0;
+    for(long i = 0; i <= last_index; i++){
+        FQEntry* fqrec = queue->at(i);
+        total += fqrec->name.length() + fqrec->seq.length() + fqrec->comment.length() + fqrec->qual.length();
+    }
+    //resize only allocates when the arena grows, the pages it keeps stay on this node
+    if(arena.size() < total) arena.resize(total);
+    char* next = arena.data();
+    for(long i = 0; i <= last_index; i++){
+        FQEntry* fqrec = queue->at(i);
+        std::string_view* fields[] = {&fqrec->name, &fqrec->seq, &fqrec->comment, &fqrec->qual};
+        for(std::string_view* field: fields){
+            memcpy(next, field->data(), field->length());
+            *field = std::string_view(next, field->length());
+            next += field->length();
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef _TOPOLOGY_
+#define _TOPOLOGY_
+
+#include <sched.h>
+#include <string_view>
+#include <vector>
+#include "FQEntry.h"
+
+/* Nodes needed for --numa to pin threads and localize batches; fewer nodes
+fall back to the normal execution */
+#ifndef NUMA_MIN_NODES
+#define NUMA_MIN_NODES 2
+#endif
+
+/* Arenas of each processing thread: the batch being trimmed and the ones
+whose output may still read them */
+#ifndef NUMA_ARENAS
+#define NUMA_ARENAS 3
+#endif
+
+/* CPUs this process may run on, limited by the CPU quota of its cgroup
+(cpu.max, or cpu.cfs_quota_us in cgroup v1) */
+int available_cpus();
+
+/* NUMA nodes with CPUs this process may run on, read from sysfs */
+class NumaTopology{
+public:
+    NumaTopology();
+    int nodes();
+    //Processing threads are split in contiguous blocks, one per node
+    int node_of(int thread_n, int threads);
+    //Pins the calling thread to the CPUs of node
+    bool pin_to_node(int node);
+private:
+    std::vector<cpu_set_t> node_cpus;
+};
+
+/* Copies the records of a queue into arena and points them to the copy. Run
+by a processing thread pinned to a node, the arena is first touched, and so
+allocated, on that node. */
+void localize_records(std::vector<FQEntry*>* queue, long last_index, std::vector<char> &arena);
+
+#endif
@@ -0,0 +1,91 @@
+#include "trace.h"
+
+#ifdef SICKLE_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <fstream>
+
+using namespace std;
+
+static bool enabled = false;
+static chrono::steady_clock::time_point trace_origin;
+//rings by tid, only locked when a thread registers
+static mutex rings_lock;
+static map<int, TraceRing*> rings;
+static thread_local TraceRing* current_ring = NULL;
+
+TraceRing::TraceRing(int tid, std::string name){
+    this->tid = tid;
+    this->name = name;
+    next = 0;
+}
+
+void TraceRing::add(const char* name, char phase, long batch, int64_t ns){
+    TraceEvent event = {name, phase, batch, ns};
+    if(events.size() < TRACE_RING_EVENTS){
+        events.push_back(event);
+    }else{
+        events[next % TRACE_RING_EVENTS] = event;
+    }
+    next++;
+}
+
+void trace_start(){
+    trace_origin = chrono::steady_clock::now();
+    enabled = true;
+}
+
+void trace_thread(int tid, const char* role, long n){
+    if(!enabled) return;
+    lock_guard<mutex> guard(rings_lock);
+    TraceRing* &ring = rings[tid];
+    if(!ring){
+        string name = role;
+        if(n >= 0) name += " " + to_string(n);
+        ring = new TraceRing(tid, name);
+    }
+    current_ring = ring;
+}
+
+void trace_event(const char* name, char phase, long batch){
+    if(!current_ring) return;
+    int64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - trace_origin).count();
+    current_ring->add(name, phase, batch, ns);
+}
+
+int trace_write(const char* path){
+    lock_guard<mutex> guard(rings_lock);
+    ofstream out(path);
+    if(!out){
+        fprintf(stderr, "****Error: Could not open trace output file '%s'.\n\n", path);
+        return EXIT_FAILURE;
+    }
+    char line[256];
+    bool first = true;
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for(auto &item: rings){
+        TraceRing* ring = item.second;
+        snprintf(line, sizeof(line), "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+            "\"args\": {\"name\": \"%s\"}}", ring->tid, ring->name.c_str());
+        out << (first ? "\n" : ",\n") << line;
+        first = false;
+        //after wrapping around, the oldest event is the next one to be overwritten
+        size_t start = ring->next > ring->events.size() ? ring->next % TRACE_RING_EVENTS : 0;
+        for(size_t i = 0; i < ring->events.size(); i++){
+            TraceEvent &event = ring->events[(start + i) % ring->events.size()];
+            int len = snprintf(line, sizeof(line), ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f",
+                event.name, event.phase, ring->tid, event.ns / 1000.0);
+            if(event.batch >= 0) snprintf(line + len, sizeof(line) - len, ", \"args\": {\"batch\": %ld}}", event.batch);
+            else snprintf(line + len, sizeof(line) - len, "}");
+            out << line;
+        }
+    }
+    out << "\n]}\n";
+    return 0;
+}
+
+#endif
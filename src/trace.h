@@ -0,0 +1,69 @@
+#ifndef _TRACE_
+#define _TRACE_
+
+/* Begin/end events of the batch pipeline, written as a Chrome trace (open it
+in chrome://tracing or ui.perfetto.dev) with --trace FILE. They are only
+compiled in with `make TRACE=1`, which defines SICKLE_TRACE; otherwise the
+TRACE_ macros are empty and the functions do nothing. */
+
+/* Events kept per thread, the oldest ones are overwritten when it is full */
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS 65536
+#endif
+
+/* Trace thread ids; the worker trimming part n of a batch is
+TRACE_TID_WORKER + n and the one formatting and writing batch n is
+TRACE_TID_OUTPUT + n */
+#define TRACE_TID_MAIN 0
+#define TRACE_TID_WORKER 1
+#define TRACE_TID_OUTPUT 100000
+
+#ifdef SICKLE_TRACE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TraceEvent{
+    //always a string literal, so only the pointer is stored
+    const char* name;
+    char phase;
+    long batch;
+    int64_t ns;
+};
+
+/* Events of one trace thread. Only the thread that registered it writes to
+it, and it is read after all threads are joined, so it needs no lock. */
+class TraceRing{
+public:
+    TraceRing(int tid, std::string name);
+    void add(const char* name, char phase, long batch, int64_t ns);
+    int tid;
+    std::string name;
+    std::vector<TraceEvent> events;
+    //total events added, the next one goes to next % TRACE_RING_EVENTS
+    uint64_t next;
+};
+
+void trace_start();
+//Makes the calling thread write to the ring of tid, named "role n" (or "role" if n < 0)
+void trace_thread(int tid, const char* role, long n);
+void trace_event(const char* name, char phase, long batch);
+int trace_write(const char* path);
+
+#define TRACE_THREAD(tid, role, n) trace_thread(tid, role, n)
+#define TRACE_BEGIN(name, batch) trace_event(name, 'B', batch)
+#define TRACE_END(name, batch) trace_event(name, 'E', batch)
+
+#else
+
+inline void trace_start(){}
+inline int trace_write(const char* path){ return 0; }
+
+#define TRACE_THREAD(tid, role, n)
+#define TRACE_BEGIN(name, batch)
+#define TRACE_END(name, batch)
+
+#endif
+
+#endif
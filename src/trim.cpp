@@ -1,4 +1,749 @@
+#include <algorithm>
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
 #include "trim.h"
+#include "filters.h"
+
+Abstract_Trimmer::Abstract_Trimmer(){
+	adapters = new AdapterMatcher(DEFAULT_ADAPTER_MISMATCHES, DEFAULT_ADAPTER_MIN_OVERLAP);
+	polyx = new PolyXMatcher(DEFAULT_POLYX_MIN_LEN, DEFAULT_POLYX_MISMATCHES);
+	max_ee = -1;
+	max_dust = -1;
+	qual_bin = NULL;
+	qc_fn = NULL;
+	qc_mates = 0;
+	stats_fn = NULL;
+	stats_per_batch = 0;
+	stats = NULL;
+	trace_fn = NULL;
+	show_progress = 0;
+	progress = NULL;
+	max_memory = 0;
+	budget = NULL;
+	max_batch_len = 0;
+	use_numa = 0;
+	topology = NULL;
+	hugepages = 0;
+	pool = NULL;
+	workers = NULL;
+	shared = false;
+	sharing = 1;
+	usage_throws = false;
+	split_reads = 0;
+	split_parts = 0;
+	splitter = NULL;
+	follow = 0;
+	follow_sentinel = NULL;
+	follow_timeout = DEFAULT_FOLLOW_TIMEOUT;
+	checkpoint_fn = NULL;
+	checkpoint_interval = DEFAULT_CHECKPOINT_INTERVAL;
+	resume = 0;
+	resume_point = NULL;
+	binary_output = 0;
+	failed = false;
+}
+
+Abstract_Trimmer::~Abstract_Trimmer(){
+	delete(adapters);
+	delete(polyx);
+	delete(qual_bin);
+	for (size_t i = 0; i < qc_reports.size(); i++) delete(qc_reports[i]);
+	free(qc_fn);
+	free(stats_fn);
+	delete(stats);
+	free(trace_fn);
+	delete(progress);
+	delete(topology);
+	delete(splitter);
+	free(follow_sentinel);
+	free(checkpoint_fn);
+	delete(resume_point);
+	free(outfn);
+	if (!shared) {
+		delete(budget);
+		delete(pool);
+	}
+}
+
+void Abstract_Trimmer::share(BufferPool* pool, MemoryBudget* budget, WorkerPool* workers, int samples){
+	this->pool = pool;
+	this->budget = budget;
+	this->workers = workers;
+	shared = true;
+	sharing = samples;
+}
+
+void Abstract_Trimmer::throw_on_usage(){
+	usage_throws = true;
+}
+
+void Abstract_Trimmer::usage_exit(int status){
+	if (usage_throws) throw UsageError{status};
+	exit(status);
+}
+
+ProgressReporter* Abstract_Trimmer::track_progress(){
+	if (!progress) progress = new ProgressReporter(PROGRESS_INTERVAL, false);
+	return progress;
+}
+
+void Abstract_Trimmer::counts(long &records, long &kept, long &discarded){
+	records = total;
+	kept = this->kept;
+	discarded = discard;
+}
+
+int Abstract_Trimmer::parse_common_arg(int optc, char *optarg){
+	/* Returns 0 if the option was handled, -1 if it is not a common option */
+	switch (optc) {
+	case 'A':
+		adapters->add_adapter(optarg);
+		return 0;
+
+	case ADAPTER_MISMATCHES_OPTION:
+		adapters->max_mismatches = atoi(optarg);
+		if (adapters->max_mismatches < 0) {
+			fprintf(stderr, "Adapter mismatches must be >= 0\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case ADAPTER_OVERLAP_OPTION:
+		adapters->min_overlap = atoi(optarg);
+		if (adapters->min_overlap < 1) {
+			fprintf(stderr, "Adapter minimum overlap must be >= 1\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case 'G':
+		polyx->add_bases("G");
+		return 0;
+
+	case POLY_X_OPTION:
+		if (strspn(optarg, "ACGTacgt") != strlen(optarg)) {
+			fprintf(stderr, "Poly-X bases must be some of A, C, G and T\n");
+			return EXIT_FAILURE;
+		}
+		polyx->add_bases(optarg);
+		return 0;
+
+	case POLY_MIN_LEN_OPTION:
+		polyx->min_len = atoi(optarg);
+		if (polyx->min_len < 1) {
+			fprintf(stderr, "Poly-X minimum length must be >= 1\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case POLY_MISMATCHES_OPTION:
+		polyx->max_mismatches = atoi(optarg);
+		if (polyx->max_mismatches < 0) {
+			fprintf(stderr, "Poly-X mismatches must be >= 0\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case MAX_EE_OPTION:
+		max_ee = atof(optarg);
+		if (max_ee < 0) {
+			fprintf(stderr, "Maximum expected errors must be >= 0\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case MAX_DUST_OPTION:
+		max_dust = atof(optarg);
+		if (max_dust < 0) {
+			fprintf(stderr, "Maximum DUST score must be >= 0\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case QC_JSON_OPTION:
+		qc_fn = (char *) malloc(strlen(optarg) + 1);
+		strcpy(qc_fn, optarg);
+		return 0;
+
+	case STATS_JSON_OPTION:
+		stats_fn = (char *) malloc(strlen(optarg) + 1);
+		strcpy(stats_fn, optarg);
+		return 0;
+
+	case STATS_PER_BATCH_OPTION:
+		stats_per_batch = 1;
+		return 0;
+
+	case MAX_MEMORY_OPTION:
+		max_memory = parse_memory_size(optarg);
+		if (max_memory == 0) {
+			fprintf(stderr, "Maximum memory '%s' is not valid, use a size as 512M or 4G\n", optarg);
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case NUMA_OPTION:
+		use_numa = 1;
+		return 0;
+
+	case HUGEPAGES_OPTION:
+		hugepages = 1;
+		return 0;
+
+	case PROGRESS_OPTION:
+		show_progress = 1;
+		return 0;
+
+	case SPLIT_READS_OPTION:
+		split_reads = atol(optarg);
+		if (split_reads < 1) {
+			fprintf(stderr, "Reads of each chunk must be >= 1\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case SPLIT_PARTS_OPTION:
+		split_parts = atoi(optarg);
+		if (split_parts < 1) {
+			fprintf(stderr, "Number of chunks must be >= 1\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case FOLLOW_OPTION:
+		follow = 1;
+		return 0;
+
+	case FOLLOW_SENTINEL_OPTION:
+		follow_sentinel = (char *) malloc(strlen(optarg) + 1);
+		strcpy(follow_sentinel, optarg);
+		return 0;
+
+	case FOLLOW_TIMEOUT_OPTION:
+		follow_timeout = atoi(optarg);
+		if (follow_timeout < 0) {
+			fprintf(stderr, "Follow timeout must be >= 0\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case CHECKPOINT_OPTION:
+		checkpoint_fn = (char *) malloc(strlen(optarg) + 1);
+		strcpy(checkpoint_fn, optarg);
+		return 0;
+
+	case CHECKPOINT_INTERVAL_OPTION:
+		checkpoint_interval = atoi(optarg);
+		if (checkpoint_interval < 0) {
+			fprintf(stderr, "Checkpoint interval must be >= 0\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case RESUME_OPTION:
+		resume = 1;
+		return 0;
+
+	case BINARY_OPTION:
+		binary_output = 1;
+		return 0;
+
+	case QUAL_BIN_OPTION:
+		delete(qual_bin);
+		qual_bin = new QualityBinner();
+		if (!qual_bin->parse(optarg)) {
+			fprintf(stderr, "Quality binning must be illumina8 or custom: and ranges of scores, as custom:0-19=10,20-93=30\n");
+			return EXIT_FAILURE;
+		}
+		return 0;
+
+	case TRACE_OPTION:
+#ifdef SICKLE_TRACE
+		trace_fn = (char *) malloc(strlen(optarg) + 1);
+		strcpy(trace_fn, optarg);
+		return 0;
+#else
+		fprintf(stderr, "--trace needs a build with tracing: make TRACE=1\n");
+		return EXIT_FAILURE;
+#endif
+
+	default:
+		return -1;
+	}
+}
+
+void Abstract_Trimmer::common_usage(){
+	fprintf(stderr, "-A, --adapter, Adapter sequence to remove from the 3' end of reads, before quality trimming.\n\
+\tCan be given more than once.\n\
+--adapter-mismatches, Maximum mismatches in a full length adapter match. Default %d.\n\
+--adapter-min-overlap, Minimum adapter bases at the read end to be trimmed. Default %d.\n",
+		DEFAULT_ADAPTER_MISMATCHES, DEFAULT_ADAPTER_MIN_OVERLAP);
+	fprintf(stderr, "-G, --poly-g, Trim poly-G tails (two-colour chemistry, as NovaSeq and NextSeq).\n\
+--poly-x, Bases of other homopolymer tails to trim, as in --poly-x AT.\n\
+--poly-min-len, Minimum length of a homopolymer tail to trim it. Default %d.\n\
+--poly-mismatches, Other bases allowed in a homopolymer tail. Default %d.\n",
+		DEFAULT_POLYX_MIN_LEN, DEFAULT_POLYX_MISMATCHES);
+	fprintf(stderr, "--max-ee, Discard reads with more expected errors (sum of the error probabilities\n\
+\tof the bases kept after trimming) than this. Default: no limit.\n\
+--max-dust, Discard low complexity reads, with a DUST score (0 to 100) of the bases kept\n\
+\tafter trimming bigger than this. 7 is a common choice. Default: no limit.\n\
+--qc-json, Write quality, base composition and length statistics of the reads,\n\
+\tbefore and after trimming, to this JSON file.\n\
+--stats-json, Write the time spent reading, parsing, trimming, formatting, compressing and\n\
+\twriting, the throughput, wait times and peak memory of the run to this JSON file.\n\
+--stats-per-batch, Also write the stats of each batch to the --stats-json file.\n\
+--trace, Write the begin and end of the stages of each batch, in every thread, to this\n\
+\tChrome trace JSON file. Needs a build with make TRACE=1.\n\
+--progress, Print the reads/s, input MB/s, kept and discarded reads and ETA every %d seconds to stderr.\n\
+--max-memory, Maximum memory of the batches being processed, as 512M or 4G (plain numbers are MB).\n\
+\tReading waits while it is used up, and -b becomes the biggest batch, adapted to the throughput.\n\
+--numa, Pin the processing threads to NUMA nodes and copy the reads of each one to memory of its node.\n\
+\tIgnored on machines with a single node.\n\
+--hugepages, Back the input and output blocks of the batches with huge pages, reserved ones if there are\n\
+\tany or else transparent ones, for less page faults and TLB misses with big batches.\n\
+--split-reads, Write each output as chunks of this many kept reads (pairs with pe), numbered as out_001.fq,\n\
+\tout_002.fq... Chunk n of -o, -p and -s come from the same input reads.\n\
+--split-parts, Write each output as this many chunks, with the reads (or pairs) going round robin to them.\n\
+\tWith -g the chunks are compressed at once, each in its own thread.\n\
+--follow, Trim an input that is still being written (the last file with several): at its end, wait for\n\
+\tmore records instead of stopping, and trim them as they come, in batches of up to %d MB.\n\
+--follow-sentinel, With --follow, the input is done once this file exists.\n\
+--follow-timeout, With --follow, the input is done after this many seconds without new data\n\
+\t(0 waits for the sentinel only). Default %d.\n",
+		PROGRESS_INTERVAL, FOLLOW_BATCH_LEN / (1024*1024), DEFAULT_FOLLOW_TIMEOUT);
+	fprintf(stderr, "--checkpoint, Save where the inputs and outputs are, and the counts, to this file every\n\
+\t--checkpoint-interval seconds, once a batch is written whole. It is removed when the run is done.\n\
+--checkpoint-interval, Seconds between checkpoints (0 saves one after every batch). Default %d.\n\
+--resume, Go on from the --checkpoint of a run that was stopped: its outputs are cut back to the\n\
+\tcheckpoint and the inputs read from there. Without a checkpoint file the run starts from the beginning.\n\
+--binary, Write the outputs in the binary format of sickle (2-bit bases, N runs and the qualities, in blocks),\n\
+\tfor tools downstream. Inputs in this format (or gzipped) are detected and accepted wherever FASTQ is.\n\
+--qual-bin, Bin the qualities of the kept reads in the outputs, after trimming with their own values: illumina8\n\
+\t(the 8 levels of Illumina) or custom: and ranges of scores with their bin, as custom:0-19=10,20-93=30.\n",
+		DEFAULT_CHECKPOINT_INTERVAL);
+}
+
+int Abstract_Trimmer::check_follow(){
+	if (!follow && (follow_sentinel || follow_timeout != DEFAULT_FOLLOW_TIMEOUT)) {
+		fprintf(stderr, "****Error: --follow-sentinel and --follow-timeout need --follow.\n\n");
+		return EXIT_FAILURE;
+	}
+	if (follow && !follow_sentinel && follow_timeout == 0) {
+		fprintf(stderr, "****Error: --follow with --follow-timeout 0 needs a --follow-sentinel to end.\n\n");
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+int Abstract_Trimmer::check_checkpoint(){
+	if (!checkpoint_fn && (resume || checkpoint_interval != DEFAULT_CHECKPOINT_INTERVAL)) {
+		fprintf(stderr, "****Error: --resume and --checkpoint-interval need --checkpoint.\n\n");
+		return EXIT_FAILURE;
+	}
+	if (checkpoint_fn && (split_reads || split_parts)) {
+		//the chunks are opened and closed as the run goes
+		fprintf(stderr, "****Error: --checkpoint can't be used with --split-reads or --split-parts.\n\n");
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+int Abstract_Trimmer::load_checkpoint(){
+	last_checkpoint = std::chrono::steady_clock::now();
+	if (!resume) return 0;
+	if (access(checkpoint_fn, F_OK) != 0) {
+		if (!quiet) fprintf(stdout, "No checkpoint in '%s', starting from the beginning.\n", checkpoint_fn);
+		resume = 0;
+		return 0;
+	}
+	resume_point = new Checkpoint();
+	if (read_checkpoint(checkpoint_fn, *resume_point) != 0) return EXIT_FAILURE;
+	restore_counters(resume_point->counters);
+	std::map<std::string, long>::const_iterator detected = resume_point->counters.find("qualtype");
+	//the records after the checkpoint may not be enough to tell it again
+	if (qualtype == QUALTYPE_AUTO && detected != resume_point->counters.end()) qualtype = detected->second;
+	if (qc_fn) fprintf(stderr, "Warning: The --qc-json report only has the reads trimmed since the checkpoint.\n");
+	if (!quiet) fprintf(stdout, "Resuming from '%s', after %ld records.\n", checkpoint_fn, resume_point->records);
+	return 0;
+}
+
+int Abstract_Trimmer::resume_input(GZReader* reader, size_t n){
+	if (!resume_point) return 0;
+	if (n >= resume_point->inputs.size() || !reader->seek(resume_point->inputs[n].file, resume_point->inputs[n].offset)) {
+		fprintf(stderr, "****Error: Could not resume '%s' from checkpoint '%s'.\n\n", reader->path, checkpoint_fn);
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+int Abstract_Trimmer::open_output(const char* path, std::ofstream &file, gzFile &gz_file){
+	size_t n = checkpoint_outputs.size();
+	if (resume_point) {
+		//what was written after the checkpoint is written again
+		if (n >= resume_point->outputs.size() || resume_point->outputs[n].path != path) {
+			fprintf(stderr, "****Error: Checkpoint '%s' is of other outputs than '%s'.\n\n", checkpoint_fn, path);
+			return EXIT_FAILURE;
+		}
+		//an output shorter than at the checkpoint lost what the counters say was written
+		if (file_size(path) < (int64_t)resume_point->outputs[n].size) {
+			fprintf(stderr, "****Error: Output '%s' is shorter than at checkpoint '%s'.\n\n", path, checkpoint_fn);
+			return EXIT_FAILURE;
+		}
+		if (truncate(path, resume_point->outputs[n].size) != 0) return EXIT_FAILURE;
+	}
+	//a resumed output has its header already
+	std::string_view header = binary_output && !resume_point ? sqb_file_header() : std::string_view();
+	if (!gzip_output) {
+		file.open(path, resume_point ? std::ios::app : std::ios::out);
+		if (file.fail()) return EXIT_FAILURE;
+		file.write(header.data(), header.length());
+		if (file.fail()) return EXIT_FAILURE;
+	} else {
+		//with -g each checkpoint ends a gzip member, which the next one appends to
+		gz_file = gzopen(path, resume_point ? "ab" : "w");
+		if (!gz_file) return EXIT_FAILURE;
+		if (!header.empty() && gzwrite_str(gz_file, header) != (int)header.length()) return EXIT_FAILURE;
+	}
+	if (checkpoint_fn) checkpoint_outputs.push_back({path, &file, &gz_file});
+	return 0;
+}
+
+void Abstract_Trimmer::write_output(const char* path, std::ofstream &file, gzFile gz_file, std::string_view text){
+	bool written;
+	if (!gzip_output) {
+		file.write(text.data(), text.length());
+		written = !file.fail();
+	} else {
+		written = text.empty() || gzwrite_str(gz_file, text) == (int)text.length();
+	}
+	if (!written) {
+		fprintf(stderr, "****Error: Could not write to output file '%s'.\n\n", path);
+		throw TrimError{EXIT_FAILURE};
+	}
+}
+
+int Abstract_Trimmer::close_output(const char* path, std::ofstream &file, gzFile &gz_file){
+	bool closed = true;
+	if (file.is_open()) {
+		file.close();
+		closed = !file.fail();
+	}
+	if (gz_file) {
+		closed = gzclose(gz_file) == Z_OK;
+		gz_file = NULL;
+	}
+	if (!closed) {
+		//a failed write said so already
+		if (!failed) fprintf(stderr, "****Error: Could not write to output file '%s'.\n\n", path);
+		return EXIT_FAILURE;
+	}
+	return 0;
+}
+
+void Abstract_Trimmer::save_checkpoint(const std::vector<InputPosition> &inputs){
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - last_checkpoint < std::chrono::seconds(checkpoint_interval)) return;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		//the batch ends where the reader can't say, the next one will do
+		if (inputs[i].offset < 0) return;
+	}
+	Checkpoint point;
+	long kept_reads, discarded_reads;
+	counts(point.records, kept_reads, discarded_reads);
+	point.inputs = inputs;
+	for (size_t i = 0; i < checkpoint_outputs.size(); i++) {
+		CheckpointOutput &output = checkpoint_outputs[i];
+		bool flushed;
+		if (!gzip_output) {
+			flushed = !output.file->flush().fail();
+		} else {
+			//ends the gzip member, the next write starts a new one
+			flushed = gzflush(*output.gz_file, Z_FINISH) == Z_OK;
+		}
+		//the sizes must be on disk before a checkpoint says so; the next batch tries again
+		if (!flushed || !sync_file(output.path)) {
+			fprintf(stderr, "Warning: Could not flush output '%s' to disk, no checkpoint saved.\n", output.path);
+			return;
+		}
+		point.outputs.push_back({output.path, (uint64_t)file_size(output.path)});
+	}
+	save_counters(point.counters);
+	point.counters["qualtype"] = qualtype;
+	//a checkpoint that can't be written leaves the last one, the run goes on
+	write_checkpoint(checkpoint_fn, point);
+	last_checkpoint = now;
+}
+
+void Abstract_Trimmer::finish_checkpoint(){
+	if (checkpoint_fn) unlink(checkpoint_fn);
+}
+
+void Abstract_Trimmer::save_counters(std::map<std::string, long> &counters){
+	counters["kept"] = kept;
+	counters["discard"] = discard;
+}
+
+void Abstract_Trimmer::restore_counters(const std::map<std::string, long> &counters){
+	std::map<std::string, long>::const_iterator it;
+	if ((it = counters.find("kept")) != counters.end()) kept = it->second;
+	if ((it = counters.find("discard")) != counters.end()) discard = it->second;
+	total = kept + discard;
+}
+
+int Abstract_Trimmer::init_splitter(){
+	if (!split_reads && !split_parts) return 0;
+	if (binary_output) {
+		//the chunks are cut between records, not between blocks
+		fprintf(stderr, "****Error: --binary can't be used with --split-reads or --split-parts.\n\n");
+		return EXIT_FAILURE;
+	}
+	if (split_reads && split_parts) {
+		fprintf(stderr, "****Error: --split-reads and --split-parts can't be used together.\n\n");
+		return EXIT_FAILURE;
+	}
+	splitter = new OutputSplitter(split_reads, split_parts, gzip_output);
+	return 0;
+}
+
+void Abstract_Trimmer::init_budget(int inputs){
+	/* inputs is the number of files read for each batch, each of batch_len */
+	if (max_memory == 0) return;
+	if (!budget) budget = new MemoryBudget(max_memory);
+	uint64_t max_len = max_memory / ((uint64_t)BATCH_MEMORY_FACTOR * BATCHES_IN_MEMORY * inputs * sharing);
+	max_batch_len = (int)std::min(max_len, (uint64_t)batch_len);
+	if (max_batch_len < 1) max_batch_len = 1;
+	batch_len = std::min(batch_len, std::max(max_batch_len / 4, std::min(max_batch_len, MIN_ADAPTIVE_BATCH_LEN)));
+}
+
+void Abstract_Trimmer::adapt_batch_len(uint64_t text_bytes, double seconds){
+	/* the next batch takes about BATCH_TARGET_SECONDS at the throughput of the last one */
+	//a budget shared without --max-memory has no max_batch_len to stay under
+	if (!budget || max_batch_len == 0 || seconds <= 0) return;
+	double target = text_bytes / seconds * BATCH_TARGET_SECONDS;
+	//changes of more than twice at once would follow the noise of a single batch
+	target = std::max(std::min(target, 2.0 * batch_len), 0.5 * batch_len);
+	batch_len = (int)std::max(std::min(target, (double)max_batch_len), (double)std::min(max_batch_len, MIN_ADAPTIVE_BATCH_LEN));
+}
+
+void Abstract_Trimmer::init_numa(){
+	if (!use_numa) return;
+	topology = new NumaTopology();
+	if (topology->nodes() < NUMA_MIN_NODES) {
+		msg("Not enough NUMA nodes, --numa is ignored");
+		delete(topology);
+		topology = NULL;
+		return;
+	}
+	numa_arenas.resize(NUMA_ARENAS * threads * 2);
+}
+
+void Abstract_Trimmer::localize_queue(int thread_n, int mate, long batch_n, std::vector<FQEntry*>* queue, long last_index){
+	/* The reads of the batch were allocated by the reading thread, so the
+	workers, pinned to the node of their part, work on local copies. Each
+	part always runs on the same node, so its arenas stay there. */
+	if (!topology) return;
+	if (mate == 0) topology->pin_to_node(topology->node_of(thread_n, threads));
+	size_t arena = ((batch_n % NUMA_ARENAS) * threads + thread_n) * 2 + mate;
+	localize_records(queue, last_index, numa_arenas[arena]);
+}
+
+void Abstract_Trimmer::append_read(OutputBuffer &out, FQEntry* read, cutsites* cs){
+	int len = cs->three_prime_cut - cs->five_prime_cut;
+	if (binary_output) {
+		sqb_append_record(out, read->name, read->seq.substr(cs->five_prime_cut, len), read->qual.substr(cs->five_prime_cut, len));
+		//the qualities end the record
+		if (qual_bin) qual_bin->apply(out.data() + out.length() - len, len);
+		return;
+	}
+	out.append(read->name);
+	out.append('\n');
+	out.append(read->seq.substr(cs->five_prime_cut, len));
+	out.append('\n');
+	out.append(read->comment);
+	out.append('\n');
+	out.append(read->qual.substr(cs->five_prime_cut, len));
+	if (qual_bin) qual_bin->apply(out.data() + out.length() - len, len);
+	out.append('\n');
+}
+
+void Abstract_Trimmer::prepare_filters(){
+	/* the lookup tables depend on the quality type */
+	if (qualtype == QUALTYPE_AUTO) return;
+	build_error_table(error_table, qualtype);
+	if (qual_bin) qual_bin->build(qualtype);
+}
+
+TrimConfig Abstract_Trimmer::trim_config(){
+	TrimConfig config;
+	config.qualtype = qualtype;
+	config.qual_threshold = qual_threshold;
+	config.length_threshold = length_threshold;
+	config.no_fiveprime = no_fiveprime;
+	config.trunc_n = trunc_n;
+	config.adapters = adapters->sequences();
+	config.adapter_mismatches = adapters->max_mismatches;
+	config.adapter_min_overlap = adapters->min_overlap;
+	config.polyx_bases = polyx->tail_bases();
+	config.polyx_min_len = polyx->min_len;
+	config.polyx_mismatches = polyx->max_mismatches;
+	config.max_ee = max_ee;
+	config.max_dust = max_dust;
+	config.debug = debug;
+	return config;
+}
+
+void Abstract_Trimmer::start_run(int qualtype){
+	if (this->qualtype == QUALTYPE_AUTO && !quiet) fprintf(stdout, "Detected quality type: %s\n", typenames[qualtype]);
+	this->qualtype = qualtype;
+	prepare_filters();
+}
+
+void Abstract_Trimmer::collect_part(RecordBatch* batch, int part){
+	if (!qc_fn && !progress) return;
+	long reads = 0, discarded = 0;
+	for (int mate = 0; mate < batch->mates; mate++) {
+		RecordArrays* records = batch->records[mate];
+		std::vector<FQEntry*> &queue = *records->queues[part];
+		for (size_t j = 0; j < queue.size(); j++) {
+			if (qc_fn) collect_qc(part, mate, *queue[j], records->cuts[part][j]);
+			if (records->filtered[part][j]) discarded++;
+		}
+		reads += queue.size();
+	}
+	//mates are counted on their own, kept ones include those that go to the singles file
+	if (progress) progress->add(reads, reads - discarded, discarded);
+}
+
+void Abstract_Trimmer::localize_part(RecordBatch* batch, int part){
+	for (int mate = 0; mate < batch->mates; mate++) {
+		std::vector<FQEntry*>* queue = batch->records[mate]->queues[part];
+		localize_queue(part, mate, batch->n, queue, (long)queue->size() - 1);
+	}
+}
+
+void Abstract_Trimmer::release_batch(InputBatch* batch){
+	if (batch->stats) stats->finish_batch(batch->stats);
+	for (int mate = 0; mate < batch->mates; mate++) {
+		RecordArrays* records = batch->records[mate];
+		if (!records) continue;
+		for (int part = 0; part < batch->parts; part++) {
+			std::vector<FQEntry*> &queue = *records->queues[part];
+			for (size_t j = 0; j < queue.size(); j++) {
+				delete(queue[j]);
+				free(records->cuts[part][j]);
+			}
+		}
+		record_pool.put(records);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (!batch->text[i]) continue;
+		batch->text[i]->free_this();
+		delete(batch->text[i]);
+	}
+	uint64_t memory = batch->memory;
+	//with the output of the batch
+	delete(batch);
+	if (budget) budget->release(memory);
+}
+
+void Abstract_Trimmer::init_qc(int mates){
+	if (!qc_fn) return;
+	qc_mates = mates;
+	for (int i = 0; i < threads * mates; i++) {
+		qc_reports.push_back(new QCReport());
+	}
+}
+
+void Abstract_Trimmer::collect_qc(int thread_n, int mate, FQEntry &fqrec, cutsites* cs){
+	QCReport* report = qc_reports[thread_n * qc_mates + mate];
+	int offset = quality_constants[qualtype][Q_OFFSET];
+	report->before.add(fqrec.seq, fqrec.qual, offset);
+	if (cs->three_prime_cut >= 0) {
+		int kept_len = cs->three_prime_cut - cs->five_prime_cut;
+		report->after.add(fqrec.seq.substr(cs->five_prime_cut, kept_len),
+			fqrec.qual.substr(cs->five_prime_cut, kept_len), offset);
+	}
+}
+
+int Abstract_Trimmer::write_qc(const char* const* mate_names){
+	std::ofstream qc_file(qc_fn);
+	if (!qc_file) {
+		fprintf(stderr, "****Error: Could not open QC output file '%s'.\n\n", qc_fn);
+		return EXIT_FAILURE;
+	}
+
+	qc_file << "{\n  \"qual_type\": \"" << (qualtype >= 0 ? typenames[qualtype] : "unknown") << "\"";
+	for (int mate = 0; mate < qc_mates; mate++) {
+		QCReport merged;
+		for (int thread_n = 0; thread_n < threads; thread_n++) {
+			merged.before.merge(qc_reports[thread_n * qc_mates + mate]->before);
+			merged.after.merge(qc_reports[thread_n * qc_mates + mate]->after);
+		}
+		qc_file << ",\n  \"" << mate_names[mate] << "\": {\n    \"before_trimming\": ";
+		merged.before.write_json(qc_file, "    ");
+		qc_file << ",\n    \"after_trimming\": ";
+		merged.after.write_json(qc_file, "    ");
+		qc_file << "\n  }";
+	}
+	qc_file << "\n}\n";
+	return 0;
+}
+
+int Abstract_Trimmer::clip_limit(FQEntry &fqrec, int max_len){
+	int limit = fqrec.seq.length();
+	if (max_len >= 0) limit = std::min(limit, max_len);
+	if (!polyx->empty()) limit = polyx->find(fqrec.seq.substr(0, limit));
+	if (!adapters->empty()) limit = std::min(limit, adapters->find(fqrec.seq.substr(0, limit)));
+	return limit;
+}
+
+static FQEntry clip_read(FQEntry &fqrec, int limit){
+	FQEntry clipped;
+	clipped.position = fqrec.position;
+	clipped.name = fqrec.name;
+	clipped.comment = fqrec.comment;
+	clipped.seq = fqrec.seq.substr(0, limit);
+	clipped.qual = fqrec.qual.substr(0, limit);
+	return clipped;
+}
+
+static cutsites* discarded_cuts(){
+	cutsites* retvals = (cutsites*) malloc (sizeof(cutsites));
+	retvals->three_prime_cut = -1;
+	retvals->five_prime_cut = -1;
+	return (retvals);
+}
+
+cutsites* Abstract_Trimmer::trim_read(FQEntry &fqrec, int max_len){
+	/* Cuts homopolymer tails and everything from the first adapter base (or
+	past max_len) before running the sliding window over what is left of the read */
+	int limit = clip_limit(fqrec, max_len);
+
+	cutsites* retvals;
+	if ((size_t)limit == fqrec.seq.length()) {
+		retvals = sliding_window(fqrec);
+	} else if (limit == 0 || limit < length_threshold) {
+		return discarded_cuts();
+	} else {
+		FQEntry clipped = clip_read(fqrec, limit);
+		retvals = sliding_window(clipped);
+	}
+	filter_kept(fqrec, retvals);
+	return (retvals);
+}
+
+void Abstract_Trimmer::filter_kept(FQEntry &fqrec, cutsites* retvals){
+	/* whole read filters, over the part of the read that would be kept */
+	if (retvals->three_prime_cut >= 0 && (max_ee >= 0 || max_dust >= 0)) {
+		int kept_len = retvals->three_prime_cut - retvals->five_prime_cut;
+		if ((max_ee >= 0 && expected_errors(fqrec.qual.substr(retvals->five_prime_cut, kept_len), error_table) > max_ee)
+			|| (max_dust >= 0 && dust_score(fqrec.seq.substr(retvals->five_prime_cut, kept_len)) > max_dust)) {
+			retvals->three_prime_cut = -1;
+			retvals->five_prime_cut = -1;
+		}
+	}
+}
 
 cutsites* Abstract_Trimmer::sliding_window(FQEntry &fqrec){
     //std::cout << "Starting sliding window\n";
@@ -14,16 +759,9 @@ cutsites* Abstract_Trimmer::sliding_window(FQEntry &fqrec){
 	int five_prime_cut = 0;
 	int found_five_prime = 0;
 	double window_avg;
-	cutsites* retvals;
-    size_t npos;
 
 	/* discard if the length of the sequence is less than the length threshold */
-    if (fqrec.seq.length() < (size_t)length_threshold) {
-		retvals = (cutsites*) malloc (sizeof(cutsites));
-		retvals->three_prime_cut = -1;
-		retvals->five_prime_cut = -1;
-		return (retvals);
-	}
+    if (fqrec.seq.length() < (size_t)length_threshold) return discarded_cuts();
 
 	/* if the seq length is less then 10bp, */
 	/* then make the window size the length of the seq */
@@ -80,6 +818,11 @@ cutsites* Abstract_Trimmer::sliding_window(FQEntry &fqrec){
 		window_start++;
 	}
 
+	return window_cuts(fqrec, found_five_prime, five_prime_cut, three_prime_cut);
+}
+
+cutsites* Abstract_Trimmer::window_cuts(FQEntry &fqrec, int found_five_prime, int five_prime_cut, int three_prime_cut){
+    size_t npos;
 
     /* If truncate N option is selected, and sequence has Ns, then */
     /* change 3' cut site to be the base before the first N */
@@ -109,12 +852,98 @@ cutsites* Abstract_Trimmer::sliding_window(FQEntry &fqrec){
 
     if (debug) printf ("\n\n");
 
-	retvals = (cutsites*) malloc (sizeof(cutsites));
+	cutsites* retvals = (cutsites*) malloc (sizeof(cutsites));
 	retvals->three_prime_cut = three_prime_cut;
 	retvals->five_prime_cut = five_prime_cut;
 	return (retvals);
 }
 
+void Abstract_Trimmer::scan_windows(FQEntry &fqrec, int window_size, long from, long to, WindowScan &scan){
+	long window_total = 0;
+	for (long i = from; i < from + window_size; i++) {
+		window_total += get_quality_num (fqrec.qual.at(i), fqrec, i);
+	}
+	scan = {-1, -1, -1};
+	for (long i = from; i < to; i++) {
+		double window_avg = (double)window_total / (double)window_size;
+		if (window_avg >= qual_threshold) {
+			if (scan.first_over < 0) scan.first_over = i;
+		} else {
+			if (scan.first_under < 0) scan.first_under = i;
+			if (scan.first_over >= 0 && scan.first_under_after_over < 0) scan.first_under_after_over = i;
+		}
+		if (scan.first_over >= 0 && scan.first_under >= 0 && scan.first_under_after_over >= 0) break;
+		window_total -= get_quality_num (fqrec.qual.at(i), fqrec, i);
+		if ((size_t)(i+window_size) < fqrec.qual.length()) {
+			window_total += get_quality_num (fqrec.qual.at(i+window_size), fqrec, i+window_size);
+		}
+	}
+}
+
+void Abstract_Trimmer::prepare_split_scan(FQEntry &fqrec, int parts, SplitScan &split){
+	/* As trim_read: the window scan runs over the read up to its limit */
+	int limit = clip_limit(fqrec, -1);
+	split.read = &fqrec;
+	split.clipped = (size_t)limit == fqrec.seq.length() ? fqrec : clip_read(fqrec, limit);
+	split.discarded = limit == 0 || limit < length_threshold;
+	split.window_size = (int) (0.1 * limit);
+	if (split.window_size == 0) split.window_size = limit;
+	split.windows = split.discarded ? 0 : limit - split.window_size + 1;
+	split.scans.assign(parts, {-1, -1, -1});
+}
+
+void Abstract_Trimmer::scan_split_range(SplitScan &split, int part){
+	long parts = split.scans.size();
+	long from = split.windows * part / parts, to = split.windows * (part + 1) / parts;
+	if (from < to) scan_windows(split.clipped, split.window_size, from, to, split.scans[part]);
+}
+
+cutsites* Abstract_Trimmer::finish_split_scan(SplitScan &split){
+	/* The first window over the threshold (the 5' one) and the first under it
+	after that (the 3' one) are the same ones the sequential scan stops at */
+	if (split.discarded) return discarded_cuts();
+	FQEntry &fqrec = split.clipped;
+	long window_size = split.window_size;
+	int parts = split.scans.size();
+	std::vector<WindowScan> &scans = split.scans;
+	int three_prime_cut = fqrec.seq.length();
+	int five_prime_cut = 0;
+	int found_five_prime = 0;
+	long five_prime_window = -1, three_prime_window = -1;
+	for (int k = 0; k < parts && three_prime_window < 0; k++) {
+		if (no_fiveprime) {
+			three_prime_window = scans[k].first_under;
+		} else if (five_prime_window < 0) {
+			five_prime_window = scans[k].first_over;
+			three_prime_window = scans[k].first_under_after_over;
+		} else {
+			three_prime_window = scans[k].first_under;
+		}
+	}
+
+	if (five_prime_window >= 0) {
+		for (long j = five_prime_window; j < five_prime_window + window_size; j++) {
+			if (get_quality_num (fqrec.qual.at(j), fqrec, j) >= qual_threshold) {
+				five_prime_cut = j;
+				break;
+			}
+		}
+		found_five_prime = 1;
+	}
+	if (three_prime_window >= 0) {
+		for (long j = three_prime_window; j < three_prime_window + window_size; j++) {
+			if (get_quality_num (fqrec.qual.at(j), fqrec, j) < qual_threshold) {
+				three_prime_cut = j;
+				break;
+			}
+		}
+	}
+
+	cutsites* retvals = window_cuts(fqrec, found_five_prime, five_prime_cut, three_prime_cut);
+	filter_kept(*split.read, retvals);
+	return (retvals);
+}
+
 int Abstract_Trimmer::get_quality_num(char qualchar, FQEntry &fqrec, int pos){
   /*
      Return the adjusted quality, depending on quality type.
@@ -133,7 +962,7 @@ int Abstract_Trimmer::get_quality_num(char qualchar, FQEntry &fqrec, int pos){
 	fprintf (stderr, "Quality string: %s\n", string(fqrec.qual).c_str());
 	fprintf (stderr, "Quality char: '%c'\n", qualchar);
 	fprintf (stderr, "Quality position: %d\n", pos+1);
-	exit(1);
+	throw TrimError{EXIT_FAILURE};
   }
 
   return (qual_value - quality_constants[qualtype][Q_OFFSET]);
@@ -1,17 +1,171 @@
 #ifndef _TRIM_
 #define _TRIM_
 
+#include <chrono>
 #include <fstream>
+#include <map>
+#include <string>
+#include <vector>
 #include "FQEntry.h"
 #include "GZReader.h"
+#include "adapter.h"
+#include "polyx.h"
+#include "qc.h"
+#include "stats.h"
+#include "trace.h"
+#include "progress.h"
+#include "memory.h"
+#include "topology.h"
+#include "split.h"
+#include "checkpoint.h"
+#include "binary.h"
+#include "qualbin.h"
+#include "libsickle.h"
+
+/* With --long-reads, reads of at least this many bases have their window
+scan split between the processing threads */
+#ifndef LONG_READ_SPLIT_BASES
+#define LONG_READ_SPLIT_BASES 100000
+#endif
+
+/* With --follow, seconds without new data after which the input is done,
+and the biggest batch, so the reads are trimmed soon after they are written */
+#ifndef DEFAULT_FOLLOW_TIMEOUT
+#define DEFAULT_FOLLOW_TIMEOUT 600
+#endif
+#ifndef FOLLOW_BATCH_LEN
+#define FOLLOW_BATCH_LEN (16*1024*1024)
+#endif
+
+/* First windows of a range of window starts with an average quality at or
+over the threshold, under it, and under it after the first one over it, or -1 */
+struct WindowScan{
+    long first_over;
+    long first_under;
+    long first_under_after_over;
+};
+
+/* A read of --long-reads whose window scan is split between the processing
+threads: prepared by the thread that has it, each thread scans one range of
+its window starts, then that thread combines the ranges into its cuts */
+struct SplitScan{
+    FQEntry* read;
+    //the read up to its homopolymer tail or adapter, as trim_read scans it
+    FQEntry clipped;
+    //already too short to keep, nothing to scan
+    bool discarded;
+    int window_size;
+    long windows;
+    std::vector<WindowScan> scans;
+};
+
+/* A batch of se or pe from the input files, as the trimmers give it to
+their Pipeline: the text its reads point into and what its output needs */
+struct InputBatch: public RecordBatch{
+    //the text of each input, batch2 only for pe with two inputs
+    Batch* text[2] = {NULL, NULL};
+    //held in the --max-memory budget until the batch is released
+    uint64_t memory = 0;
+    uint64_t text_bytes = 0;
+    //when the batch started to be read, for adapt_batch_len
+    timepoint cycle_start;
+    //the inputs right after the batch, for its checkpoint
+    std::vector<InputPosition> positions;
+};
+
+/* An output of the run, as opened by open_output: one of file and
+gz_file is used, as gzip_output says */
+struct CheckpointOutput{
+    const char* path;
+    std::ofstream* file;
+    gzFile* gz_file;
+};
+
+/* Thrown by usage() instead of exiting when the options come from a sickle
+serve client, whose mistakes must not end the server */
+struct UsageError{
+    int status;
+};
 
 class Abstract_Trimmer{
 public:
+    Abstract_Trimmer();
+    virtual ~Abstract_Trimmer();
     virtual int parse_args(int argc, char *argv[]) = 0;
     virtual int trim_main() = 0;
     virtual void usage(int status, char const *msg) = 0;
+    //For the job runners: a pool, a budget (or NULL) and workers shared by the samples trimmed at once
+    void share(BufferPool* pool, MemoryBudget* budget, WorkerPool* workers, int samples);
+    //Records, kept and discarded reads of the run
+    virtual void counts(long &records, long &kept, long &discarded);
+    //For sickle serve: usage() throws UsageError rather than exiting
+    void throw_on_usage();
+    //For sickle serve: a reporter counting the run without printing, owned by the trimmer
+    ProgressReporter* track_progress();
 protected:
+    void usage_exit(int status);
+    cutsites* trim_read(FQEntry &fqrec, int max_len = -1);
     cutsites* sliding_window(FQEntry &fqrec);
+    void scan_windows(FQEntry &fqrec, int window_size, long from, long to, WindowScan &scan);
+    /* trim_read of a long read in three steps: prepare_split_scan by one
+    thread, scan_split_range for each of the parts (by any thread), then
+    finish_split_scan once they are all done */
+    void prepare_split_scan(FQEntry &fqrec, int parts, SplitScan &split);
+    void scan_split_range(SplitScan &split, int part);
+    cutsites* finish_split_scan(SplitScan &split);
+    //bases of fqrec the sliding window runs over: up to max_len, its homopolymer tail and its adapter
+    int clip_limit(FQEntry &fqrec, int max_len);
+    //cutsites of the windows found, after -n and the length threshold
+    cutsites* window_cuts(FQEntry &fqrec, int found_five_prime, int five_prime_cut, int three_prime_cut);
+    //discards a read the sliding window kept if it fails --max-ee or --max-dust
+    void filter_kept(FQEntry &fqrec, cutsites* retvals);
+    void prepare_filters();
+    //the trimming options of the run, for its Pipeline
+    TrimConfig trim_config();
+    /* What se and pe do the same as the source and sink of their Pipeline:
+    the quality type of the run, the QC and progress of a part, and
+    localizing a part with --numa, adapting batch_len and releasing a batch */
+    void start_run(int qualtype);
+    void collect_part(RecordBatch* batch, int part);
+    void localize_part(RecordBatch* batch, int part);
+    void adapt_batch(InputBatch* batch);
+    void release_batch(InputBatch* batch);
+    void init_budget(int inputs);
+    void adapt_batch_len(uint64_t text_bytes, double seconds);
+    void init_numa();
+    //the splitter of --split-reads or --split-parts, or 0 without them
+    int init_splitter();
+    //0 if the --follow options go together
+    int check_follow();
+    //0 if the --checkpoint options go together
+    int check_checkpoint();
+    //starts the checkpoint interval; with --resume, reads the checkpoint (if there is one yet) and restores the counters
+    int load_checkpoint();
+    //with --resume, seeks input n of the checkpoint
+    int resume_input(GZReader* reader, size_t n);
+    /* Opens the output path in file, or gz_file with -g. With --resume it is
+    first truncated to its size at the checkpoint and appended to. Returns
+    EXIT_FAILURE if it can't, the caller says which output. */
+    int open_output(const char* path, std::ofstream &file, gzFile &gz_file);
+    //writes text to an output of open_output; prints the error and throws TrimError if it can't take all of it
+    void write_output(const char* path, std::ofstream &file, gzFile gz_file, std::string_view text);
+    //closes an output of open_output, EXIT_FAILURE (and the error printed) if what it buffered couldn't be written
+    int close_output(const char* path, std::ofstream &file, gzFile &gz_file);
+    //after a batch is written whole, with the inputs right after it: a checkpoint once the interval is over
+    void save_checkpoint(const std::vector<InputPosition> &inputs);
+    //the run is done, its checkpoint is of no use any more
+    void finish_checkpoint();
+    //counters of the run saved in checkpoints, kept and discard unless the trimmer has others
+    virtual void save_counters(std::map<std::string, long> &counters);
+    virtual void restore_counters(const std::map<std::string, long> &counters);
+    void localize_queue(int thread_n, int mate, long batch_n, std::vector<FQEntry*>* queue, long last_index);
+    void append_read(OutputBuffer &out, FQEntry* read, cutsites* cs);
+    void init_qc(int mates);
+    void collect_qc(int thread_n, int mate, FQEntry &fqrec, cutsites* cs);
+    int write_qc(const char* const* mate_names);
+    int parse_common_arg(int optc, char *optarg);
+    void common_usage();
+    //throws TrimError for a char out of the range of qualtype
     int get_quality_num (char qualchar, FQEntry &fqrec, int pos);
     int qualtype;
     int length_threshold;
@@ -22,6 +176,73 @@ protected:
 
     int threads, batch_len;
 
+    AdapterMatcher* adapters;
+    PolyXMatcher* polyx;
+    float max_ee;
+    float error_table[256];
+    float max_dust;
+    //NULL unless --qual-bin was given
+    QualityBinner* qual_bin;
+
+    char *qc_fn;
+    int qc_mates;
+    //one report per processing thread and mate, only touched by that thread
+    std::vector<QCReport*> qc_reports;
+
+    char *stats_fn;
+    int stats_per_batch;
+    //NULL unless --stats-json was given
+    PipelineStats* stats;
+
+    char *trace_fn;
+
+    int show_progress;
+    //NULL unless --progress was given, or track_progress called
+    ProgressReporter* progress;
+
+    uint64_t max_memory;
+    //NULL unless --max-memory was given
+    MemoryBudget* budget;
+    //biggest batch_len for which BATCHES_IN_MEMORY batches fit in max_memory
+    int max_batch_len;
+
+    int use_numa;
+    //NULL unless --numa was given on a machine with NUMA_MIN_NODES nodes
+    NumaTopology* topology;
+    //NUMA_ARENAS for each processing thread and mate
+    std::vector<std::vector<char> > numa_arenas;
+
+    int hugepages;
+    //input and output blocks of the batches, for the whole run
+    BufferPool* pool;
+    //queues, filtered flags and cutsites given back as the batches are released
+    RecyclePool<RecordArrays> record_pool;
+    //NULL unless shared, for the Pipeline to start workers of its own
+    WorkerPool* workers;
+    //pool, budget and workers belong to the job runner, split between this many samples
+    bool shared;
+    int sharing;
+    bool usage_throws;
+
+    long split_reads;
+    int split_parts;
+    //NULL unless --split-reads or --split-parts was given
+    OutputSplitter* splitter;
+
+    int follow;
+    //NULL unless --follow-sentinel was given
+    char* follow_sentinel;
+    int follow_timeout;
+
+    //NULL unless --checkpoint was given
+    char* checkpoint_fn;
+    int checkpoint_interval;
+    int resume;
+    //NULL unless --resume found a checkpoint
+    Checkpoint* resume_point;
+    std::vector<CheckpointOutput> checkpoint_outputs;
+    std::chrono::steady_clock::time_point last_checkpoint;
+
     GZReader* input;
     std::ofstream outfile;
     gzFile outfile_gzip;
@@ -29,12 +250,16 @@ protected:
     char *infn;
     int quiet;
     int gzip_output;
+    //records in the format of binary.h instead of FASTQ
+    int binary_output;
 
     int kept;
     int discard;
     int total;
 
-    bool writing_results_flag;
+    /* the Pipeline of the run failed: trim_main leaves the outputs as they
+    are, and a write error it printed isn't printed again as they close */
+    bool failed;
 };
 
 #endif
\ No newline at end of file
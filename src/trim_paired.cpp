@@ -13,7 +13,7 @@
 #include "sickle.h"
 #include "trim_paired.h"
 
-static struct option paired_long_options[] = {
+struct option paired_long_options[] = {
     {"qual-type", required_argument, 0, 't'},
     {"pe-file1", required_argument, 0, 'f'},
     {"pe-file2", required_argument, 0, 'r'},
@@ -30,6 +30,34 @@ static struct option paired_long_options[] = {
     {"quiet", no_argument, 0, 'z'},
     {"threads", no_argument, 0, 'a'},
     {"batch", no_argument, 0, 'b'},
+    {"adapter", required_argument, 0, 'A'},
+    {"adapter-mismatches", required_argument, 0, ADAPTER_MISMATCHES_OPTION},
+    {"adapter-min-overlap", required_argument, 0, ADAPTER_OVERLAP_OPTION},
+    {"poly-g", no_argument, 0, 'G'},
+    {"poly-x", required_argument, 0, POLY_X_OPTION},
+    {"poly-min-len", required_argument, 0, POLY_MIN_LEN_OPTION},
+    {"poly-mismatches", required_argument, 0, POLY_MISMATCHES_OPTION},
+    {"max-ee", required_argument, 0, MAX_EE_OPTION},
+    {"max-dust", required_argument, 0, MAX_DUST_OPTION},
+    {"qc-json", required_argument, 0, QC_JSON_OPTION},
+    {"stats-json", required_argument, 0, STATS_JSON_OPTION},
+    {"stats-per-batch", no_argument, 0, STATS_PER_BATCH_OPTION},
+    {"trace", required_argument, 0, TRACE_OPTION},
+    {"progress", no_argument, 0, PROGRESS_OPTION},
+    {"max-memory", required_argument, 0, MAX_MEMORY_OPTION},
+    {"numa", no_argument, 0, NUMA_OPTION},
+    {"hugepages", no_argument, 0, HUGEPAGES_OPTION},
+    {"split-reads", required_argument, 0, SPLIT_READS_OPTION},
+    {"split-parts", required_argument, 0, SPLIT_PARTS_OPTION},
+    {"follow", no_argument, 0, FOLLOW_OPTION},
+    {"follow-sentinel", required_argument, 0, FOLLOW_SENTINEL_OPTION},
+    {"follow-timeout", required_argument, 0, FOLLOW_TIMEOUT_OPTION},
+    {"checkpoint", required_argument, 0, CHECKPOINT_OPTION},
+    {"checkpoint-interval", required_argument, 0, CHECKPOINT_INTERVAL_OPTION},
+    {"resume", no_argument, 0, RESUME_OPTION},
+    {"binary", no_argument, 0, BINARY_OPTION},
+    {"qual-bin", required_argument, 0, QUAL_BIN_OPTION},
+    {"detect-overlap", no_argument, 0, DETECT_OVERLAP_OPTION},
     {GETOPT_HELP_OPTION_DECL},
     {GETOPT_VERSION_OPTION_DECL},
     {NULL, 0, NULL, 0}
@@ -47,6 +75,7 @@ Usage: %s pe [options] -c <interleaved input file> -t <quality type> -m <interle
 Paired-end separated reads\n\
 --------------------------\n\
 -f, --pe-file1, Input paired-end forward fastq file (Input files must have same number of records)\n\
+\tSeveral files, separated by commas, or a quoted glob pattern, are read back to back, for -r and -c too.\n\
 -r, --pe-file2, Input paired-end reverse fastq file\n\
 -o, --output-pe1, Output trimmed forward fastq file\n\
 -p, --output-pe2, Output trimmed reverse fastq file. Must use -s option.\n\n\
@@ -55,7 +84,8 @@ Paired-end interleaved reads\n\
     fprintf(stderr,"-c, --pe-interleaved, Combined (interleaved) input paired-end fastq\n\
 -m, --output-interleaved, Output combined (interleaved) paired-end fastq file. Must use -s option.\n\
 --------------\n\
--t, --qual-type, Type of quality values (solexa (CASAVA < 1.3), illumina (CASAVA 1.3 to 1.7), sanger (which is CASAVA >= 1.8)) (required)\n");
+-t, --qual-type, Type of quality values (solexa (CASAVA < 1.3), illumina (CASAVA 1.3 to 1.7), sanger (which is CASAVA >= 1.8),\n\
+\tor auto, to detect it from the first records) (required)\n");
     fprintf(stderr, "-s, --output-single, Output trimmed singles fastq file\n\
 -q, --qual-threshold, Threshold for trimming based on average quality in a window. Default 20.\n\
 -l, --length-threshold, Threshold to keep a read based on length after trimming. Default 20.\n\
@@ -65,14 +95,15 @@ Paired-end interleaved reads\n\
 -b, --batch, maximum MB of data to read from the input file at each cycle.\n\
 \tThe greater the value, the greater the memory usage can be. The value, multiplied by 1024^2, must be \n\
 \tbigger than the lenght of the longest read. Minimum 1. Default: 512.\n");
-
+    common_usage();
+    fprintf(stderr, "--detect-overlap, Also find adapters where the mates overlap past the start of each other.\n");
 
     fprintf(stderr, "-g, --gzip-output, Output gzipped files.\n--quiet, do not output trimming info\n\
 --help, display this help and exit\n\
 --version, output version information and exit\n\n");
 
     if (msg) fprintf(stderr, "%s\n\n", msg);
-    exit(status);
+    usage_exit(status);
 }
 
 Trim_Paired::Trim_Paired(){
@@ -104,14 +135,16 @@ Trim_Paired::Trim_Paired(){
     trunc_n = 0;
     gzip_output = 0;
     interleaved_s = 0;
+    detect_overlap = 0;
+    batches_read = 0;
 }
 
 int Trim_Paired::parse_args(int argc, char *argv[]){
-    int optc;
+    int optc, res;
     extern char *optarg;
     while (1) {
         int option_index = 0;
-        optc = getopt_long(argc, argv, "df:r:c:t:o:p:m:M:s:q:a:b:l:xng", paired_long_options, &option_index);
+        optc = getopt_long(argc, argv, "df:r:c:t:o:p:m:M:s:q:a:b:l:xngA:G", paired_long_options, &option_index);
 
         if (optc == -1)
             break;
@@ -136,7 +169,9 @@ int Trim_Paired::parse_args(int argc, char *argv[]){
             break;
 
         case 't':
-            if (!strcmp(optarg, "illumina")) qualtype = ILLUMINA;
+            if (!strcmp(optarg, "auto"))
+                qualtype = QUALTYPE_AUTO;
+            else if (!strcmp(optarg, "illumina")) qualtype = ILLUMINA;
             else if (!strcmp(optarg, "solexa")) qualtype = SOLEXA;
             else if (!strcmp(optarg, "sanger")) qualtype = SANGER;
             else {
@@ -213,12 +248,18 @@ int Trim_Paired::parse_args(int argc, char *argv[]){
         case_GETOPT_HELP_CHAR(usage);
         case_GETOPT_VERSION_CHAR(PROGRAM_NAME, VERSION, AUTHORS);
 
+        case DETECT_OVERLAP_OPTION:
+            detect_overlap = 1;
+            break;
+
         case '?':
             usage(EXIT_FAILURE, NULL);
             break;
 
         default:
-            usage(EXIT_FAILURE, NULL);
+            res = parse_common_arg(optc, optarg);
+            if (res == -1) usage(EXIT_FAILURE, NULL);
+            else if (res != 0) return res;
             break;
         }
     }
@@ -234,7 +275,16 @@ int Trim_Paired::parse_args(int argc, char *argv[]){
         usage(EXIT_FAILURE, "****Error: Must have either -f OR -c argument.");
         return EXIT_FAILURE;
     }
-    if(infnc)
+    if (check_follow() != 0) return EXIT_FAILURE;
+    if (check_checkpoint() != 0) return EXIT_FAILURE;
+    if (follow && !infnc) {
+        //the batches of -f and -r must have the same pairs, whatever each file has so far
+        fprintf(stderr, "****Error: --follow needs an interleaved input (-c).\n\n");
+        return EXIT_FAILURE;
+    }
+    if(follow)
+        batch_len = min(batch_len, FOLLOW_BATCH_LEN);
+    else if(infnc)
         batch_len = recommended_batch_len(infnc, batch_len);
     else if(infn){
         batch_len = recommended_batch_len(infn, batch_len);
@@ -246,7 +296,7 @@ int Trim_Paired::parse_args(int argc, char *argv[]){
 int Trim_Paired::recommended_batch_len(const char* path, int max_batch_len){
     std::uintmax_t min = 20;
     std::uintmax_t max = (unsigned) max_batch_len / 2;
-    std::uintmax_t size = std::experimental::filesystem::file_size(path);
+    std::uintmax_t size = input_size(path);
 
     std::uintmax_t recommended = size / 8;
 
@@ -271,360 +321,412 @@ int Trim_Paired::trim_main() {
     discard_s1 = 0;
     discard_s2 = 0;
 
-    int res = init_streams();
+    init_budget(infnc ? 1 : 2);
+    init_numa();
+    if(!pool) pool = new BufferPool(hugepages);
+    int res = load_checkpoint();
+    if(res != 0) return res;
+    res = init_streams();
     if(res != 0){
         return res;
     }
-    
-    vector<thread> output_threads;
-    while(true){
-        //lock_guard<mutex> guard(batch_lock);
-        msg("Starting batch variables");
-        std::vector<std::vector<FQEntry*>* > queues;
-        std::vector<std::vector<FQEntry*>* > queues2;
+    init_qc(2);
+    if(stats_fn) stats = new PipelineStats(threads, stats_per_batch);
+    if(trace_fn) trace_start();
+    TRACE_THREAD(TRACE_TID_MAIN, "main", -1);
+    if(show_progress && !progress) progress = new ProgressReporter(PROGRESS_INTERVAL);
+    if(progress){
+        progress->add_input(input);
+        if(!input_inter) progress->add_input(input2);
+        progress->start();
+    }
 
-        std::vector<long> queue_lens;
-        std::vector<long> queue_lens2;
+    PipelineOptions options;
+    options.parts = threads;
+    options.workers = workers;
+    options.output_batches = PE_OUTPUT_THREADS;
+    TrimConfig config = trim_config();
+    config.detect_overlap = detect_overlap;
+    int status = 0;
+    try{
+        Pipeline pipeline(config, *this, *this, options);
+        pipeline.run();
+    }catch(TrimError &error){
+        failed = true;
+        status = error.status;
+    }
 
-        std::vector<long> last_item;
+    if(progress) progress->stop();
+    //what the outputs still buffer is written as they close, the run fails if it can't be
+    if(close_streams() != 0 && !failed){
+        failed = true;
+        status = EXIT_FAILURE;
+    }
+    if(failed){
+        //the outputs are left as they are, and the checkpoint with them
+        throw TrimError{status};
+    }
 
-        bool** filtered_reads1 = new bool*[threads];
-        bool** filtered_reads2 = new bool*[threads];
+    if(trace_fn){
+        res = trace_write(trace_fn);
+        if(res != 0) return res;
+    }
 
-        cutsites*** saved_cutsites1 = new cutsites**[threads];
-        cutsites*** saved_cutsites2 = new cutsites**[threads];
+    if(stats){
+        res = stats->write_json(stats_fn);
+        if(res != 0) return res;
+    }
 
-        for (int i = 0; i < threads; i++){
-            queues.push_back(new std::vector<FQEntry*>());
-            queue_lens.push_back(0);
-            last_item.push_back(-1);
-        }
-        for (int i = 0; i < threads; i++){
-            queues2.push_back(new std::vector<FQEntry*>());
-            queue_lens2.push_back(0);
-        }
+    if(qc_fn){
+        const char* mate_names[] = {"read1", "read2"};
+        res = write_qc(mate_names);
+        if(res != 0) return res;
+    }
 
-        Batch* batch = NULL;
-        Batch* batch2 = NULL;
-        int last_read_position = 0;
-        int last_read_position2 = 0;
+    if (!quiet) {
+        if (infn && infn2) fprintf(stdout, "\nPE forward file: %s\nPE reverse file: %s\n", infn, infn2);
+        if (infnc) fprintf(stdout, "\nPE interleaved file: %s\n", infnc);
+        fprintf(stdout, "\nTotal input FastQ records: %d (%d pairs)\n", total, (total / 2));
+        fprintf(stdout, "\nFastQ paired records kept: %d (%d pairs)\n", kept_p, (kept_p / 2));
+        if (input_inter) fprintf(stdout, "FastQ single records kept: %d\n", (kept_s1 + kept_s2));
+        else fprintf(stdout, "FastQ single records kept: %d (from PE1: %d, from PE2: %d)\n", (kept_s1 + kept_s2), kept_s1, kept_s2);
 
-        for (int i = 0; i < threads; i++){
-            last_item[i] =  -1;
-            queue_lens[i] =  0;
-            queue_lens2[i] = 0;
-        }
+        fprintf(stdout, "FastQ paired records discarded: %d (%d pairs)\n", discard_p, (discard_p / 2));
 
-        msg("Reading new batch");
-        batch = input->get_batch_buffering_lines();
-        //msg("Read new batch");
-        if(batch == NULL){
-            msg("No more data, finishing program.");
-            break;
-        }
+        if (input_inter) fprintf(stdout, "FastQ single records discarded: %d\n\n", (discard_s1 + discard_s2));
+        else fprintf(stdout, "FastQ single records discarded: %d (from PE1: %d, from PE2: %d)\n\n", (discard_s1 + discard_s2), discard_s1, discard_s2);
+    }
 
-        if(!input_inter){
-            //msg("Reading batch2");
-            batch2 = input2->get_batch_buffering_lines();
-            //msg("Read batch2");
+    finish_checkpoint();
 
-            if(batch2 == NULL){
-                //msg("No batch2 returned, exiting.");
-                break;
-            }else{
-                if(batch2->n_lines() != batch->n_lines()){
-                    error("Batch2 and Batch1 have different lengths, exiting");
-                    break;
-                }
-            }
-        }else{
-            //msg("No need for batch2");
-        }
-        int chars_read_from_batch = 0;
-        int max_queue_len = batch->sequences_len / threads;
+    return EXIT_SUCCESS;
+}
+
+RecordBatch* Trim_Paired::next(int parts){
+    uint64_t reserved = 0;
+    timepoint stage_start, cycle_start;
+    if(budget){
+        TRACE_BEGIN("memory wait", batches_read);
+        reserved = input->block_bytes() + (uint64_t)batch_len * BATCH_OUTPUT_FACTOR;
+        if(!input_inter) reserved += input2->block_bytes() + (uint64_t)batch_len * BATCH_OUTPUT_FACTOR;
+        budget->reserve(reserved);
+        TRACE_END("memory wait", batches_read);
+        cycle_start = stats_now();
+    }
+    if(stats) stage_start = stats_now();
+    TRACE_BEGIN("read", batches_read);
+    Batch* batch = NULL;
+    Batch* batch2 = NULL;
+    try{
+        batch = input->get_batch_buffering_lines();
+        //msg("Read new batch");
+        if(batch != NULL && !input_inter) batch2 = input2->get_batch_buffering_lines();
+    }catch(TrimError &){
+        free_batches(batch, batch2);
+        if(budget) budget->release(reserved);
+        throw;
+    }
+    TRACE_END("read", batches_read);
+    if(batch == NULL || (!input_inter && batch2 == NULL)){
+        msg("No more data, finishing program.");
+        free_batches(batch, batch2);
+        if(budget) budget->release(reserved);
+        return NULL;
+    }
+    if(batch2 && batch2->n_lines() != batch->n_lines()){
+        error("Batch2 and Batch1 have different lengths, exiting");
+        free_batches(batch, batch2);
+        if(budget) budget->release(reserved);
+        return NULL;
+    }
 
-        FQEntry* fqrec = NULL;
-        FQEntry* fqrec2 = NULL;
-        //msg("Reading reads from batch");
-        int last_queue = 0;
+    PairedBatch* paired = new PairedBatch();
+    paired->mates = 2;
+    paired->text[0] = batch;
+    paired->text[1] = batch2;
+    paired->cycle_start = cycle_start;
+    paired->text_bytes = batch->sequences_len + batch->n_lines();
+    if(batch2) paired->text_bytes += batch2->sequences_len + batch2->n_lines();
+    if(budget){
+        //the blocks as they were read into, with their growth
+        paired->memory = batch_memory(batch->block_bytes() + (batch2 ? batch2->block_bytes() : 0), paired->text_bytes,
+            batch->n_lines() + (batch2 ? batch2->n_lines() : 0));
+        budget->resize(reserved, paired->memory);
+    }
+    if(stats){
+        paired->stats = stats->new_batch();
+        paired->stats->seconds[STAGE_READ] = seconds_between(stage_start, stats_now());
+        paired->stats->input_bytes = paired->text_bytes;
+        stage_start = stats_now();
+    }
+    //the arrays go with the batch, which gives them back to the pool once it is written
+    paired->parts = parts;
+    RecordArrays* records = paired->records[0] = record_pool.get();
+    RecordArrays* records2 = paired->records[1] = record_pool.get();
+    records->reset(parts);
+    records2->reset(parts);
+    std::vector<std::vector<FQEntry*>* > &queues = records->queues;
+    std::vector<std::vector<FQEntry*>* > &queues2 = records2->queues;
+    std::vector<long> last_item(parts, -1);
+
+    int chars_read_from_batch = 0;
+    int last_read_position = 0;
+    int last_read_position2 = 0;
+
+    FQEntry* fqrec = NULL;
+    FQEntry* fqrec2 = NULL;
+    //msg("Reading reads from batch");
+    TRACE_BEGIN("parse", batches_read);
+    int last_queue = 0;
+    try{
         while(batch->has_lines()){
-            if(!input_inter){
-                if(chars_read_from_batch > batch_len){
-                    break;
-                }
-            }else{
-                if(chars_read_from_batch > batch_len){
-                    break;
-                }
+            if(chars_read_from_batch > batch_len){
+                break;
             }
 
-            //msg("Reading read1");
-            //if(input == NULL) msg("input1 is null");
             fqrec = new FQEntry(last_read_position, batch);
             last_read_position = fqrec->position;
 
-            //msg("Reading read2");
             if(input_inter && !batch->has_lines()){
                 error("Reading interleaved pair: read1 loaded, but no read2 to load. Maybe it's not an interleaved file?");
-                exit(EXIT_FAILURE);
+                delete(fqrec);
+                throw TrimError{EXIT_FAILURE};
             }
-            if(input_inter){
-                fqrec2 = new FQEntry(last_read_position, batch);
-                last_read_position = fqrec2->position;
-            }else{
-                fqrec2 = new FQEntry(last_read_position2, batch2);
-                last_read_position2 = fqrec2->position;
-            }
-
-            //msg("Reads read");
-
-            int read_len = fqrec->seq.length();
-            int read_len2 = fqrec2->seq.length();
-            chars_read_from_batch += read_len;
-
-            int smallest_queue = 0;
-            bool fitted_in_a_queue = false;
-
-            long next_index = last_item[last_queue] + 1;
-
-            if(next_index < queues[last_queue]->size()){
-                (*queues[last_queue])[next_index] = fqrec;
-                (*queues2[last_queue])[next_index] = fqrec2;
-            }else{
-                queues[last_queue]->push_back(fqrec);
-                queues2[last_queue]->push_back(fqrec2);
+            try{
+                if(input_inter){
+                    fqrec2 = new FQEntry(last_read_position, batch);
+                    last_read_position = fqrec2->position;
+                }else{
+                    fqrec2 = new FQEntry(last_read_position2, batch2);
+                    last_read_position2 = fqrec2->position;
+                }
+            }catch(TrimError &){
+                delete(fqrec);
+                throw;
             }
 
-            queue_lens[last_queue] += read_len;
-            queue_lens2[last_queue] += read_len2;
+            chars_read_from_batch += fqrec->seq.length();
 
+            queues[last_queue]->push_back(fqrec);
+            queues2[last_queue]->push_back(fqrec2);
             last_item[last_queue] += 1;
 
-            last_queue = (last_queue+1) % threads;
-        }
-        msg("Finished reading batch");
-
-        if(chars_read_from_batch == 0){
-            msg("No more data, finishing program.");
-            break;
-        }else{
-            for (int i = 0; i < threads; i++){
-                filtered_reads1[i] = new bool[last_item[i]+1];
-                filtered_reads2[i] = new bool[last_item[i]+1];
-                bool* array = filtered_reads1[i];
-                memset(array, false, sizeof(array[0])*last_item[i]+1);
-                bool* array2 = filtered_reads2[i];
-                memset(array2, false, sizeof(array2[0])*last_item[i]+1);
-                /*for(int j = 0; j < last_item[i]+1; j++){
-                    if(array[j] != false){
-                        error("Array is not all false");
-                        exit(EXIT_FAILURE);
-                    }
-                }*/
-                saved_cutsites1[i] = new cutsites*[last_item[i]+1];
-                saved_cutsites2[i] = new cutsites*[last_item[i]+1];
-            }
-
-            msg("Processing threads:");
-            vector<thread> running;
-
-            for(int thread_n = 0; thread_n < threads; thread_n++){
-                running.push_back(thread(&Trim_Paired::processing_thread,
-                    this,
-                    queues[thread_n], queues2[thread_n],
-                    filtered_reads1[thread_n], filtered_reads2[thread_n],
-                    saved_cutsites1[thread_n], saved_cutsites2[thread_n],
-                    last_item[thread_n], thread_n
-                ));
-            }
-
-            //msg("Joining all");
-            std::for_each(running.begin(),running.end(), std::mem_fn(&std::thread::join));
-
-            writing_results_flag = true;
-            output_threads.push_back(thread(&Trim_Paired::output_paired,
-                this,
-                queues, queues2, filtered_reads1, filtered_reads2,
-                saved_cutsites1, saved_cutsites2, last_item)
-            );
-            //output_paired(queues, queues2, filtered_reads1, filtered_reads2,
-            //    saved_cutsites1, saved_cutsites2, last_item);
+            last_queue = (last_queue+1) % parts;
         }
+    }catch(TrimError &){
+        //the pairs before the bad one are freed with the batch
+        records->fit(last_item);
+        records2->fit(last_item);
+        release_batch(paired);
+        throw;
     }
-
-    msg("Waiting for output threads");
-    for(int i = 0; i < output_threads.size(); i++){
-        output_threads[i].join();
+    records->fit(last_item);
+    records2->fit(last_item);
+    TRACE_END("parse", batches_read);
+    if(paired->stats){
+        paired->stats->records = (batch->n_lines() + (batch2 ? batch2->n_lines() : 0)) / 4;
+        paired->stats->seconds[STAGE_PARSE] = seconds_between(stage_start, stats_now());
     }
 
-    while(writing_results_flag){
-        this_thread::sleep_for(chrono::milliseconds(100));
+    if(chars_read_from_batch == 0){
+        msg("No more data, finishing program.");
+        release_batch(paired);
+        return NULL;
     }
+    paired->positions = {{batch->end_file, batch->end_offset}};
+    if(batch2) paired->positions.push_back({batch2->end_file, batch2->end_offset});
+    batches_read++;
+    return paired;
+}
 
-    if (!quiet) {
-        if (infn && infn2) fprintf(stdout, "\nPE forward file: %s\nPE reverse file: %s\n", infn, infn2);
-        if (infnc) fprintf(stdout, "\nPE interleaved file: %s\n", infnc);
-        fprintf(stdout, "\nTotal input FastQ records: %d (%d pairs)\n", total, (total / 2));
-        fprintf(stdout, "\nFastQ paired records kept: %d (%d pairs)\n", kept_p, (kept_p / 2));
-        if (input_inter) fprintf(stdout, "FastQ single records kept: %d\n", (kept_s1 + kept_s2));
-        else fprintf(stdout, "FastQ single records kept: %d (from PE1: %d, from PE2: %d)\n", (kept_s1 + kept_s2), kept_s1, kept_s2);
-
-        fprintf(stdout, "FastQ paired records discarded: %d (%d pairs)\n", discard_p, (discard_p / 2));
-
-        if (input_inter) fprintf(stdout, "FastQ single records discarded: %d\n\n", (discard_s1 + discard_s2));
-        else fprintf(stdout, "FastQ single records discarded: %d (from PE1: %d, from PE2: %d)\n\n", (discard_s1 + discard_s2), discard_s1, discard_s2);
-    }
+void Trim_Paired::trimmed(RecordBatch* batch){
+    if(!budget) return;
+    InputBatch* input_batch = (InputBatch*)batch;
+    adapt_batch_len(input_batch->text_bytes, seconds_between(input_batch->cycle_start, stats_now()));
+    input->set_batch_len(batch_len);
+    if(!input_inter) input2->set_batch_len(batch_len);
+}
 
-    close_streams();
+void Trim_Paired::release(RecordBatch* batch){
+    release_batch((InputBatch*)batch);
+}
 
-    return EXIT_SUCCESS;
+void Trim_Paired::localize(RecordBatch* batch, int part){
+    localize_part(batch, part);
 }
 
-void Trim_Paired::processing_thread(
-        std::vector<FQEntry*>* local_queue, std::vector<FQEntry*>* local_queue2,
-        bool* filtered1, bool* filtered2,
-        cutsites** cutsites1, cutsites** cutsites2,
-        long last_index, int thread_n)
-{
-    assert(local_queue != NULL && local_queue2 != NULL);
-
-    msg(string("Processing thread ") + to_string(thread_n) + string(", read pairs: ") + to_string(last_index+1));
-    FQEntry* fqrec1;
-    FQEntry* fqrec2;
-
-    assert(local_queue2->size() == local_queue->size());
-    for(int i = 0; i <= last_index; i++){
-        fqrec1 = local_queue->at(i);
-        fqrec2 = local_queue2->at(i);
-        cutsites1[i] = sliding_window(*fqrec1);
-        if(!(cutsites1[i]->three_prime_cut >= 0)) filtered1[i] = true;
-        cutsites2[i] = sliding_window(*fqrec2);
-        if(!(cutsites2[i]->three_prime_cut >= 0)) filtered2[i] = true;
-    }
+void Trim_Paired::start(int qualtype){
+    start_run(qualtype);
 }
 
-std::string Trim_Paired::get_read_string(FQEntry* read, cutsites* cs){
-    std::stringstream to_print;
-    to_print << read->name << "\n";
-    to_print << read->seq.substr(cs->five_prime_cut, cs->three_prime_cut - cs->five_prime_cut) << "\n";
-    to_print << read->comment << "\n";
-    to_print << read->qual.substr(cs->five_prime_cut, cs->three_prime_cut - cs->five_prime_cut) << "\n";
-    return to_print.str();
+void Trim_Paired::part_trimmed(RecordBatch* batch, int part){
+    collect_part(batch, part);
 }
 
-void Trim_Paired::output_paired(std::vector<std::vector<FQEntry*>* > queues, std::vector<std::vector<FQEntry*>* > queues2,
-        bool** filtered_reads, bool** filtered_reads2,
-        cutsites*** saved_cutsites, cutsites*** saved_cutsites2,
-        vector<long> last_index)
-{
-    int kept_p = 0;
-    int kept_s1 = 0;
-    int kept_s2 = 0;
-    int discard_p = 0;
-    int discard_s1 = 0;
-    int discard_s2 = 0;
-
-    msg("Making results string");
-    std::stringstream fq1, fq2, singles;
-    
-    for (size_t i = 0; i < threads; i++){
-        //msg("Results from thread ");
-        //msg(to_string(i));
-        for (size_t j = 0; j < queues[i]->size(); j++)
-        {  
-            //msg("Reading data");
-            bool r1 = !filtered_reads[i][j];
-            bool r2 = !filtered_reads2[i][j];
-            FQEntry* read1 = queues[i]->at(j);
-            cutsites* cs1 = saved_cutsites[i][j];
-            FQEntry* read2 = queues2[i]->at(j);
-            cutsites* cs2 = saved_cutsites2[i][j];
-            //msg("Read entry data");
+void Trim_Paired::format(RecordBatch* batch){
+    PairedBatch* paired = (PairedBatch*)batch;
+    RecordArrays* records = paired->records[0];
+    RecordArrays* records2 = paired->records[1];
+    Batch* text = paired->text[0];
+    Batch* text2 = paired->text[1];
+
+    timepoint stage_start;
+    if(paired->stats) stage_start = stats_now();
+    TRACE_BEGIN("format", paired->n);
+    /* FASTQ output of a mate is never bigger than its input, binary output
+    grows past it with N runs; the singles start smaller and grow */
+    size_t text1_len = text->sequences_len + text->n_lines();
+    size_t text2_len = text2 ? text2->sequences_len + text2->n_lines() : 0;
+    size_t len1 = text1_len, len2 = text2_len;
+    if(binary_output){
+        len1 = sqb_output_len(text1_len, text->n_lines() / 4);
+        len2 = text2 ? sqb_output_len(text2_len, text2->n_lines() / 4) : 0;
+    }
+    paired->fq1 = new OutputBuffer(pool, len1);
+    paired->fq2 = new OutputBuffer(pool, len2);
+    paired->singles = new OutputBuffer(pool, (text1_len + text2_len) / 8);
+    OutputBuffer &fq1 = *paired->fq1, &fq2 = *paired->fq2, &singles = *paired->singles;
+
+    for (int i = 0; i < paired->parts; i++){
+        for (size_t j = 0; j < records->queues[i]->size(); j++)
+        {
+            bool r1 = !records->filtered[i][j];
+            bool r2 = !records2->filtered[i][j];
+            FQEntry* read1 = records->queues[i]->at(j);
+            cutsites* cs1 = records->cuts[i][j];
+            FQEntry* read2 = records2->queues[i]->at(j);
+            cutsites* cs2 = records2->cuts[i][j];
             if(r1 && r2){
-                //msg("Writing both");
-                fq1 << get_read_string(read1, cs1);
+                append_read(fq1, read1, cs1);
                 if(input_inter){
-                    fq1 << get_read_string(read2, cs2);
+                    append_read(fq1, read2, cs2);
                 }else{
-                    fq2 << get_read_string(read2, cs2);
+                    append_read(fq2, read2, cs2);
+                }
+                paired->kept_p += 2;
+                if(splitter){
+                    paired->kinds.push_back(SPLIT_KEPT);
+                    paired->ends1.push_back(fq1.length());
+                    paired->ends2.push_back(fq2.length());
                 }
-                kept_p += 2;
             }else if(r1 || r2){
                 if(r1){
-                    //msg("Writing r1");
-                    singles << get_read_string(read1, cs1);
-                    kept_s1++;
-                    discard_s2++;
+                    append_read(singles, read1, cs1);
+                    paired->kept_s1++;
+                    paired->discard_s2++;
                 }else{
-                    //msg("Writing r2");
-                    singles << get_read_string(read2, cs2);
-                    kept_s2++;
-                    discard_s1++;
+                    append_read(singles, read2, cs2);
+                    paired->kept_s2++;
+                    paired->discard_s1++;
+                }
+                if(splitter){
+                    paired->kinds.push_back(SPLIT_SINGLE);
+                    paired->singles_ends.push_back(singles.length());
                 }
             }else{
-                //msg("Writing none");
-                discard_p += 2;
+                paired->discard_p += 2;
+                if(splitter) paired->kinds.push_back(SPLIT_DISCARDED);
             }
-            delete(read1);
-            delete(read2);
-            free(cs1);
-            free(cs2);
         }
-        delete(queues[i]);
-        delete(queues2[i]);
-        delete(filtered_reads[i]);
-        delete(filtered_reads2[i]);
-        free(saved_cutsites[i]);
-        free(saved_cutsites2[i]);
-        //msg("Read results from thread");
-    }
-    free(saved_cutsites);
-    free(saved_cutsites2);
-    msg("Finished results string");
-
-    lock_guard<mutex> guard(batch_lock);
-    this->kept_p += kept_p;
-    this->kept_s1 += kept_s1;
-    this->kept_s2 += kept_s2;
-    this->discard_p += discard_p;
-    this->discard_s1 += discard_s1;
-    this->discard_s2 += discard_s2;
+    }
+    if(paired->stats){
+        paired->stats->seconds[STAGE_FORMAT] = seconds_between(stage_start, stats_now());
+        paired->stats->output_bytes = fq1.length() + fq2.length() + singles.length();
+    }
+    TRACE_END("format", paired->n);
+}
 
+void Trim_Paired::write(RecordBatch* batch){
+    PairedBatch* paired = (PairedBatch*)batch;
+    //batches are formatted in parallel, but written one at a time in input order
+    kept_p += paired->kept_p;
+    kept_s1 += paired->kept_s1;
+    kept_s2 += paired->kept_s2;
+    discard_p += paired->discard_p;
+    discard_s1 += paired->discard_s1;
+    discard_s2 += paired->discard_s2;
     total = kept_p + kept_s1 + kept_s2 + discard_p + discard_s1 + discard_s2;
-    
-    //msg("Outputing");
-    if (!gzip_output) {
-        //msg("Writing plain text");
-        if(input_inter){
-            //msg("Interleaved output");
-            outfile_interleaved << fq1.str();
-            if (sfn) outfile_single << singles.str();
-            //fprintf(outfile_interleaved, "%s", fq1.str());
-        }else{
-            //msg("Separate outputs");
-            outfile << fq1.str();
-            //fprintf(outfile, "%s", );
-            outfile2 << fq2.str();
-            //fprintf(outfile2, "%s", );
-            if (sfn) outfile_single << singles.str();
-            //fprintf(outfile_single, "%s", fq2.str());
-        }
+
+    std::string_view fq1_content = paired->fq1->content();
+    std::string_view fq2_content = paired->fq2->content();
+    std::string_view singles_content = paired->singles->content();
+    timepoint stage_start;
+    if(paired->stats) stage_start = stats_now();
+    TRACE_BEGIN(gzip_output ? "compress" : "write", paired->n);
+    if (splitter) {
+        //in the order of the outputs in init_streams
+        vector<SplitText> texts = {{fq1_content, &paired->ends1}};
+        if(!input_inter) texts.push_back({fq2_content, &paired->ends2});
+        if(sfn) texts.push_back({singles_content, &paired->singles_ends});
+        splitter->write(paired->kinds, texts);
     } else {
         if(input_inter){
-            gzprintf(interleaved_gzip, fq1.str().c_str());
-            if (sfn) gzprintf(single_gzip, singles.str().c_str());
+            write_output(outfnc, outfile_interleaved, interleaved_gzip, fq1_content);
         }else{
-            gzprintf(outfile_gzip, fq1.str().c_str());
-            gzprintf(outfile2_gzip, fq2.str().c_str());
-            if (sfn) gzprintf(single_gzip, singles.str().c_str());
+            write_output(outfn, outfile, outfile_gzip, fq1_content);
+            write_output(outfn2, outfile2, outfile2_gzip, fq2_content);
         }
+        if (sfn) write_output(sfn, outfile_single, single_gzip, singles_content);
+    }
+    TRACE_END(gzip_output ? "compress" : "write", paired->n);
+    if(paired->stats) paired->stats->seconds[gzip_output ? STAGE_COMPRESS : STAGE_WRITE] = seconds_between(stage_start, stats_now());
+    if(checkpoint_fn) save_checkpoint(paired->positions);
+}
+
+Trim_Paired::~Trim_Paired(){
+    //the input names belong to their readers once there are any; a failed run may not have closed them
+    if (input_inter) delete(input_inter);
+    else delete(input);
+    delete(input2);
+    if (!input_inter) free(infnc);
+    if (!input) free(infn);
+    if (!input2) free(infn2);
+    free(outfn2);
+    free(outfnc);
+    free(sfn);
+}
+
+void Trim_Paired::counts(long &records, long &kept, long &discarded){
+    kept = kept_p + kept_s1 + kept_s2;
+    discarded = discard_p + discard_s1 + discard_s2;
+    records = kept + discarded;
+}
+
+void Trim_Paired::save_counters(std::map<std::string, long> &counters){
+    counters["kept_p"] = kept_p;
+    counters["kept_s1"] = kept_s1;
+    counters["kept_s2"] = kept_s2;
+    counters["discard_p"] = discard_p;
+    counters["discard_s1"] = discard_s1;
+    counters["discard_s2"] = discard_s2;
+}
+
+void Trim_Paired::restore_counters(const std::map<std::string, long> &counters){
+    std::map<std::string, long>::const_iterator it;
+    if ((it = counters.find("kept_p")) != counters.end()) kept_p = it->second;
+    if ((it = counters.find("kept_s1")) != counters.end()) kept_s1 = it->second;
+    if ((it = counters.find("kept_s2")) != counters.end()) kept_s2 = it->second;
+    if ((it = counters.find("discard_p")) != counters.end()) discard_p = it->second;
+    if ((it = counters.find("discard_s1")) != counters.end()) discard_s1 = it->second;
+    if ((it = counters.find("discard_s2")) != counters.end()) discard_s2 = it->second;
+    total = kept_p + kept_s1 + kept_s2 + discard_p + discard_s1 + discard_s2;
+}
+
+void Trim_Paired::free_batches(Batch* batch, Batch* batch2){
+    if(batch){
+        batch->free_this();
+        delete(batch);
+    }
+    if(batch2){
+        batch2->free_this();
+        delete(batch2);
     }
-    //msg("Finished outputing results");
-    writing_results_flag = false;
 }
 
 int Trim_Paired::init_streams(){
     msg("Opening files");
+    int res = init_splitter();
+    if (res != 0) return res;
     if (infnc) {      /* using interleaved input file */
 
         if (infn || infn2 || outfn || outfn2) {
@@ -632,27 +734,21 @@ int Trim_Paired::init_streams(){
             return EXIT_FAILURE;
         }
 
-        input_inter = new GZReader(infnc, batch_len, true);
-        if (!input_inter) {
-            fprintf(stderr, "****Error: Could not open interleaved input file '%s'.\n\n", infnc);
+        input_inter = new GZReader(infnc, batch_len, true, pool);
+        if (follow) input_inter->set_follow(follow_sentinel, follow_timeout);
+        //the reader says which file it couldn't open
+        if (!input_inter->is_open() || resume_input(input_inter, 0) != 0) {
             return EXIT_FAILURE;
         }
         input = input_inter;
 
         /* get interleaved output file */
-        if (!gzip_output) {
-            outfile_interleaved.open(outfnc);
+        if (splitter) {
+            splitter->add_output(outfnc, false);
+        } else if (open_output(outfnc, outfile_interleaved, interleaved_gzip) != 0) {
             //outfile_interleaved = fopen(outfnc, "w");
-            if (!outfile_interleaved) {
-                fprintf(stderr, "****Error: Could not open interleaved output file '%s'.\n\n", outfnc);
-                return EXIT_FAILURE;
-            }
-        } else {
-            interleaved_gzip = gzopen(outfnc, "w");
-            if (!interleaved_gzip) {
-                fprintf(stderr, "****Error: Could not open interleaved output file '%s'.\n\n", outfnc);
-                return EXIT_FAILURE;
-            }
+            fprintf(stderr, "****Error: Could not open interleaved output file '%s'.\n\n", outfnc);
+            return EXIT_FAILURE;
         }
 
     } else {     /* using forward and reverse input files */
@@ -667,70 +763,60 @@ int Trim_Paired::init_streams(){
             return EXIT_FAILURE;
         }
 
-        input = new GZReader(infn, batch_len);
-        if (!input) {
-            fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", infn);
+        input = new GZReader(infn, batch_len, false, pool);
+        if (!input->is_open() || resume_input(input, 0) != 0) {
             return EXIT_FAILURE;
         }
 
-        input2 = new GZReader(infn2, batch_len);
-        if (!input2) {
-            fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", infn2);
+        input2 = new GZReader(infn2, batch_len, false, pool);
+        if (!input2->is_open() || resume_input(input2, 1) != 0) {
             return EXIT_FAILURE;
         }
 
-        if (!gzip_output) {
+        if (input->file_count() != input2->file_count()) {
+            fprintf(stderr, "****Error: -f has %zu files and -r has %zu, they must be the same lanes or chunks.\n\n",
+                input->file_count(), input2->file_count());
+            return EXIT_FAILURE;
+        }
+
+        if (splitter) {
+            splitter->add_output(outfn, false);
+            splitter->add_output(outfn2, false);
+        } else {
             //outfile = fopen(outfn, "w");
-            outfile.open(outfn);
-            if (!outfile) {
+            if (open_output(outfn, outfile, outfile_gzip) != 0) {
                 fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
                 return EXIT_FAILURE;
             }
-            outfile2.open(outfn2);
             //outfile2 = fopen(outfn2, "w");
-            if (!outfile2) {
+            if (open_output(outfn2, outfile2, outfile2_gzip) != 0) {
                 fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn2);
                 return EXIT_FAILURE;
             }
-        } else {
-            outfile_gzip = gzopen(outfn, "w");
-            if (!outfile_gzip) {
-                fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
-                return EXIT_FAILURE;
-            }
-
-            outfile2_gzip = gzopen(outfn2, "w");
-            if (!outfile2_gzip) {
-                fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn2);
-                return EXIT_FAILURE;
-            }
-
         }
     }
 
     /* get singles output file handle */
     if (sfn) {
-        if (!gzip_output) {
-            outfile_single.open(sfn);
-            if (!outfile_single) {
-                fprintf(stderr, "****Error: Could not open single output file '%s'.\n\n", sfn);
-                return EXIT_FAILURE;
-            }
-        } else {
-            single_gzip = gzopen(sfn, "w");
-            if (!single_gzip) {
-                fprintf(stderr, "****Error: Could not open single output file '%s'.\n\n", sfn);
-                return EXIT_FAILURE;
-            }
+        if (splitter) {
+            splitter->add_output(sfn, true);
+        } else if (open_output(sfn, outfile_single, single_gzip) != 0) {
+            fprintf(stderr, "****Error: Could not open single output file '%s'.\n\n", sfn);
+            return EXIT_FAILURE;
         }
     }
 
 
+    if (splitter) {
+        res = splitter->open();
+        if (res != 0) return res;
+    }
+
     msg("Opened files");
     return 0;
 }
 
-void Trim_Paired::close_streams(){
+int Trim_Paired::close_streams(){
     //msg("Closing paired end streams");
     if (input_inter) {
         //msg("Deleting interleaved reader");
@@ -740,25 +826,22 @@ void Trim_Paired::close_streams(){
         delete(input);
         delete(input2);
     }
+    //freed by the readers
+    input_inter = input = input2 = NULL;
+    infnc = infn = infn2 = NULL;
     //msg("Deleted readers");
 
-    if(single_gzip){
-        gzclose(single_gzip);
-    }
-    if(outfile_single){
-        outfile_single.close();
-    }
-    //msg("Deleted single outputs");
+    int res = 0;
+    if(splitter) res = splitter->close();
 
+    //the outputs that weren't opened have nothing to close
+    if(close_output(sfn, outfile_single, single_gzip) != 0) res = EXIT_FAILURE;
+    //msg("Deleted single outputs");
+    if(close_output(outfnc, outfile_interleaved, interleaved_gzip) != 0) res = EXIT_FAILURE;
     //msg("Deleted interleaved outputs");
-
-    if (!gzip_output) {
-        if(outfile) outfile.close();
-        if(outfile2) outfile2.close();
-    } else {
-        if(outfile_gzip) gzclose(outfile_gzip);
-        if(outfile2_gzip) gzclose(outfile2_gzip);
-    }
+    if(close_output(outfn, outfile, outfile_gzip) != 0) res = EXIT_FAILURE;
+    if(close_output(outfn2, outfile2, outfile2_gzip) != 0) res = EXIT_FAILURE;
 
     msg("Closed all files");
+    return res;
 }
@@ -8,31 +8,47 @@
 #include <mutex>
 #include <cstdint>
 #include <experimental/filesystem>
+#include <getopt.h>
 #include "trim.h"
 
+//The long options of pe, also for the runners that check the options of their jobs
+extern struct option paired_long_options[];
 
-class Trim_Paired : public Abstract_Trimmer{
+/* Batches formatted at once, while the next ones are trimmed; each holds
+its memory until it is written */
+#ifndef PE_OUTPUT_THREADS
+#define PE_OUTPUT_THREADS 2
+#endif
+
+
+/* sickle pe: a Pipeline from the input files to the output files, which
+it is the source and the sink of */
+class Trim_Paired : public Abstract_Trimmer, public RecordSource, public RecordSink{
 public:
     Trim_Paired();
+    ~Trim_Paired();
     int parse_args(int argc, char *argv[]);
 
     int trim_main();
     void usage(int status, char const *msg);
     int recommended_batch_len(const char* path, int max_batch_len);
+    void counts(long &records, long &kept, long &discarded);
+
+    RecordBatch* next(int parts);
+    void trimmed(RecordBatch* batch);
+    void release(RecordBatch* batch);
+    void localize(RecordBatch* batch, int part);
+    void start(int qualtype);
+    void part_trimmed(RecordBatch* batch, int part);
+    void format(RecordBatch* batch);
+    void write(RecordBatch* batch);
 protected:
-    std::string get_read_string(FQEntry* read, cutsites* cs);
+    void save_counters(std::map<std::string, long> &counters);
+    void restore_counters(const std::map<std::string, long> &counters);
     int init_streams();
-    void processing_thread(
-        std::vector<FQEntry*>* local_queue, std::vector<FQEntry*>* local_queue2,
-        bool* filtered1, bool* filtered2,
-        cutsites** cutsites1, cutsites** cutsites2,
-        long last_index, int thread_n
-    );
-    void close_streams();
-    void output_paired(std::vector<std::vector<FQEntry*>* > queues, std::vector<std::vector<FQEntry*>* > queue2,
-        bool** filtered_reads, bool** filtered_reads2, 
-        cutsites*** saved_cutsites, cutsites*** saved_cutsites2,
-        vector<long> last_index);
+    //EXIT_FAILURE if an output couldn't be written whole
+    int close_streams();
+    void free_batches(Batch* batch, Batch* batch2);
     GZReader* input2;
     GZReader* input_inter;
     std::ofstream outfile2;      /* reverse output file handle */
@@ -42,6 +58,7 @@ protected:
     gzFile interleaved_gzip;
     gzFile single_gzip;
     int interleaved_s;
+    int detect_overlap;
     
     char *outfn2;        /* reverse file out name */
     char *outfnc;        /* interleaved file out name */
@@ -56,7 +73,29 @@ protected:
     int discard_s1;
     int discard_s2;
 
-    mutex batch_lock;
+    //batches read so far, for the trace events of the reading
+    long batches_read;
+};
+
+/* A batch of pe as format leaves it for write, with its counters */
+struct PairedBatch: public InputBatch{
+    ~PairedBatch(){
+        delete(fq1);
+        delete(fq2);
+        delete(singles);
+    }
+    OutputBuffer* fq1 = NULL;
+    OutputBuffer* fq2 = NULL;
+    OutputBuffer* singles = NULL;
+    //with a splitter, what happened to each pair and where its reads end in each output
+    std::vector<char> kinds;
+    std::vector<size_t> ends1, ends2, singles_ends;
+    int kept_p = 0;
+    int kept_s1 = 0;
+    int kept_s2 = 0;
+    int discard_p = 0;
+    int discard_s1 = 0;
+    int discard_s2 = 0;
 };
 
 #endif
\ No newline at end of file
@@ -17,7 +17,7 @@
 #include "trim_single.h"
 #include "GZReader.h"
 
-static struct option single_long_options[] = {
+struct option single_long_options[] = {
     {"fastq-file", required_argument, 0, 'f'},
     {"output-file", required_argument, 0, 'o'},
     {"qual-type", required_argument, 0, 't'},
@@ -29,6 +29,34 @@ static struct option single_long_options[] = {
     {"quiet", no_argument, 0, 'z'},
     {"threads", no_argument, 0, 'a'},
     {"batch", no_argument, 0, 'b'},
+    {"adapter", required_argument, 0, 'A'},
+    {"adapter-mismatches", required_argument, 0, ADAPTER_MISMATCHES_OPTION},
+    {"adapter-min-overlap", required_argument, 0, ADAPTER_OVERLAP_OPTION},
+    {"poly-g", no_argument, 0, 'G'},
+    {"poly-x", required_argument, 0, POLY_X_OPTION},
+    {"poly-min-len", required_argument, 0, POLY_MIN_LEN_OPTION},
+    {"poly-mismatches", required_argument, 0, POLY_MISMATCHES_OPTION},
+    {"max-ee", required_argument, 0, MAX_EE_OPTION},
+    {"max-dust", required_argument, 0, MAX_DUST_OPTION},
+    {"qc-json", required_argument, 0, QC_JSON_OPTION},
+    {"stats-json", required_argument, 0, STATS_JSON_OPTION},
+    {"stats-per-batch", no_argument, 0, STATS_PER_BATCH_OPTION},
+    {"trace", required_argument, 0, TRACE_OPTION},
+    {"progress", no_argument, 0, PROGRESS_OPTION},
+    {"max-memory", required_argument, 0, MAX_MEMORY_OPTION},
+    {"numa", no_argument, 0, NUMA_OPTION},
+    {"hugepages", no_argument, 0, HUGEPAGES_OPTION},
+    {"split-reads", required_argument, 0, SPLIT_READS_OPTION},
+    {"split-parts", required_argument, 0, SPLIT_PARTS_OPTION},
+    {"follow", no_argument, 0, FOLLOW_OPTION},
+    {"follow-sentinel", required_argument, 0, FOLLOW_SENTINEL_OPTION},
+    {"follow-timeout", required_argument, 0, FOLLOW_TIMEOUT_OPTION},
+    {"checkpoint", required_argument, 0, CHECKPOINT_OPTION},
+    {"checkpoint-interval", required_argument, 0, CHECKPOINT_INTERVAL_OPTION},
+    {"resume", no_argument, 0, RESUME_OPTION},
+    {"binary", no_argument, 0, BINARY_OPTION},
+    {"qual-bin", required_argument, 0, QUAL_BIN_OPTION},
+    {"long-reads", no_argument, 0, LONG_READS_OPTION},
     {GETOPT_HELP_OPTION_DECL},
     {GETOPT_VERSION_OPTION_DECL},
     {NULL, 0, NULL, 0}
@@ -39,8 +67,10 @@ void Trim_Single::usage(int status, char const *msg) {
     fprintf(stderr, "\nUsage: %s se [options] -f <fastq sequence file> -t <quality type> -o <trimmed fastq file>\n\
 \n\
 Options:\n\
--f, --fastq-file, Input fastq file (required)\n\
--t, --qual-type, Type of quality values (solexa (CASAVA < 1.3), illumina (CASAVA 1.3 to 1.7), sanger (which is CASAVA >= 1.8)) (required)\n\
+-f, --fastq-file, Input fastq file (required). Several files, separated by commas, or a quoted glob\n\
+\tpattern (as 'reads_L00*.fq.gz') are read back to back, as if concatenated.\n\
+-t, --qual-type, Type of quality values (solexa (CASAVA < 1.3), illumina (CASAVA 1.3 to 1.7), sanger (which is CASAVA >= 1.8),\n\
+\tor auto, to detect it from the first records) (required)\n\
 -o, --output-file, Output trimmed fastq file (required)\n", PROGRAM_NAME);
 
     fprintf(stderr, "-q, --qual-threshold, Threshold for trimming based on average quality in a window. Default 20.\n\
@@ -52,12 +82,15 @@ Options:\n\
 -b, --batch, maximum MB of data to read from the input file at each cycle.\n\
 \tThe greater the value, the greater the memory usage can be. The value, multiplied by 1024^2, must be \n\
 \tbigger than the lenght of the longest read. Minimum 1. Default: 512.\n\
---quiet, Don't print out any trimming information\n\
+--long-reads, Read records of any length, in batches of -b million bases, for long read data.\n\
+\tThe window scan of reads of %d bases or more is split between the threads.\n", LONG_READ_SPLIT_BASES);
+    common_usage();
+    fprintf(stderr, "--quiet, Don't print out any trimming information\n\
 --help, display this help and exit\n\
 --version, output version information and exit\n\n");
 
     if (msg) fprintf(stderr, "%s\n\n", msg);
-    exit(status);
+    usage_exit(status);
 }
 
 Trim_Single::Trim_Single(){
@@ -77,17 +110,26 @@ Trim_Single::Trim_Single(){
     infn = NULL;
     quiet = 0;
     gzip_output = 0;
+    long_reads = 0;
+    batches_read = 0;
+    last_read_position = 0;
     //msg("Finished build trimmer");
 }
 
+Trim_Single::~Trim_Single(){
+    //the input name belongs to the reader once there is one; a failed run may not have closed it
+    if (input) delete(input);
+    else free(infn);
+}
+
 int Trim_Single::parse_args(int argc, char *argv[]){
-    int optc;
+    int optc, res;
     extern char *optarg;
 
-    std::cout << "Setting se trimming params\n";
+    msg("Setting se trimming params");
     while (1) {
         int option_index = 0;
-        optc = getopt_long(argc, argv, "df:t:o:q:a:b:l:zxng", single_long_options, &option_index);
+        optc = getopt_long(argc, argv, "df:t:o:q:a:b:l:zxngA:G", single_long_options, &option_index);
 
         if (optc == -1)
             break;
@@ -102,7 +144,9 @@ int Trim_Single::parse_args(int argc, char *argv[]){
             break;
 
         case 't':
-            if (!strcmp(optarg, "illumina"))
+            if (!strcmp(optarg, "auto"))
+                qualtype = QUALTYPE_AUTO;
+            else if (!strcmp(optarg, "illumina"))
                 qualtype = ILLUMINA;
             else if (!strcmp(optarg, "solexa"))
                 qualtype = SOLEXA;
@@ -163,6 +207,10 @@ int Trim_Single::parse_args(int argc, char *argv[]){
             batch_len = 1024*1024*(atoi(optarg));
             break;
 
+        case LONG_READS_OPTION:
+            long_reads = 1;
+            break;
+
         case_GETOPT_HELP_CHAR(usage)
         case_GETOPT_VERSION_CHAR(PROGRAM_NAME, VERSION, AUTHORS);
 
@@ -171,7 +219,9 @@ int Trim_Single::parse_args(int argc, char *argv[]){
             break;
 
         default:
-            usage(EXIT_FAILURE, NULL);
+            res = parse_common_arg(optc, optarg);
+            if (res == -1) usage(EXIT_FAILURE, NULL);
+            else if (res != 0) return res;
             break;
         }
     }
@@ -181,12 +231,20 @@ int Trim_Single::parse_args(int argc, char *argv[]){
         usage(EXIT_FAILURE, "****Error: Must have quality type, input file, and output file.");
     }
 
-    if (!strcmp(infn, outfn)) {
-        fprintf(stderr, "****Error: Input file is same as output file.\n\n");
-        return EXIT_FAILURE;
+    vector<string> inputs;
+    if (input_files(infn, inputs) != 0) return EXIT_FAILURE;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (inputs[i] == outfn) {
+            fprintf(stderr, "****Error: Input file is same as output file.\n\n");
+            return EXIT_FAILURE;
+        }
     }
 
-    batch_len = recommended_batch_len(infn, batch_len);
+    if (check_follow() != 0) return EXIT_FAILURE;
+    if (check_checkpoint() != 0) return EXIT_FAILURE;
+    //the size of a file still being written says nothing of the run
+    if (follow) batch_len = min(batch_len, FOLLOW_BATCH_LEN);
+    else batch_len = recommended_batch_len(infn, batch_len);
 
     return 0;
 }
@@ -194,7 +252,7 @@ int Trim_Single::parse_args(int argc, char *argv[]){
 int Trim_Single::recommended_batch_len(const char* path, int max_batch_len){
     std::uintmax_t min = 20;
     std::uintmax_t max = (unsigned) max_batch_len;
-    std::uintmax_t size = std::experimental::filesystem::file_size(path);
+    std::uintmax_t size = input_size(path);
 
     std::uintmax_t recommended = size / 8;
 
@@ -211,258 +269,275 @@ int Trim_Single::recommended_batch_len(const char* path, int max_batch_len){
 }
 
 int Trim_Single::trim_main() {
-    std::cout << "trim_main()\n";
+    msg("trim_main()");
 
     kept=0;
     discard=0;
     total=0;
 
-    int res = init_streams();
+    init_budget(1);
+    init_numa();
+    if(!pool) pool = new BufferPool(hugepages);
+    int res = load_checkpoint();
+    if(res != 0) return res;
+    res = init_streams();
     if(res != 0){
         return res;
     }
+    init_qc(1);
+    if(stats_fn) stats = new PipelineStats(threads, stats_per_batch);
+    if(trace_fn) trace_start();
+    TRACE_THREAD(TRACE_TID_MAIN, "main", -1);
+    if(show_progress && !progress) progress = new ProgressReporter(PROGRESS_INTERVAL);
+    if(progress){
+        progress->add_input(input);
+        progress->start();
+    }
 
-    //msg("Creating queues");
-    std::vector<std::vector<FQEntry*>* > queues;
-    std::vector<long> queue_lens;
-    std::vector<long> last_item;
-    for (int i = 0; i < threads; i++){
-        queues.push_back(new std::vector<FQEntry*>());
-        queue_lens.push_back(0);
-        last_item.push_back(-1);
+    PipelineOptions options;
+    options.parts = threads;
+    options.workers = workers;
+    //only one batch is written at a time
+    options.output_batches = 1;
+    if(long_reads) options.split_bases = LONG_READ_SPLIT_BASES;
+    int status = 0;
+    try{
+        Pipeline pipeline(trim_config(), *this, *this, options);
+        pipeline.run();
+    }catch(TrimError &error){
+        failed = true;
+        status = error.status;
     }
-    bool** filtered_reads = new bool*[threads];
-    cutsites*** saved_cutsites = new cutsites**[threads];
-    //msg("Finished creating queues");
-    Batch* batch = NULL;
-    int last_read_position = 0;
-    while(true){
-        for (int i = 0; i < threads; i++){
-            last_item[i] = -1;
-            queue_lens[i] = 0;
-        }
-        msg("Reading new batch");
-        batch = input->get_batch_buffering_lines();
 
-        if(batch == NULL){
-            msg("No batch returned, exiting.");
-            break;
-        }
-        lock_guard<mutex> guard(batch_lock);
-        //msg("Got the lock to process the batch");
-        int batch_len = batch->sequences_len;
-        //msg("batch seq len is ");
-        //msg(to_string(batch_len));
-        long chars_read_from_batch = 0;
-        int max_queue_len = batch_len / threads;
-        /*msg("Reading big batch");
-        input->read_n_chars(batch_len);
-        msg("Finished reading big batch");*/
-        FQEntry* fqrec = NULL;
-        //msg("Starting fqentries");
-        int last_queue = threads-1;
-        
-        while(batch->has_lines()){
-            fqrec = new FQEntry(last_read_position, batch);
-            last_read_position = fqrec->position;
+    if(progress) progress->stop();
+    //what the outputs still buffer is written as they close, the run fails if it can't be
+    if(close_streams() != 0 && !failed){
+        failed = true;
+        status = EXIT_FAILURE;
+    }
+    if(failed){
+        //the outputs are left as they are, and the checkpoint with them
+        throw TrimError{status};
+    }
 
-            int read_len = fqrec->seq.length();
-            chars_read_from_batch += read_len;
-            int smallest_queue = 0;
-            bool fitted_in_a_queue = false;
-            last_queue += 1;
-            int next_queue = (last_queue + 1)%threads;
-            int next_index = last_item[next_queue]+1;
-            if(next_index < queues[next_queue]->size()){
-                //msg("index");
-                //msg(to_string(next_index));
-                //msg("to");
-                //msg(to_string(next_queue));
-                //msg("of size");
-                //msg(to_string(queues[next_queue]->size()));
-                (*queues[next_queue])[next_index] = fqrec;
-            }else{
-                //msg("to");
-                //msg(to_string(next_queue));
-                queues[next_queue]->push_back(fqrec);
-            }
-            //queues[next_queue]->emplace(queues[next_queue]->begin()+last_item[next_queue]+1, fqrec);
-            queue_lens[next_queue] += read_len;
+    if(trace_fn){
+        res = trace_write(trace_fn);
+        if(res != 0) return res;
+    }
 
-            //fitted_in_a_queue = true;
-            last_item[next_queue] += 1;
+    if(stats){
+        res = stats->write_json(stats_fn);
+        if(res != 0) return res;
+    }
 
-            //if(!fitted_in_a_queue){
-                
-            //}
-        }
+    if(qc_fn){
+        const char* mate_names[] = {"reads"};
+        res = write_qc(mate_names);
+        if(res != 0) return res;
+    }
 
-        for (int i = 0; i < threads; i++){
-            filtered_reads[i] = new bool[queues[i]->size()];
-            bool* array = filtered_reads[i];
-            memset(array, false, sizeof(array[0])*queues[i]->size());
-            /*for(int j = 0; j < queues[i]->size(); j++){
-                if(array[j] != false){
-                    error("Array is not all false");
-                    exit(EXIT_FAILURE);
-                }
-            }*/
-            saved_cutsites[i] = new cutsites*[queues[i]->size()];
-            //msg(string("queue len for ") + to_string(i) + string(" is ") + to_string(queue_lens[i]));
-            //msg(string("queue size for ") + to_string(i) + string(" is ") + to_string(queues[i]->size()));
-        }
+    if (!quiet) fprintf(stdout, "\nSE input file: %s\n\nTotal FastQ records: %d\nFastQ records kept: %d\nFastQ records discarded: %d\n\n", infn, total, kept, discard);
 
-        msg(string("Batch length of ") + to_string(chars_read_from_batch));
-        //msg(string("Max is ") + to_string(batch_len));
+    //kseq_destroy(fqrec);
+    //delete(fqrec);
+    //gzclose(input);
+    finish_checkpoint();
 
-        if(chars_read_from_batch == 0){
-            break;
-        }
+    return EXIT_SUCCESS;
+}
 
-        //msg("Starting threads");
-        vector<thread> running;
-        for(int thread_n = 0; thread_n < threads; thread_n++){
-            running.push_back(thread(&Trim_Single::processing_thread,
-                this,
-                queues[thread_n], filtered_reads[thread_n], saved_cutsites[thread_n], last_item[thread_n], thread_n)
-            );
-            //processing_thread(queues[thread_n], filtered_reads[thread_n], saved_cutsites[thread_n], thread_n);
-        }
+RecordBatch* Trim_Single::next(int parts){
+    uint64_t reserved = 0;
+    timepoint stage_start, cycle_start;
+    if(budget){
+        TRACE_BEGIN("memory wait", batches_read);
+        reserved = input->block_bytes() + (uint64_t)batch_len * BATCH_OUTPUT_FACTOR;
+        budget->reserve(reserved);
+        TRACE_END("memory wait", batches_read);
+        cycle_start = stats_now();
+    }
+    if(stats) stage_start = stats_now();
+    TRACE_BEGIN("read", batches_read);
+    Batch* text;
+    try{
+        text = input->get_batch_buffering_lines();
+    }catch(TrimError &){
+        if(budget) budget->release(reserved);
+        throw;
+    }
+    TRACE_END("read", batches_read);
 
-        //msg("Joining all");
-        std::for_each(running.begin(),running.end(), std::mem_fn(&std::thread::join));
+    if(text == NULL){
+        msg("No batch returned, exiting.");
+        if(budget) budget->release(reserved);
+        return NULL;
+    }
+    SingleBatch* batch = new SingleBatch();
+    batch->text[0] = text;
+    batch->cycle_start = cycle_start;
+    batch->text_bytes = text->sequences_len + text->n_lines();
+    if(budget){
+        //the block as it was read into, with its growth
+        batch->memory = batch_memory(text->block_bytes(), batch->text_bytes, text->n_lines());
+        budget->resize(reserved, batch->memory);
+    }
+    TRACE_BEGIN("parse", batches_read);
+    if(stats){
+        batch->stats = stats->new_batch();
+        batch->stats->seconds[STAGE_READ] = seconds_between(stage_start, stats_now());
+        batch->stats->input_bytes = batch->text_bytes;
+        stage_start = stats_now();
+    }
+
+    //the arrays go with the batch, which gives them back to the pool once it is written
+    batch->parts = parts;
+    RecordArrays* records = batch->records[0] = record_pool.get();
+    records->reset(parts);
+    std::vector<std::vector<FQEntry*>* > &queues = records->queues;
+    std::vector<long> last_item(parts, -1);
+
+    FQEntry* fqrec = NULL;
+    int next_queue = 0;
+    try{
+        while(text->has_lines()){
+            fqrec = new FQEntry(last_read_position, text);
+            last_read_position = fqrec->position;
 
-        writing_results_flag = true;
-        thread output_thread(&Trim_Single::output_single,
-            this,
-            queues, filtered_reads, saved_cutsites, last_item, batch);
-        output_thread.detach();
+            queues[next_queue]->push_back(fqrec);
+            last_item[next_queue] += 1;
+            next_queue = (next_queue + 1) % parts;
+        }
+    }catch(TrimError &){
+        //the records before the bad one are freed with the batch
+        records->fit(last_item);
+        release_batch(batch);
+        throw;
     }
 
-    //#TODO: USELESS! the program still closes before the output finishs
-    while(writing_results_flag){
-        this_thread::sleep_for(chrono::milliseconds(100));
+    records->fit(last_item);
+
+    TRACE_END("parse", batches_read);
+    if(batch->stats){
+        batch->stats->records = text->n_lines() / 4;
+        batch->stats->seconds[STAGE_PARSE] = seconds_between(stage_start, stats_now());
     }
+    batch->positions = {{text->end_file, text->end_offset}};
+    batches_read++;
+    return batch;
+}
 
-    if (!quiet) fprintf(stdout, "\nSE input file: %s\n\nTotal FastQ records: %d\nFastQ records kept: %d\nFastQ records discarded: %d\n\n", infn, total, kept, discard);
+void Trim_Single::trimmed(RecordBatch* batch){
+    if(!budget) return;
+    InputBatch* input_batch = (InputBatch*)batch;
+    adapt_batch_len(input_batch->text_bytes, seconds_between(input_batch->cycle_start, stats_now()));
+    input->set_batch_len(batch_len);
+}
 
-    //kseq_destroy(fqrec);
-    //delete(fqrec);
-    //gzclose(input);
-    close_streams();
+void Trim_Single::release(RecordBatch* batch){
+    release_batch((InputBatch*)batch);
+}
 
-    return EXIT_SUCCESS;
+void Trim_Single::localize(RecordBatch* batch, int part){
+    localize_part(batch, part);
 }
 
-void Trim_Single::processing_thread(std::vector<FQEntry*>* local_queue, bool* filtered,
-    cutsites** saved_cutsites, long last_index, int thread_n)
-{
-    msg(string("Processing thread ") + to_string(thread_n) + string(", reads: ") + to_string(last_index+1));
-    FQEntry* fqrec;
-    //cutsites *p1cut;
-    for(int i = 0; i <= last_index; i++){
-        fqrec = local_queue->at(i);
-        //msg("running sliding window");
-        saved_cutsites[i] = sliding_window(*fqrec);
-        //if (debug) printf("P1cut: %d,%d\n", p1cut->five_prime_cut, p1cut->three_prime_cut);
-        if(!(saved_cutsites[i]->three_prime_cut >= 0)) filtered[i] = true;
-        //output_single(fqrec, p1cut);
-        //free(p1cut);
-    }
+void Trim_Single::start(int qualtype){
+    start_run(qualtype);
 }
 
-void Trim_Single::output_single(std::vector<std::vector<FQEntry*>* > queues,
-    bool** filtered_reads, cutsites*** saved_cutsites,
-    vector<long> last_index, Batch* batch)
-{
-    std::stringstream to_print;
-    msg("Making results string");
-    lock_guard<mutex> guard(batch_lock);
-    //msg("Got the lock to actually make it");
-    for (size_t i = 0; i < threads; i++){
-        //msg("Processing thread");
-        if(!queues[i]->empty()){
-            for (size_t j = 0; j <= last_index[i]; j++)
-            {
-                //msg("Parsing read");
-                FQEntry* read = queues[i]->at(j);
-                cutsites* cs = saved_cutsites[i][j];
-                if(filtered_reads[i][j]){
-                    discard++;
-                }else{
-                    to_print << read->name << "\n";
-                    to_print << read->seq.substr(cs->five_prime_cut, cs->three_prime_cut - cs->five_prime_cut) << "\n";
-                    to_print << read->comment << "\n";
-                    to_print << read->qual.substr(cs->five_prime_cut, cs->three_prime_cut - cs->five_prime_cut) << "\n";
-                    kept++;
+void Trim_Single::part_trimmed(RecordBatch* batch, int part){
+    collect_part(batch, part);
+}
+
+void Trim_Single::format(RecordBatch* batch){
+    SingleBatch* single = (SingleBatch*)batch;
+    RecordArrays* records = single->records[0];
+    //FASTQ output is never bigger than the input; binary output grows past it with N runs
+    Batch* text = single->text[0];
+    size_t text_len = text->sequences_len + text->n_lines();
+    single->out = new OutputBuffer(pool, binary_output ? sqb_output_len(text_len, text->n_lines() / 4) : text_len);
+    OutputBuffer &to_print = *single->out;
+    timepoint stage_start;
+    if(single->stats) stage_start = stats_now();
+    TRACE_BEGIN("format", single->n);
+    for (int i = 0; i < single->parts; i++){
+        for (size_t j = 0; j < records->queues[i]->size(); j++)
+        {
+            if(records->filtered[i][j]){
+                single->discard++;
+                if(splitter) single->kinds.push_back(SPLIT_DISCARDED);
+            }else{
+                append_read(to_print, records->queues[i]->at(j), records->cuts[i][j]);
+                single->kept++;
+                if(splitter){
+                    single->kinds.push_back(SPLIT_KEPT);
+                    single->ends.push_back(to_print.length());
                 }
-                delete (read);
-                //free(read);
-                free(cs);
-                //msg("Parsed read");
             }
         }
-        //msg("Processed thread");
     }
+    if(single->stats){
+        single->stats->seconds[STAGE_FORMAT] = seconds_between(stage_start, stats_now());
+        single->stats->output_bytes = to_print.length();
+    }
+    TRACE_END("format", single->n);
+}
 
+void Trim_Single::write(RecordBatch* batch){
+    SingleBatch* single = (SingleBatch*)batch;
+    //batches are written one at a time, in input order
+    kept += single->kept;
+    discard += single->discard;
     total = kept + discard;
-    guard.~lock_guard();
-    //msg("Finished results string");
-    //#TODO:NOT WRITING ANYTHING
-    msg("Outputing");
-    if (!gzip_output) {
-        msg(string("writing to ") + string(outfn));
-        outfile << to_print.str();
-        //fprintf(outfile, "%s", to_print.str() );
+    std::string_view content = single->out->content();
+    timepoint stage_start;
+    if(single->stats) stage_start = stats_now();
+    TRACE_BEGIN(gzip_output ? "compress" : "write", single->n);
+    if (splitter) {
+        splitter->write(single->kinds, {{content, &single->ends}});
     } else {
-        gzprintf(outfile_gzip, to_print.str().c_str());
+        write_output(outfn, outfile, outfile_gzip, content);
     }
-
-    msg("Deleting batch");
-    batch->free_this();
-    delete(batch);
-    msg("Batch deleted");
-    //msg("Writing flag");
-    writing_results_flag = false;
-    msg("Finished outputing results");
+    TRACE_END(gzip_output ? "compress" : "write", single->n);
+    if(single->stats) single->stats->seconds[gzip_output ? STAGE_COMPRESS : STAGE_WRITE] = seconds_between(stage_start, stats_now());
+    if(checkpoint_fn) save_checkpoint(single->positions);
 }
 
 int Trim_Single::init_streams(){
     msg("Initializing streams");
-    input = new GZReader(infn, batch_len, false);
-    if (!input) {
-        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", infn);
+    input = new GZReader(infn, batch_len, false, pool);
+    input->set_long_reads(long_reads);
+    if (follow) input->set_follow(follow_sentinel, follow_timeout);
+    //the reader says which file it couldn't open
+    if (!input->is_open() || resume_input(input, 0) != 0) {
         return EXIT_FAILURE;
     }
 
-    if (!gzip_output) {
-        //outfile = fopen(outfn, "w");
-        outfile.open(outfn);
-        if (outfile.fail()) {
-            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
-            return EXIT_FAILURE;
-        }
-    } else {
-        outfile_gzip = gzopen(outfn, "w");
-        if (!outfile_gzip) {
-            fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
-            return EXIT_FAILURE;
-        }
+    int res = init_splitter();
+    if (res != 0) return res;
+    if (splitter) {
+        splitter->add_output(outfn, false);
+        return splitter->open();
+    }
+
+    //outfile = fopen(outfn, "w");
+    if (open_output(outfn, outfile, outfile_gzip) != 0) {
+        fprintf(stderr, "****Error: Could not open output file '%s'.\n\n", outfn);
+        return EXIT_FAILURE;
     }
 
     //msg("Finished initializing streams");
     return 0;
 }
 
-void Trim_Single::close_streams(){
+int Trim_Single::close_streams(){
     //msg("closing gzreader");
     delete(input);
+    //freed by the reader
+    input = NULL;
+    infn = NULL;
 
-    if (!gzip_output){
-        //msg("closing outfile");
-        outfile.close();
-    }else{
-        //msg("closing gz outfile");
-        gzclose(outfile_gzip);
-    }
+    if (splitter) return splitter->close();
+    //msg("closing outfile");
+    return close_output(outfn, outfile, outfile_gzip);
 }
\ No newline at end of file
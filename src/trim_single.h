@@ -5,23 +5,51 @@
 #include <mutex>
 #include <cstdint>
 #include <experimental/filesystem>
+#include <getopt.h>
 #include "trim.h"
 
-class Trim_Single : public Abstract_Trimmer{
+//The long options of se, also for the runners that check the options of their jobs
+extern struct option single_long_options[];
+
+/* sickle se: a Pipeline from the input file to the output file, which it
+is the source and the sink of */
+class Trim_Single : public Abstract_Trimmer, public RecordSource, public RecordSink{
 public:
     Trim_Single();
+    ~Trim_Single();
     int parse_args(int argc, char *argv[]);
     int recommended_batch_len(const char* path, int max_len);
     int trim_main();
-    void processing_thread(std::vector<FQEntry*>* local_queue, bool* filtered, 
-        cutsites** saved_cutsites, long last_index, int thread_n);
     void usage(int status, char const *msg);
-    void output_single(std::vector<std::vector<FQEntry*>* > queues, bool** filtered_reads, 
-        cutsites*** saved_cutsites, vector<long> last_index, Batch* batch);
     int init_streams();
-    void close_streams();
+    //EXIT_FAILURE if an output couldn't be written whole
+    int close_streams();
+
+    RecordBatch* next(int parts);
+    void trimmed(RecordBatch* batch);
+    void release(RecordBatch* batch);
+    void localize(RecordBatch* batch, int part);
+    void start(int qualtype);
+    void part_trimmed(RecordBatch* batch, int part);
+    void format(RecordBatch* batch);
+    void write(RecordBatch* batch);
 private:
-    mutex batch_lock;
+    //records of any length, in batches of batch_len bases
+    int long_reads;
+    //batches read so far, for the trace events of the reading
+    long batches_read;
+    int last_read_position;
+};
+
+/* A batch of se as format leaves it for write */
+struct SingleBatch: public InputBatch{
+    ~SingleBatch(){ delete(out); }
+    OutputBuffer* out = NULL;
+    //with a splitter, what happened to each record and where the kept ones end
+    std::vector<char> kinds;
+    std::vector<size_t> ends;
+    int kept = 0;
+    int discard = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <thread>
+#include "watch.h"
+
+using namespace std;
+
+/* Options of se and pe for files written over time, or to several outputs;
+the outputs of watch are renamed whole */
+static const char* const whole_file_options[] = {
+    "--follow", "--follow-sentinel", "--follow-timeout", "--split-reads", "--split-parts", NULL
+};
+
+static const char* const fastq_extensions[] = {".fastq.gz", ".fq.gz", ".fastq", ".fq", NULL};
+
+static volatile sig_atomic_t watch_signalled = 0;
+
+static void watch_signal(int){
+    watch_signalled = 1;
+}
+
+/* Position of the FASTQ extension of name, or npos if it has none */
+static size_t fastq_extension(const string &name){
+    for(int i = 0; fastq_extensions[i]; i++){
+        size_t len = strlen(fastq_extensions[i]);
+        if(name.length() > len && name.compare(name.length() - len, len, fastq_extensions[i]) == 0) return name.length() - len;
+    }
+    return string::npos;
+}
+
+/* Position of the mate number (1 or 2) of an R1 or R2 file, as in S_R1_001.fq.gz
+or S_1.fq, or npos if name isn't one */
+static size_t mate_position(const string &name){
+    size_t ext = fastq_extension(name);
+    for(size_t pos = name.rfind("_R", ext); pos != string::npos && pos > 0; pos = name.rfind("_R", pos - 1)){
+        char number = name[pos+2], after = name[pos+3];
+        if((number == '1' || number == '2') && (after == '_' || after == '.')) return pos + 2;
+    }
+    if(ext >= 2 && name[ext-2] == '_' && (name[ext-1] == '1' || name[ext-1] == '2')) return ext - 1;
+    return string::npos;
+}
+
+/* Output name of an input: without .gz, unless the output is gzipped */
+static string output_name(const string &name, bool gzip){
+    string plain = name.compare(name.length() - 3, 3, ".gz") == 0 ? name.substr(0, name.length() - 3) : name;
+    return gzip ? plain + ".gz" : plain;
+}
+
+/* Whether a and b read one of the same files */
+static bool same_input(const WatchJob* a, const WatchJob* b){
+    for(size_t i = 0; i < a->inputs.size(); i++){
+        if(find(b->inputs.begin(), b->inputs.end(), a->inputs[i]) != b->inputs.end()) return true;
+    }
+    return false;
+}
+
+DirectoryWatcher::DirectoryWatcher() : runner("--jobs", DEFAULT_WATCH_JOBS){
+    in_dir = NULL;
+    out_dir = NULL;
+    quiet = 0;
+    existing = 0;
+    gzip_output = false;
+    file_mode = 0644;
+    stopping = false;
+    done = 0;
+    failed = 0;
+}
+
+DirectoryWatcher::~DirectoryWatcher(){
+    for(size_t i = 0; i < queue.size(); i++) delete(queue[i]);
+    for(size_t i = 0; i < deferred.size(); i++) delete(deferred[i]);
+    free(in_dir);
+    free(out_dir);
+}
+
+void DirectoryWatcher::usage(int status, char const *msg){
+    fprintf(stderr, "\nUsage: %s watch --in <input directory> --out <output directory> -t <quality type> [options]\n\
+\n\
+Options:\n\
+--in, Directory to watch for FASTQ files (.fastq, .fq, .fastq.gz or .fq.gz), trimmed once they are closed (required).\n\
+\tR1 and R2 files (as S_R1_001.fq.gz and S_R2_001.fq.gz, or S_1.fq and S_2.fq) are trimmed together\n\
+\twith pe once both are closed, with the singles in S_singles_001.fq; other files with se.\n\
+--out, Directory of the trimmed files, which have the names of the inputs (required).\n\
+--existing, Also trim the files that are in the input directory when starting.\n\
+--jobs, Files (or pairs) trimmed at once, sharing the threads and batch buffers. Default %d.\n\
+-a, --threads, Threads of all the files trimmed at once. Default %d.\n\
+--max-memory, Memory limit of the batches of all the files, as for se and pe.\n\
+--hugepages, Back the batch buffers with transparent huge pages.\n\
+--quiet, Don't print each file as it is done.\n\
+--help, display this help and exit\n\
+\n\
+The other options are those of se and pe (-t, -q, -l, -x, -n, -g, -b, the filters...) and apply to\n\
+every file. The outputs are written as hidden temporary files of the output directory and renamed\n\
+when done. Stops on SIGINT or SIGTERM, after the files being trimmed.\n\n",
+        PROGRAM_NAME, DEFAULT_WATCH_JOBS, DEFAULT_THREADS);
+
+    if (msg) fprintf(stderr, "%s\n\n", msg);
+    exit(status);
+}
+
+int DirectoryWatcher::parse_args(int argc, char *argv[]){
+    for(int i = 2; i < argc; i++){
+        int res = runner.parse_arg(argc, argv, i);
+        if(res == 0) continue;
+        if(res != -1) return res;
+        string arg = argv[i];
+        string name = arg.substr(0, arg.find('='));
+        bool inline_value = name.length() < arg.length();
+        if(name == "--in" || name == "--out"){
+            const char* value;
+            if(inline_value){
+                value = argv[i] + name.length() + 1;
+            }else if(i + 1 < argc){
+                value = argv[++i];
+            }else{
+                fprintf(stderr, "****Error: %s needs a value.\n\n", name.c_str());
+                return EXIT_FAILURE;
+            }
+            if(name == "--in"){
+                free(in_dir);
+                in_dir = strdup(value);
+            }else{
+                free(out_dir);
+                out_dir = strdup(value);
+            }
+        }else if(arg == "--help"){
+            usage(EXIT_SUCCESS, NULL);
+        }else if(arg == "--quiet"){
+            quiet = 1;
+        }else if(arg == "--existing"){
+            existing = 1;
+        }else if(job_option_in_list(job_file_options, name) || job_option_in_list(job_report_options, name)
+            || job_option_in_list(job_process_options, name) || job_option_in_list(job_checkpoint_options, name)
+            || job_option_in_list(whole_file_options, name)){
+            //the per run reports would be written by every file to the same one
+            fprintf(stderr, "****Error: %s is not an option of watch, the files come from the watched directory.\n\n", name.c_str());
+            return EXIT_FAILURE;
+        }else{
+            //-g alone or among other flags, as in -xg
+            if(job_option_name("se", arg) == "--gzip-output" || (arg.length() > 1 && arg[0] == '-' && arg[1] != '-'
+                && arg.find('g') != string::npos && arg.find_first_not_of("-dxngzG") == string::npos)) gzip_output = true;
+            trim_args.push_back(arg);
+        }
+    }
+
+    if(!in_dir || !out_dir){
+        usage(EXIT_FAILURE, "****Error: Must have an input and an output directory.");
+    }
+    bool has_qualtype = false;
+    for(size_t i = 0; i < trim_args.size(); i++){
+        if(trim_args[i] == "-t" || job_option_name("se", trim_args[i].substr(0, trim_args[i].find('='))) == "--qual-type") has_qualtype = true;
+    }
+    if(!has_qualtype){
+        usage(EXIT_FAILURE, "****Error: Must have quality type.");
+    }
+
+    char in_path[PATH_MAX], out_path[PATH_MAX];
+    if(!realpath(in_dir, in_path)){
+        fprintf(stderr, "****Error: Could not open input directory '%s'.\n\n", in_dir);
+        return EXIT_FAILURE;
+    }
+    if(!realpath(out_dir, out_path)){
+        fprintf(stderr, "****Error: Could not open output directory '%s'.\n\n", out_dir);
+        return EXIT_FAILURE;
+    }
+    //the renamed outputs would be new files to trim
+    if(strcmp(in_path, out_path) == 0){
+        fprintf(stderr, "****Error: The input and output directories must be different.\n\n");
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+void DirectoryWatcher::file_closed(const string &name){
+    //hidden files are the temporary files of other programs
+    if(name.empty() || name[0] == '.' || fastq_extension(name) == string::npos) return;
+    //the same file may be found by --existing and closed for inotify, or closed without a change
+    struct stat info;
+    if(stat((string(in_dir) + "/" + name).c_str(), &info) != 0) return;
+    FileVersion version = {(long)info.st_mtim.tv_sec, info.st_mtim.tv_nsec, (long)info.st_size};
+    auto seen = versions.find(name);
+    if(seen != versions.end() && seen->second == version) return;
+    versions[name] = version;
+
+    WatchJob* job = new WatchJob();
+    size_t mate = mate_position(name);
+    if(mate == string::npos){
+        job->type = "se";
+        job->inputs.push_back(name);
+        job->outputs.push_back(output_name(name, gzip_output));
+        queue_job(job);
+        return;
+    }
+
+    string mate_name = name;
+    mate_name[mate] = name[mate] == '1' ? '2' : '1';
+    auto waiting = waiting_mates.find(name);
+    if(waiting == waiting_mates.end()){
+        waiting_mates[mate_name] = name;
+        delete(job);
+        return;
+    }
+    waiting_mates.erase(waiting);
+    job->type = "pe";
+    string r1 = name[mate] == '1' ? name : mate_name;
+    string r2 = name[mate] == '1' ? mate_name : name;
+    job->inputs.push_back(r1);
+    job->inputs.push_back(r2);
+    job->outputs.push_back(output_name(r1, gzip_output));
+    job->outputs.push_back(output_name(r2, gzip_output));
+    //S_R1_001.fq is S_singles_001.fq, S_1.fq is S_singles.fq
+    size_t number_start = r1[mate-1] == 'R' ? mate - 1 : mate;
+    job->outputs.push_back(output_name(r1.substr(0, number_start) + "singles" + r1.substr(mate + 1), gzip_output));
+    queue_job(job);
+}
+
+void DirectoryWatcher::queue_job(WatchJob* job){
+    {
+        lock_guard<mutex> guard(lock);
+        //a job that hasn't started yet reads the file as it is now
+        for(size_t i = 0; i < queue.size(); i++){
+            if(same_input(queue[i], job)){
+                delete(job);
+                return;
+            }
+        }
+        for(size_t i = 0; i < deferred.size(); i++){
+            if(same_input(deferred[i], job)){
+                delete(job);
+                return;
+            }
+        }
+        //one being trimmed has read part of the old file, so it's trimmed again once done
+        for(size_t i = 0; i < running.size(); i++){
+            if(same_input(running[i], job)){
+                deferred.push_back(job);
+                return;
+            }
+        }
+        queue.push_back(job);
+    }
+    changed.notify_one();
+}
+
+void DirectoryWatcher::finish_job(WatchJob* job){
+    {
+        lock_guard<mutex> guard(lock);
+        running.erase(find(running.begin(), running.end(), job));
+        for(size_t i = 0; i < deferred.size(); ){
+            bool blocked = false;
+            for(size_t j = 0; j < running.size(); j++) blocked = blocked || same_input(running[j], deferred[i]);
+            if(blocked){
+                i++;
+                continue;
+            }
+            queue.push_back(deferred[i]);
+            deferred.erase(deferred.begin() + i);
+        }
+    }
+    changed.notify_all();
+    delete(job);
+}
+
+int DirectoryWatcher::trim_job(WatchJob* job){
+    vector<string> args = trim_args;
+    const char* input_flags[] = {"-f", "-r"};
+    const char* output_flags[] = {"-o", "-p", "-s"};
+    for(size_t i = 0; i < job->inputs.size(); i++){
+        args.push_back(input_flags[i]);
+        args.push_back(string(in_dir) + "/" + job->inputs[i]);
+    }
+    //unique names, as a file trimmed again or a.fq and a.fq.gz have the same outputs
+    vector<string> temps;
+    for(size_t i = 0; i < job->outputs.size(); i++){
+        string temp = string(out_dir) + "/." + job->outputs[i] + ".XXXXXX";
+        int fd = mkstemp(&temp[0]);
+        if(fd < 0){
+            fprintf(stderr, "****Error: Could not create a temporary file in '%s': %s.\n\n", out_dir, strerror(errno));
+            break;
+        }
+        //mkstemp makes it private to the user, the output gets the mode of a new file
+        fchmod(fd, file_mode);
+        close(fd);
+        temps.push_back(temp);
+        args.push_back(output_flags[i]);
+        args.push_back(temp);
+    }
+    JobResult result = {EXIT_FAILURE, 0, 0, 0, 0};
+    Abstract_Trimmer* trimmer = temps.size() == job->outputs.size() ? runner.prepare_job(job->type, args) : NULL;
+    if(trimmer){
+        result = runner.run_job(trimmer);
+        //closes the outputs before they are renamed
+        delete(trimmer);
+    }
+    int res = result.status;
+
+    for(size_t i = 0; i < temps.size(); i++){
+        const string &temp = temps[i];
+        string final = string(out_dir) + "/" + job->outputs[i];
+        if(res != 0){
+            unlink(temp.c_str());
+        }else if(rename(temp.c_str(), final.c_str()) != 0){
+            fprintf(stderr, "****Error: Could not rename '%s' to '%s': %s.\n\n", temp.c_str(), final.c_str(), strerror(errno));
+            unlink(temp.c_str());
+            res = EXIT_FAILURE;
+        }
+    }
+    if(!quiet){
+        lock_guard<mutex> guard(lock);
+        string inputs = job->inputs[0] + (job->inputs.size() > 1 ? " " + job->inputs[1] : "");
+        fprintf(stdout, "%s (%s): %ld records, %ld kept, %ld discarded%s\n", inputs.c_str(), job->type.c_str(),
+            result.records, result.kept, result.discarded, res == 0 ? "" : ", failed");
+        fflush(stdout);
+    }
+    return res;
+}
+
+void DirectoryWatcher::run_jobs(){
+    while(true){
+        WatchJob* job;
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [this]{ return stopping || !queue.empty(); });
+            //the files already queued are trimmed before stopping
+            if(queue.empty()) return;
+            job = queue.front();
+            queue.pop_front();
+            running.push_back(job);
+        }
+        int res = trim_job(job);
+        {
+            lock_guard<mutex> guard(lock);
+            if(res == 0) done++;
+            else failed++;
+        }
+        finish_job(job);
+    }
+}
+
+int DirectoryWatcher::run_main(){
+    int watch_fd = inotify_init1(IN_CLOEXEC);
+    //close write: a file written in place is done; moved to: one written elsewhere is moved in
+    if(watch_fd < 0 || inotify_add_watch(watch_fd, in_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+        fprintf(stderr, "****Error: Could not watch input directory '%s': %s.\n\n", in_dir, strerror(errno));
+        if(watch_fd >= 0) close(watch_fd);
+        return EXIT_FAILURE;
+    }
+    runner.start();
+    mode_t mask = umask(0);
+    umask(mask);
+    file_mode = 0666 & ~mask;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = watch_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    //after the watch is set, so a file closed meanwhile is seen by one or the other
+    if(existing){
+        DIR* dir = opendir(in_dir);
+        vector<string> names;
+        struct dirent* entry;
+        while(dir && (entry = readdir(dir))){
+            struct stat info;
+            string path = string(in_dir) + "/" + entry->d_name;
+            if(stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) names.push_back(entry->d_name);
+        }
+        if(dir) closedir(dir);
+        sort(names.begin(), names.end());
+        for(size_t i = 0; i < names.size(); i++) file_closed(names[i]);
+    }
+
+    vector<thread> workers;
+    for(int i = 0; i < runner.jobs; i++) workers.push_back(thread(&DirectoryWatcher::run_jobs, this));
+    if(!quiet){
+        fprintf(stdout, "Watching '%s', trimmed files go to '%s'\n", in_dir, out_dir);
+        fflush(stdout);
+    }
+
+    char events[64 * (sizeof(struct inotify_event) + NAME_MAX + 1)] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while(!watch_signalled){
+        struct pollfd waiting = {watch_fd, POLLIN, 0};
+        if(poll(&waiting, 1, 500) <= 0) continue;
+        ssize_t len = read(watch_fd, events, sizeof(events));
+        if(len <= 0) continue;
+        for(char* next = events; next < events + len; ){
+            struct inotify_event* event = (struct inotify_event*)next;
+            if(event->len > 0 && !(event->mask & IN_ISDIR)) file_closed(event->name);
+            if(event->mask & IN_Q_OVERFLOW) fprintf(stderr, "Warning: Too many files at once, some of '%s' were missed.\n", in_dir);
+            next += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    close(watch_fd);
+
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+    for(auto &waiting: waiting_mates){
+        fprintf(stderr, "Warning: '%s' was not trimmed, its mate '%s' never came.\n", waiting.second.c_str(), waiting.first.c_str());
+    }
+    if(!quiet) fprintf(stdout, "\nFiles trimmed: %ld, failed: %ld\n\n", done, failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
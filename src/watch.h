@@ -0,0 +1,88 @@
+#ifndef _WATCH_
+#define _WATCH_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "runner.h"
+
+/* Files of sickle watch trimmed at the same time */
+#ifndef DEFAULT_WATCH_JOBS
+#define DEFAULT_WATCH_JOBS 2
+#endif
+
+/* A file, or a pair of R1 and R2 files, of the watched directory */
+struct WatchJob{
+    //se or pe
+    std::string type;
+    //names in the input directory, R1 first
+    std::vector<std::string> inputs;
+    //names in the output directory: the reads (R1 and R2) and the singles of pe
+    std::vector<std::string> outputs;
+};
+
+/* mtime and size of a file when it was queued, to tell a file closed again
+from the same one seen twice */
+struct FileVersion{
+    long seconds, nanoseconds;
+    long size;
+    bool operator==(const FileVersion &other) const{
+        return seconds == other.seconds && nanoseconds == other.nanoseconds && size == other.size;
+    }
+};
+
+/* `sickle watch`, trims the FASTQ files written to a directory as they are
+closed (inotify), with one pipeline for all of them: a few files are in flight
+at once, sharing the threads, the batch buffers and the --max-memory budget.
+R1 and R2 files of a pair are trimmed together with pe once both are there,
+other files with se. The outputs are written to temporary files of the
+output directory and renamed when done, so whatever reads them never sees a
+partial file. */
+class DirectoryWatcher{
+public:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+    int parse_args(int argc, char *argv[]);
+    int run_main();
+    void usage(int status, char const *msg);
+private:
+    void file_closed(const std::string &name);
+    void queue_job(WatchJob* job);
+    //takes a trimmed job off running, and queues the ones deferred for it
+    void finish_job(WatchJob* job);
+    void run_jobs();
+    int trim_job(WatchJob* job);
+
+    char* in_dir;
+    char* out_dir;
+    int quiet;
+    int existing;
+    bool gzip_output;
+    //of the renamed outputs, as for a file created under the umask
+    mode_t file_mode;
+    //options given for all files, as for sickle se and pe
+    std::vector<std::string> trim_args;
+
+    //--jobs, -a, --max-memory and --hugepages
+    JobRunner runner;
+    //R1 or R2 files whose mate hasn't been closed yet, by the name of the mate
+    std::map<std::string, std::string> waiting_mates;
+    //of the files queued, by name
+    std::map<std::string, FileVersion> versions;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::deque<WatchJob*> queue;
+    std::vector<WatchJob*> running;
+    //jobs of files closed again while being trimmed, queued once that is done
+    std::vector<WatchJob*> deferred;
+    bool stopping;
+    long done;
+    long failed;
+};
+
+#endif
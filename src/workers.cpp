@@ -0,0 +1,101 @@
+#include "workers.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(int threads){
+    next_queue = 0;
+    last_served = -1;
+    stopping = false;
+    for(int i = 0; i < threads; i++) this->threads.push_back(thread(&WorkerPool::work, this));
+}
+
+WorkerPool::~WorkerPool(){
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    queued.notify_all();
+    for(size_t i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+int WorkerPool::size(){
+    return threads.size();
+}
+
+int WorkerPool::open_queue(){
+    lock_guard<mutex> guard(lock);
+    queues[next_queue];
+    return next_queue++;
+}
+
+void WorkerPool::close_queue(int queue){
+    lock_guard<mutex> guard(lock);
+    queues.erase(queue);
+}
+
+void WorkerPool::submit(int queue, function<void()> task){
+    {
+        lock_guard<mutex> guard(lock);
+        queues[queue].push_back(task);
+    }
+    queued.notify_one();
+}
+
+void WorkerPool::work(){
+    unique_lock<mutex> guard(lock);
+    while(true){
+        //the first queue with tasks after the one served last, in turns
+        map<int, deque<function<void()> > >::iterator next = queues.upper_bound(last_served);
+        while(next != queues.end() && next->second.empty()) next++;
+        if(next == queues.end()){
+            next = queues.begin();
+            while(next != queues.end() && next->second.empty()) next++;
+        }
+        if(next == queues.end()){
+            if(stopping) return;
+            queued.wait(guard);
+            continue;
+        }
+        function<void()> task = next->second.front();
+        next->second.pop_front();
+        last_served = next->first;
+        guard.unlock();
+        task();
+        guard.lock();
+    }
+}
+
+TaskGroup::TaskGroup(WorkerPool* pool, int queue){
+    this->pool = pool;
+    this->queue = queue;
+    pending = 0;
+}
+
+void TaskGroup::run(function<void()> task){
+    {
+        lock_guard<mutex> guard(lock);
+        pending++;
+    }
+    pool->submit(queue, [this, task]{
+        exception_ptr thrown;
+        try{
+            task();
+        }catch(...){
+            thrown = current_exception();
+        }
+        lock_guard<mutex> guard(lock);
+        if(thrown && !error) error = thrown;
+        //under the lock, so wait() (and the end of the group) comes after this task lets go of it
+        if(--pending == 0) done.notify_all();
+    });
+}
+
+void TaskGroup::wait(){
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [this]{ return pending == 0; });
+    if(error){
+        exception_ptr thrown = error;
+        error = NULL;
+        rethrow_exception(thrown);
+    }
+}
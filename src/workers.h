@@ -0,0 +1,58 @@
+#ifndef _WORKERS_
+#define _WORKERS_
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Threads that trim, format and write the batches of every run of the
+process, started once and kept warm between batches and runs. Each run
+submits its tasks to its own queue, and the threads take them from the
+queues in turns, so a run with many batches queued doesn't hold the others
+back. A task must never wait for another one: the threads only wait for
+tasks to run. */
+class WorkerPool{
+public:
+    WorkerPool(int threads);
+    //Runs the tasks still queued, then joins the threads
+    ~WorkerPool();
+    int size();
+    //A queue for the tasks of a run, served in turns with the others
+    int open_queue();
+    //Once the tasks of the queue are done
+    void close_queue(int queue);
+    void submit(int queue, std::function<void()> task);
+private:
+    void work();
+    std::mutex lock;
+    std::condition_variable queued;
+    std::vector<std::thread> threads;
+    std::map<int, std::deque<std::function<void()> > > queues;
+    int next_queue;
+    //the queue the last task was taken from
+    int last_served;
+    bool stopping;
+};
+
+/* Tasks of one queue of a pool waited for together. wait() rethrows the
+first exception a task threw, once they are all done. */
+class TaskGroup{
+public:
+    TaskGroup(WorkerPool* pool, int queue);
+    void run(std::function<void()> task);
+    void wait();
+private:
+    WorkerPool* pool;
+    int queue;
+    std::mutex lock;
+    std::condition_variable done;
+    int pending;
+    std::exception_ptr error;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "libsickle.h"
+
+/* Trims a FASTQ file with the Trimmer of libsickle.a, with the defaults of
+sickle se -t sanger, for make test_lib to compare with sickle se */
+int main(int argc, char *argv[]){
+    if(argc != 3){
+        fprintf(stderr, "Usage: %s <fastq file> <trimmed fastq file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    if(!in){
+        fprintf(stderr, "****Error: Could not open input file '%s'.\n\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    std::string fastq = text.str();
+
+    TrimConfig config;
+    Trimmer trimmer(config);
+    std::vector<char> out(fastq.length() + 1);
+    TrimCounts counts;
+    long written = trimmer.trim_fastq(fastq, out.data(), out.size(), &counts);
+    if(written < 0){
+        fprintf(stderr, "****Error: '%s' has a malformed record or a quality out of range.\n\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(argv[2], "wb");
+    if(!file || fwrite(out.data(), 1, written, file) != (size_t)written || fclose(file) != 0){
+        fprintf(stderr, "****Error: Could not write to output file '%s'.\n\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    printf("%ld records, %ld kept, %ld discarded\n", counts.records, counts.kept, counts.discarded);
+    return EXIT_SUCCESS;
+}